@@ -70,7 +70,6 @@ typedef enum EntityArchetype
 // Structure representing an Entity, containing its attributes and state
 typedef struct Entity
 {
-	bool is_valid;		  // Flag to indicate if the entity is active/valid
 	EntityArchetype arch; // The archetype/type of the entity
 	Vector2 pos;		  // Position of the entity in the world
 	bool render_sprite;	  // Flag to determine if the entity should render a sprite
@@ -93,7 +92,7 @@ typedef struct Stats
 // World structure containing all entities
 typedef struct World
 {
-	Entity entities[MAX_ENTITY_COUNT];
+	Pool *entities; // Entity pool, O(1) create/destroy
 } World;
 
 // Global pointer to the world instance
@@ -104,26 +103,15 @@ World *world = 0;
 // Function to create a new entity
 Entity *entity_create()
 {
-	Entity *entity_found = 0;
-	for (int i = 0; i < MAX_ENTITY_COUNT; i++)
-	{
-		Entity *existing_entity = &world->entities[i];
-		if (!existing_entity->is_valid)
-		{
-			entity_found = existing_entity;
-			break;
-		}
-	}
-	// Ensure an entity was found
-	assert(entity_found, "No more free entities!");
-	entity_found->is_valid = true;
-	return entity_found;
+	// The pool asserts if it's full and hands back zeroed memory
+	Pool_Handle handle = pool_add(world->entities);
+	return pool_get(world->entities, handle);
 }
 
-// Function to destroy an entity and reset its data
+// Function to destroy an entity, its slot is reused by the next entity_create
 void entity_destroy(Entity *entity)
 {
-	memset(entity, 0, sizeof(Entity)); // Clear the memory of the entity
+	pool_remove(world->entities, pool_get_handle(world->entities, entity));
 }
 
 // ENTITY SETUP FUNCTIONS
@@ -249,6 +237,7 @@ int entry(int argc, char **argv)
 
 	// Allocate memory for the world
 	world = alloc(get_heap_allocator(), sizeof(World));
+	world->entities = make_pool(Entity, MAX_ENTITY_COUNT);
 
 	// LOAD FONT
 	Gfx_Font *font_mono = load_font_from_disk(STR("assets/fonts/monogram/ttf/monogram.ttf"), get_heap_allocator());
@@ -320,24 +309,20 @@ int entry(int argc, char **argv)
 		os_update();
 
 		// RENDERING
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++)
+		for (Entity *en = pool_first(world->entities); en; en = pool_next(world->entities, en))
 		{
-			Entity *en = &world->entities[i];
-			if (en->is_valid)
+			// Render the entity based on its archetype and sprite
+			switch (en->arch)
+			{
+			default:
 			{
-				// Render the entity based on its archetype and sprite
-				switch (en->arch)
-				{
-				default:
-				{
-					Sprite *sprite = get_sprite(en->sprite_id);
-					Matrix4 xform = m4_scalar(1.0);
-					xform = m4_translate(xform, v3(en->pos.x, en->pos.y, 0));
-					xform = m4_translate(xform, v3(sprite->size.x * -0.5, 0.0, 0));
-					draw_image_xform(sprite->image, xform, sprite->size, COLOR_WHITE);
-				}
-				break;
-				}
+				Sprite *sprite = get_sprite(en->sprite_id);
+				Matrix4 xform = m4_scalar(1.0);
+				xform = m4_translate(xform, v3(en->pos.x, en->pos.y, 0));
+				xform = m4_translate(xform, v3(sprite->size.x * -0.5, 0.0, 0));
+				draw_image_xform(sprite->image, xform, sprite->size, COLOR_WHITE);
+			}
+			break;
 			}
 		}
 
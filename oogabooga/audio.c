@@ -19,7 +19,8 @@
 	Audio_Player * audio_player_get_one();
 	void           audio_player_release(Audio_Player *p);
 
-		BEWARE! Most of these operations are potentially slow because they may need to synchronize with audio thread.
+		These never wait on the audio thread. Changes are queued and applied by the audio thread
+		the next time it samples. Until then, the getters report what you asked for.
 		
 	void    audio_player_set_state(Audio_Player *p, Audio_Player_State state);
 	void    audio_player_set_time_stamp(Audio_Player *p, float64 time_in_seconds);
@@ -140,17 +141,14 @@ typedef struct Audio_Source {
 	// #Memory #Incomplete #StbVorbisFileStream
 	// I tried replacing the stdio stuff in stb_vorbis with oogabooga file api, but now
 	// stb_vorbis is shitting itself.
-	// So, for now, we're just reading the file into memory and then streaming from that
-	// memory.
-	// Luckily, ogg compression is pretty good so it's not going to completely butcher
-	// memory usage, but it's definitely suboptimal.
+	// So, for now, we're mapping the file into memory and then streaming from that
+	// memory. Since it's a file mapping (os_file_map) it doesn't cost us a heap copy
+	// and the OS only pages in what we actually decode.
 	string ogg_raw;
 	
 	// For memory source
 	void *pcm_frames;
 	
-	Mutex mutex_for_destroy; // This should ONLY be used so a source isnt sampled on audio thread while it's being destroyed
-	
 } Audio_Source;
 
 int 
@@ -378,8 +376,7 @@ wav_read_frames(Wav_Stream *wav, Audio_Format format, void *frames,
 		
 		u64 new_size = get_next_power_of_two(required_size);
 		
-		raw_buffer = alloc(get_heap_allocator(), new_size);
-		memset(raw_buffer, 0, new_size);
+		raw_buffer = alloc_zeroed(get_heap_allocator(), new_size);
 		raw_buffer_size = new_size;
 	}
 	if (!convert_buffer || required_size > convert_buffer_size) {
@@ -387,8 +384,7 @@ wav_read_frames(Wav_Stream *wav, Audio_Format format, void *frames,
 		
 		u64 new_size = get_next_power_of_two(required_size);
 		
-		convert_buffer = alloc(get_heap_allocator(), new_size);
-		memset(convert_buffer, 0, new_size);
+		convert_buffer = alloc_zeroed(get_heap_allocator(), new_size);
 		convert_buffer_size = new_size;
 	}
 	
@@ -554,8 +550,6 @@ audio_open_source_stream_format(Audio_Source *src, string path, Audio_Format for
 	src->uid = next_audio_source_uid;
 	next_audio_source_uid += 1;
 	
-	mutex_init(&src->mutex_for_destroy);
-	
 	src->allocator = allocator;
 	src->kind = AUDIO_SOURCE_FILE_STREAM;
 	
@@ -577,7 +571,7 @@ audio_open_source_stream_format(Audio_Source *src, string path, Audio_Format for
 	} else if (check_ogg_header(header)) {
 		src->decoder = AUDIO_DECODER_OGG;
 		
-		ok = os_read_entire_file(path, &src->ogg_raw, src->allocator);
+		ok = os_file_map(path, &src->ogg_raw);
 		if (!ok) return false;
 		
 		third_party_allocator = src->allocator;
@@ -585,7 +579,11 @@ audio_open_source_stream_format(Audio_Source *src, string path, Audio_Format for
 		src->ogg = stb_vorbis_open_memory(src->ogg_raw.data, src->ogg_raw.count, &err, 0);
 		third_party_allocator = ZERO(Allocator);
 		
-		if (err != 0 || src->ogg == 0) return false;
+		if (err != 0 || src->ogg == 0) {
+			os_file_unmap(src->ogg_raw);
+			src->ogg_raw = ZERO(string);
+			return false;
+		}
 		
 		third_party_allocator = src->allocator;
 		src->number_of_frames = stb_vorbis_stream_length_in_samples(src->ogg);
@@ -612,8 +610,6 @@ audio_open_source_load_format(Audio_Source *src, string path, Audio_Format forma
 	src->uid = next_audio_source_uid;
 	next_audio_source_uid += 1;
 	
-	mutex_init(&src->mutex_for_destroy);
-	
 	src->allocator = allocator;
 	src->kind = AUDIO_SOURCE_MEMORY;
 	src->format = format;
@@ -636,7 +632,7 @@ audio_open_source_load_format(Audio_Source *src, string path, Audio_Format forma
 	} else if (check_ogg_header(header)) {
 		src->decoder = AUDIO_DECODER_OGG;
 		
-		ok = os_read_entire_file(path, &src->ogg_raw, src->allocator);
+		ok = os_file_map(path, &src->ogg_raw);
 		if (!ok) return false;
 		
 		third_party_allocator = src->allocator;
@@ -644,7 +640,11 @@ audio_open_source_load_format(Audio_Source *src, string path, Audio_Format forma
 		src->ogg = stb_vorbis_open_memory(src->ogg_raw.data, src->ogg_raw.count, &err, 0);
 		third_party_allocator = ZERO(Allocator);
 		
-		if (err != 0 || src->ogg == 0) return false;
+		if (err != 0 || src->ogg == 0) {
+			os_file_unmap(src->ogg_raw);
+			src->ogg_raw = ZERO(string);
+			return false;
+		}
 		
 		third_party_allocator = src->allocator;
 		src->number_of_frames = stb_vorbis_stream_length_in_samples(src->ogg);
@@ -663,6 +663,10 @@ audio_open_source_load_format(Audio_Source *src, string path, Audio_Format forma
 		stb_vorbis_close(src->ogg);
 		third_party_allocator = ZERO(Allocator);
 		
+		// Everything is decoded into pcm_frames now
+		os_file_unmap(src->ogg_raw);
+		src->ogg_raw = ZERO(string);
+		
 		if (retrieved != src->number_of_frames) {
 			dealloc(src->allocator, src->pcm_frames);
 			return false;
@@ -682,11 +686,9 @@ audio_open_source_load(Audio_Source *src, string path, Allocator allocator) {
 	return audio_open_source_load_format(src, path, format, allocator);
 }
 
+// Audio thread only, see audio_source_destroy()
 void 
-audio_source_destroy(Audio_Source *src) {
-
-	mutex_acquire_or_wait(&src->mutex_for_destroy);
-
+audio_source_destroy_now(Audio_Source *src) {
 	switch (src->kind) {
 		case AUDIO_SOURCE_FILE_STREAM: {
 			third_party_allocator = src->allocator;
@@ -697,7 +699,7 @@ audio_source_destroy(Audio_Source *src) {
 				}
 				case AUDIO_DECODER_OGG: {
 					stb_vorbis_close(src->ogg);
-					dealloc_string(src->allocator, src->ogg_raw);
+					os_file_unmap(src->ogg_raw);
 					break;
 				}
 			}
@@ -709,8 +711,6 @@ audio_source_destroy(Audio_Source *src) {
 			break;
 		}
 	}
-	
-	mutex_release(&src->mutex_for_destroy);
 }
 
 int
@@ -754,8 +754,7 @@ audio_source_get_frames(Audio_Source *src, u64 first_frame_index,
 			
 			u64 new_size = get_next_power_of_two(required_size);
 			
-			convert_buffer = alloc(get_heap_allocator(), new_size);
-			memset(convert_buffer, 0, new_size);
+			convert_buffer = alloc_zeroed(get_heap_allocator(), new_size);
 			convert_buffer_size = new_size;
 		}
 		
@@ -1152,32 +1151,57 @@ typedef struct Audio_Playback_Config {
 	float32 playback_speed;
 } Audio_Playback_Config;
 
-typedef struct Audio_Player {
-	// You shouldn't set these directly.
-	// Set playback state with the player_xxxxx procedures
+// The audio thread's copy of the player state. Only the audio thread touches this, it's
+// updated from the commands that the audio_player_xxxxx procedures send.
+typedef struct Audio_Player_Playback {
 	Audio_Source source;
 	bool has_source;
-	bool allocated;
-	bool marked_for_release; // We release on audio thread
+	bool looping;
+	bool release_when_done;
 	Audio_Player_State state;
 	u64 frame_index;
-	bool looping;
 	u64 fade_frames;
 	u64 fade_frames_total;
+} Audio_Player_Playback;
+
+typedef struct Audio_Player {
+	// You shouldn't set these directly.
+	// Set playback state with the player_xxxxx procedures.
+	// These are what the game thread last asked for, the audio thread catches up when it
+	// applies the commands at the start of the next audio sample.
+	Audio_Source source;
+	bool has_source;
+	volatile bool allocated; // Cleared by audio thread when released
+	Audio_Player_State state;
+	volatile u64 frame_index; // Published by audio thread
+	bool looping;
 	bool release_when_done;
-	// I think we only need to sync when audio thread samples the source, which should be
-	// fairly quick and low contention, hence a spinlock.
-	Spinlock sample_lock; 
+	
+	// The frame index we asked for until the audio thread has applied the command
+	u64 requested_frame_index;
+	u64 requested_frame_index_command;
+	
+	// Commands that didn't fit in the command ring, merged into the latest of each kind.
+	// Protected by audio_player_command_lock.
+	u32 overflow_kinds; // Bit per Audio_Player_Command_Kind
+	Audio_Player_State overflow_state;
+	u64 overflow_frame_index;
+	bool overflow_looping;
+	Audio_Source overflow_source;
+	struct Audio_Player *overflow_next;
 	
 	// #Cleanup
 	DEPRECATED(Vector3 position, "Use player->config.position_ndc instead"); // ndc space -1 to 1
 	DEPRECATED(bool disable_spacialization, "Use player->config.enable_spacialization instead");
 	DEPRECATED(float32 volume, "Use player->config.volume instead");
 	DEPRECATED(float32 playback_speed, "Use player->config.playback_speed instead");
+	DEPRECATED(bool marked_for_release, "Not used anymore, audio_player_release() sends a release command to the audio thread");
 	
 	// This is safe to set whenever
 	Audio_Playback_Config config;
 	
+	Audio_Player_Playback playback;
+	
 } Audio_Player;
 #define AUDIO_PLAYERS_PER_BLOCK 128
 typedef struct Audio_Player_Block {
@@ -1186,13 +1210,301 @@ typedef struct Audio_Player_Block {
 	struct Audio_Player_Block *next;
 } Audio_Player_Block;
 
+typedef enum Audio_Player_Command_Kind {
+	AUDIO_PLAYER_COMMAND_SET_STATE,
+	AUDIO_PLAYER_COMMAND_SET_FRAME_INDEX,
+	AUDIO_PLAYER_COMMAND_SET_SOURCE,
+	AUDIO_PLAYER_COMMAND_CLEAR_SOURCE,
+	AUDIO_PLAYER_COMMAND_SET_LOOPING,
+	AUDIO_PLAYER_COMMAND_RELEASE_WHEN_DONE,
+	AUDIO_PLAYER_COMMAND_RELEASE,
+	AUDIO_PLAYER_COMMAND_DESTROY_SOURCE, // No player
+} Audio_Player_Command_Kind;
+
+typedef struct Audio_Player_Command {
+	Audio_Player_Command_Kind kind;
+	Audio_Player *player;
+	union {
+		Audio_Player_State state;
+		u64 frame_index;
+		bool looping;
+		Audio_Source source;
+	};
+} Audio_Player_Command;
+
+// Player changes are sent to the audio thread through a single-producer single-consumer
+// ring so the audio thread never waits on the game thread. Producers are serialized with
+// a spinlock in case players are touched from more than one thread. The audio thread only
+// ever tries to take it, never waits.
+// If the audio thread isn't draining the ring (no audio device) it fills up. Then commands
+// are merged per player instead, so nothing is lost and there's at most one pending change
+// of each kind per player. The audio thread picks those up once it gets to it.
+#define AUDIO_PLAYER_COMMAND_CAPACITY 1024
+
 // #Global
 ogb_instance Audio_Player_Block audio_player_block;
+ogb_instance Spsc_Ring audio_player_commands;
+ogb_instance volatile bool audio_player_commands_initted;
+ogb_instance Spinlock audio_player_command_lock;
+ogb_instance volatile u64 audio_player_commands_sent;
+ogb_instance volatile u64 audio_player_commands_applied;
+// While there are merged commands, all commands are merged so they stay in order
+ogb_instance volatile bool audio_player_overflowing;
+ogb_instance Audio_Player *audio_player_overflow_head; // Players with merged commands
+ogb_instance Audio_Source *audio_source_overflow_destroys; // Growing array
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Audio_Player_Block audio_player_block = {0};
+Spsc_Ring audio_player_commands;
+volatile bool audio_player_commands_initted = false;
+Spinlock audio_player_command_lock = {0};
+volatile u64 audio_player_commands_sent = 0;
+volatile u64 audio_player_commands_applied = 0;
+volatile bool audio_player_overflowing = false;
+Audio_Player *audio_player_overflow_head = 0;
+Audio_Source *audio_source_overflow_destroys = 0;
 #endif
 
+// Expects audio_player_command_lock to be held
+void
+audio_player_merge_command(Audio_Player_Command *command) {
+	if (command->kind == AUDIO_PLAYER_COMMAND_DESTROY_SOURCE) {
+		// Applied after all merged player commands, so after any that stop players using it
+		if (!audio_source_overflow_destroys) {
+			growing_array_init((void**)&audio_source_overflow_destroys, sizeof(Audio_Source), get_heap_allocator());
+		}
+		growing_array_add((void**)&audio_source_overflow_destroys, &command->source);
+		return;
+	}
+	
+	Audio_Player *p = command->player;
+	if (p->overflow_kinds == 0) {
+		p->overflow_next = audio_player_overflow_head;
+		audio_player_overflow_head = p;
+	}
+	
+	switch (command->kind) {
+		case AUDIO_PLAYER_COMMAND_SET_STATE:         p->overflow_state = command->state; break;
+		case AUDIO_PLAYER_COMMAND_SET_FRAME_INDEX:   p->overflow_frame_index = command->frame_index; break;
+		case AUDIO_PLAYER_COMMAND_SET_LOOPING:       p->overflow_looping = command->looping; break;
+		case AUDIO_PLAYER_COMMAND_RELEASE_WHEN_DONE: break;
+		case AUDIO_PLAYER_COMMAND_RELEASE:           break;
+		case AUDIO_PLAYER_COMMAND_DESTROY_SOURCE:    break;
+		case AUDIO_PLAYER_COMMAND_SET_SOURCE: {
+			// Starts the new source from the beginning
+			p->overflow_source = command->source;
+			p->overflow_kinds &= ~((1 << AUDIO_PLAYER_COMMAND_CLEAR_SOURCE) | (1 << AUDIO_PLAYER_COMMAND_SET_FRAME_INDEX));
+			break;
+		}
+		case AUDIO_PLAYER_COMMAND_CLEAR_SOURCE: {
+			// Also pauses
+			p->overflow_kinds &= ~((1 << AUDIO_PLAYER_COMMAND_SET_SOURCE) | (1 << AUDIO_PLAYER_COMMAND_SET_FRAME_INDEX) | (1 << AUDIO_PLAYER_COMMAND_SET_STATE));
+			break;
+		}
+	}
+	p->overflow_kinds |= 1 << command->kind;
+}
+
+// Returns the command number, which the audio thread has applied once
+// audio_player_commands_applied reaches it.
+u64
+audio_player_send_command(Audio_Player_Command *command) {
+	spinlock_acquire_or_wait(&audio_player_command_lock);
+	
+	if (!audio_player_commands_initted) {
+		spsc_ring_init(&audio_player_commands, Audio_Player_Command, AUDIO_PLAYER_COMMAND_CAPACITY, get_heap_allocator());
+		COMPILER_BARRIER;
+		audio_player_commands_initted = true;
+	}
+	
+	// The audio thread drains the ring every time it samples, so it's only full if it's not
+	// sampling at all (no audio device). We don't wait for it since it might never come back.
+	if (audio_player_overflowing || !spsc_ring_push(&audio_player_commands, *command)) {
+		audio_player_merge_command(command);
+		audio_player_overflowing = true;
+	}
+	audio_player_commands_sent += 1;
+	u64 number = audio_player_commands_sent;
+	
+	spinlock_release(&audio_player_command_lock);
+	
+	return number;
+}
+
+// Audio thread only
+void
+audio_player_retire(Audio_Player *p) {
+	p->playback = ZERO(Audio_Player_Playback);
+	p->frame_index = 0;
+	COMPILER_BARRIER; // Done with the player before game thread can reuse it
+	p->allocated = false;
+}
+
+// Audio thread only
+void
+audio_player_apply_command(Audio_Player_Command *command) {
+	Audio_Player *p = command->player;
+	Audio_Player_Playback *pb = p ? &p->playback : 0;
+	
+	switch (command->kind) {
+		case AUDIO_PLAYER_COMMAND_SET_STATE: {
+			if (pb->state == command->state) break;
+			pb->state = command->state;
+			if (!pb->has_source || pb->source.number_of_frames == 0) break;
+			
+			float64 full_duration 
+				= (float64)pb->source.number_of_frames/(float64)pb->source.format.sample_rate;
+			float64 progression = (float64)pb->frame_index / (float64)pb->source.number_of_frames;
+			float64 remaining = (1.0-progression)*full_duration;
+			
+			float64 fade_seconds = min(AUDIO_SMOOTH_TRANSITION_TIME_MS/1000.0, remaining);
+			
+			float64 fade_factor = fade_seconds/full_duration;
+			
+			pb->fade_frames = (u64)round(fade_factor*(float64)pb->source.number_of_frames);
+			pb->fade_frames_total = pb->fade_frames;
+			break;
+		}
+		case AUDIO_PLAYER_COMMAND_SET_FRAME_INDEX: {
+			pb->frame_index = min(command->frame_index, pb->source.number_of_frames);
+			p->frame_index = pb->frame_index;
+			break;
+		}
+		case AUDIO_PLAYER_COMMAND_SET_SOURCE: {
+			pb->source = command->source;
+			pb->has_source = true;
+			pb->frame_index = 0;
+			p->frame_index = 0;
+			break;
+		}
+		case AUDIO_PLAYER_COMMAND_CLEAR_SOURCE: {
+			pb->has_source = false;
+			pb->state = AUDIO_PLAYER_STATE_PAUSED;
+			pb->source = ZERO(Audio_Source);
+			pb->frame_index = 0;
+			pb->fade_frames = 0;
+			p->frame_index = 0;
+			break;
+		}
+		case AUDIO_PLAYER_COMMAND_SET_LOOPING: {
+			if (pb->has_source && command->looping && !pb->looping && pb->frame_index == pb->source.number_of_frames) {
+				pb->frame_index = 0;
+				p->frame_index = 0;
+			}
+			pb->looping = command->looping;
+			break;
+		}
+		case AUDIO_PLAYER_COMMAND_RELEASE_WHEN_DONE: {
+			pb->release_when_done = true;
+			break;
+		}
+		case AUDIO_PLAYER_COMMAND_RELEASE: {
+			audio_player_retire(p);
+			break;
+		}
+		case AUDIO_PLAYER_COMMAND_DESTROY_SOURCE: {
+			// Players still on this source would sample freed memory
+			for (Audio_Player_Block *block = &audio_player_block; block; block = block->next) {
+				for (u64 i = 0; i < AUDIO_PLAYERS_PER_BLOCK; i++) {
+					Audio_Player_Playback *player_pb = &block->players[i].playback;
+					if (player_pb->has_source && player_pb->source.uid == command->source.uid) {
+						player_pb->has_source = false;
+						player_pb->source = ZERO(Audio_Source);
+					}
+				}
+			}
+			audio_source_destroy_now(&command->source);
+			break;
+		}
+	}
+}
+
+// Audio thread only
+void
+audio_player_apply_commands() {
+	if (!audio_player_commands_initted) return;
+	
+	Audio_Player_Command command;
+	while (spsc_ring_pop(&audio_player_commands, &command)) {
+		audio_player_apply_command(&command);
+		audio_player_commands_applied += 1;
+	}
+	
+	// Merged commands are newer than anything in the ring. If the game thread is sending
+	// right now we get them next time.
+	if (!audio_player_overflowing) return;
+	if (!spinlock_acquire_or_wait_timeout(&audio_player_command_lock, 0)) return;
+	
+	// In the order they can depend on each other
+	const Audio_Player_Command_Kind kinds[] = {
+		AUDIO_PLAYER_COMMAND_CLEAR_SOURCE,
+		AUDIO_PLAYER_COMMAND_SET_SOURCE,
+		AUDIO_PLAYER_COMMAND_SET_FRAME_INDEX,
+		AUDIO_PLAYER_COMMAND_SET_STATE,
+		AUDIO_PLAYER_COMMAND_SET_LOOPING,
+		AUDIO_PLAYER_COMMAND_RELEASE_WHEN_DONE,
+		AUDIO_PLAYER_COMMAND_RELEASE,
+	};
+	
+	Audio_Player *p = audio_player_overflow_head;
+	while (p) {
+		Audio_Player *next = p->overflow_next;
+		u32 overflow_kinds = p->overflow_kinds;
+		p->overflow_kinds = 0;
+		p->overflow_next = 0;
+		
+		for (u64 i = 0; i < sizeof(kinds)/sizeof(kinds[0]); i++) {
+			if (!(overflow_kinds & (1 << kinds[i]))) continue;
+			command = ZERO(Audio_Player_Command);
+			command.kind = kinds[i];
+			command.player = p;
+			switch (kinds[i]) {
+				case AUDIO_PLAYER_COMMAND_SET_STATE:       command.state = p->overflow_state; break;
+				case AUDIO_PLAYER_COMMAND_SET_FRAME_INDEX: command.frame_index = p->overflow_frame_index; break;
+				case AUDIO_PLAYER_COMMAND_SET_LOOPING:     command.looping = p->overflow_looping; break;
+				case AUDIO_PLAYER_COMMAND_SET_SOURCE:      command.source = p->overflow_source; break;
+				default: break;
+			}
+			audio_player_apply_command(&command);
+		}
+		
+		p = next;
+	}
+	audio_player_overflow_head = 0;
+	
+	if (audio_source_overflow_destroys) {
+		for (u64 i = 0; i < growing_array_get_valid_count(audio_source_overflow_destroys); i++) {
+			command = ZERO(Audio_Player_Command);
+			command.kind = AUDIO_PLAYER_COMMAND_DESTROY_SOURCE;
+			command.source = audio_source_overflow_destroys[i];
+			audio_player_apply_command(&command);
+		}
+		growing_array_clear((void**)&audio_source_overflow_destroys);
+	}
+	
+	audio_player_overflowing = false;
+	
+	// Nothing went into the ring while there were merged commands, so everything is applied
+	audio_player_commands_applied = audio_player_commands_sent;
+	spinlock_release(&audio_player_command_lock);
+}
+
+// Game side view of the frame index. If the audio thread hasn't applied our last seek yet,
+// this is where we asked it to go.
+u64
+audio_player_get_frame_index(Audio_Player *p) {
+	if (audio_player_commands_applied < p->requested_frame_index_command) {
+		return p->requested_frame_index;
+	}
+	return min(p->frame_index, p->source.number_of_frames);
+}
+
+void
+audio_player_request_frame_index(Audio_Player *p, u64 frame_index, Audio_Player_Command *command) {
+	p->requested_frame_index = frame_index;
+	p->requested_frame_index_command = audio_player_send_command(command);
+}
+
 Audio_Player *
 audio_player_get_one() {
 
@@ -1219,144 +1531,115 @@ audio_player_get_one() {
 	
 	// No free player found, make another block
 	// #Volatile can't assign to last->next before this is zero initialized
-	Audio_Player_Block *new_block = alloc(get_heap_allocator(), sizeof(Audio_Player_Block));
-	
-#if !DO_ZERO_INITIALIATION
-	memset(new_block, 0, sizeof(*new_block));
-#endif
+	Audio_Player_Block *new_block = alloc_zeroed(get_heap_allocator(), sizeof(Audio_Player_Block));
 
 	last->next = new_block;
 
 	new_block->players[0].allocated = true;
 	new_block->players[0].config.volume = 1.0;
-	block->players[0].config.playback_speed = 1.0;
+	new_block->players[0].config.playback_speed = 1.0;
 	return &new_block->players[0];
 }
 
 void 
 audio_player_release(Audio_Player *p) {
-	p->marked_for_release = true;
+	Audio_Player_Command command = {AUDIO_PLAYER_COMMAND_RELEASE, p};
+	audio_player_send_command(&command);
 }
 void
 audio_player_set_state(Audio_Player *p, Audio_Player_State state) {
 
 	if (p->state == state) return;
 
-	spinlock_acquire_or_wait(&p->sample_lock);
-	assert(p->frame_index <= p->source.number_of_frames);
 	p->state = state;
 	
-	float64 full_duration 
-		= (float64)p->source.number_of_frames/(float64)p->source.format.sample_rate;
-	float64 progression = (float64)p->frame_index / (float64)p->source.number_of_frames;
-	float64 remaining = (1.0-progression)*full_duration;
-	
-	float64 fade_seconds = min(AUDIO_SMOOTH_TRANSITION_TIME_MS/1000.0, remaining);
-	
-	float64 fade_factor = fade_seconds/full_duration;
-	
-	p->fade_frames = (u64)round(fade_factor*(float64)p->source.number_of_frames);
-	p->fade_frames_total = p->fade_frames;
-	
-	spinlock_release(&p->sample_lock);
+	Audio_Player_Command command = {AUDIO_PLAYER_COMMAND_SET_STATE, p};
+	command.state = state;
+	audio_player_send_command(&command);
 }
 void
 audio_player_set_time_stamp(Audio_Player *p, float64 time_in_seconds) {
-	spinlock_acquire_or_wait(&p->sample_lock);
-	assert(p->frame_index <= p->source.number_of_frames);
+	if (!p->has_source) return;
 	
 	float64 full_duration 
 		= (float64)p->source.number_of_frames/(float64)p->source.format.sample_rate;
 	time_in_seconds = clamp(time_in_seconds, 0, full_duration);
 	float64 progression = time_in_seconds/full_duration;
 	
-	p->frame_index = (u64)round((float64)p->source.number_of_frames*progression);
-	
-	spinlock_release(&p->sample_lock);
+	Audio_Player_Command command = {AUDIO_PLAYER_COMMAND_SET_FRAME_INDEX, p};
+	command.frame_index = (u64)round((float64)p->source.number_of_frames*progression);
+	audio_player_request_frame_index(p, command.frame_index, &command);
 }
 
 bool 
 audio_player_at_source_end(Audio_Player *p) {
-	spinlock_acquire_or_wait(&p->sample_lock);
-	assert(p->frame_index <= p->source.number_of_frames);
-	
-    bool finished = p->frame_index == p->source.number_of_frames;
-	
-	spinlock_release(&p->sample_lock);
-
-    return finished;
+	return audio_player_get_frame_index(p) == p->source.number_of_frames;
 }
 
 void // 0 - 1
 audio_player_set_progression_factor(Audio_Player *p, float64 factor) {
-	spinlock_acquire_or_wait(&p->sample_lock);
-	assert(p->frame_index <= p->source.number_of_frames);
-	
-	p->frame_index = (u64)round((float64)p->source.number_of_frames*factor);
-	
-	spinlock_release(&p->sample_lock);
+	Audio_Player_Command command = {AUDIO_PLAYER_COMMAND_SET_FRAME_INDEX, p};
+	command.frame_index = (u64)round((float64)p->source.number_of_frames*factor);
+	audio_player_request_frame_index(p, command.frame_index, &command);
 }
 float64 // seconds
 audio_player_get_time_stamp(Audio_Player *p) {
-	spinlock_acquire_or_wait(&p->sample_lock);
-	assert(p->frame_index <= p->source.number_of_frames);
-	
-	float64 full_duration 
-		= (float64)p->source.number_of_frames/(float64)p->source.format.sample_rate;
-	float64 progression = (float64)p->frame_index / (float64)p->source.number_of_frames;
-	
-	spinlock_release(&p->sample_lock);
+	if (!p->has_source) return 0;
 	
-	return progression*full_duration;
+	return (float64)audio_player_get_frame_index(p)/(float64)p->source.format.sample_rate;
 }
 float64
 audio_player_get_current_progression_factor(Audio_Player *p) {
 	if (!p->has_source) return 0;
-	spinlock_acquire_or_wait(&p->sample_lock);
-	assert(p->frame_index <= p->source.number_of_frames);
-	
-	float64 progression = (float64)p->frame_index / (float64)p->source.number_of_frames;
-	
-	spinlock_release(&p->sample_lock);
 	
-	return progression;
+	return (float64)audio_player_get_frame_index(p) / (float64)p->source.number_of_frames;
 }
 void 
 audio_player_set_source(Audio_Player *p, Audio_Source src) {
-
-	float64 last_progression = audio_player_get_current_progression_factor(p);
-	
-	spinlock_acquire_or_wait(&p->sample_lock);
-
 	p->source = src;
 	p->has_source = true;
 	
-	p->frame_index = 0;
-	
-	spinlock_release(&p->sample_lock);
+	Audio_Player_Command command = {AUDIO_PLAYER_COMMAND_SET_SOURCE, p};
+	command.source = src;
+	audio_player_request_frame_index(p, 0, &command);
 }
 void 
 audio_player_clear_source(Audio_Player *p) {
-	spinlock_acquire_or_wait(&p->sample_lock);
-	assert(p->frame_index <= p->source.number_of_frames);
-	
 	p->has_source = false;
 	p->state = AUDIO_PLAYER_STATE_PAUSED;
 	p->source = ZERO(Audio_Source);
 	
-	spinlock_release(&p->sample_lock);
+	Audio_Player_Command command = {AUDIO_PLAYER_COMMAND_CLEAR_SOURCE, p};
+	audio_player_request_frame_index(p, 0, &command);
 }
 void
 audio_player_set_looping(Audio_Player *p, bool looping) {
-	spinlock_acquire_or_wait(&p->sample_lock);
+	Audio_Player_Command command = {AUDIO_PLAYER_COMMAND_SET_LOOPING, p};
+	command.looping = looping;
 	
-	if (p->has_source && looping && !p->looping && p->frame_index == p->source.number_of_frames) {
-		p->frame_index = 0;
+	if (p->has_source && looping && !p->looping && audio_player_at_source_end(p)) {
+		audio_player_request_frame_index(p, 0, &command);
+	} else {
+		audio_player_send_command(&command);
 	}
 	
 	p->looping = looping;
-	
-	spinlock_release(&p->sample_lock);
+}
+void
+audio_player_set_release_when_done(Audio_Player *p) {
+	p->release_when_done = true;
+	Audio_Player_Command command = {AUDIO_PLAYER_COMMAND_RELEASE_WHEN_DONE, p};
+	audio_player_send_command(&command);
+}
+
+// Sources are destroyed on the audio thread, after it applied every player change you made
+// before this. So clear or release the players using it first, and it's never freed mid mix.
+// Players that still use it when it's destroyed lose their source.
+void 
+audio_source_destroy(Audio_Source *src) {
+	Audio_Player_Command command = {AUDIO_PLAYER_COMMAND_DESTROY_SOURCE, 0};
+	command.source = *src;
+	audio_player_send_command(&command);
 }
 
 // #Global
@@ -1375,7 +1658,7 @@ DEPRECATED(play_one_audio_clip_source_at_position(Audio_Source source, Vector3 p
 	audio_player_set_state(p, AUDIO_PLAYER_STATE_PLAYING);
 	p->config.position_ndc = pos;
 	p->config.enable_spacialization = true;
-	p->release_when_done = true;
+	audio_player_set_release_when_done(p);
 }
 
 void
@@ -1384,7 +1667,7 @@ play_one_audio_clip_source_with_config(Audio_Source source, Audio_Playback_Confi
 	audio_player_set_source(p, source);
 	audio_player_set_state(p, AUDIO_PLAYER_STATE_PLAYING);
 	p->config = config;
-	p->release_when_done = true;
+	audio_player_set_release_when_done(p);
 }
 
 void inline 
@@ -1660,7 +1943,8 @@ void
 do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format, 
 							 void *output) {
 							 
-	reset_temporary_storage();
+	// Only free what we allocate here, whoever owns this thread may have temp memory live
+	Temp_Scope temp_scope = temp_scope_begin();
 							 
 	u64 out_comp_size  = get_audio_bit_width_byte_size(out_format.bit_width);
     u64 out_frame_size = out_comp_size * out_format.channels;
@@ -1668,6 +1952,8 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
     
 	memset(output, 0, output_size);
 	
+	audio_player_apply_commands();
+	
 	Audio_Player_Block *block = &audio_player_block;
 	
 	// #Cleanup #Memory refactor intermediate buffers
@@ -1685,34 +1971,46 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 		
 		for (u64 i = 0; i < AUDIO_PLAYERS_PER_BLOCK; i++) {
 			Audio_Player *p = &block->players[i];
-			if (p->release_when_done && (p->frame_index >= p->source.number_of_frames
-										  || !p->has_source)) {
-				p->allocated = false;
-			}
-			if (!p->allocated) {
+			Audio_Player_Playback *pb = &p->playback;
+			if (pb->release_when_done && (pb->frame_index >= pb->source.number_of_frames
+										  || !pb->has_source)) {
+				audio_player_retire(p);
 				continue;
 			}
-			
-			if (p->marked_for_release) {
-				p->marked_for_release = false;
-				p->allocated = false;
+			if (!pb->has_source) {
 				continue;
 			}
 			
-			if (p->state != AUDIO_PLAYER_STATE_PLAYING) {
-				if (p->fade_frames == 0) continue;
+			if (pb->state != AUDIO_PLAYER_STATE_PLAYING) {
+				if (pb->fade_frames == 0) continue;
 			}
 			
 			// #Incomplete Reverse playback ?
 			if (p->config.playback_speed <= 0.0) continue;
 			
-			if (p->frame_index >= p->source.number_of_frames && !p->looping) continue;
+			if (pb->frame_index >= pb->source.number_of_frames && !pb->looping) continue;
 			
-			spinlock_acquire_or_wait(&p->sample_lock);
+			Audio_Source src = pb->source;
 			
-			Audio_Source src = p->source;
+			// :PhaseCancellation
+			if (pb->frame_index == 0) { // The players' source just started playing
 			
-			mutex_acquire_or_wait(&src.mutex_for_destroy);
+				s64 existing_index = growing_array_find_index_from_left_by_value((void**)&started_this_frame, &src.uid);
+				
+				if (existing_index != -1) {
+					// If this source already started playing this round from another player, then we pretend that
+					// we're already done playing by skipping to the last frame.
+					// For non-looping players, this means we don't play this instance at all.
+					// For looping players, this means we have a slight offset between the players that start
+					// playing at the exact same time. I'm not sure how else to deal with phase cancellation
+					// in looping players.
+					// #Incomplete player->is_muted_for_phase_cancellation ? 
+					pb->frame_index = src.number_of_frames;
+					p->frame_index = pb->frame_index;
+					continue;
+				}
+				growing_array_add((void**)&started_this_frame, &src.uid);
+			}
 
 			Audio_Format sample_format = src.format;
 			sample_format.sample_rate = sample_format.sample_rate*p->config.playback_speed;
@@ -1734,9 +2032,8 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 			if (!mix_buffer || mix_buffer_size < biggest_size) {
 				u64 new_size = get_next_power_of_two(biggest_size);
 				if (mix_buffer) dealloc(get_heap_allocator(), mix_buffer);
-				mix_buffer = alloc(get_heap_allocator(), new_size);
+				mix_buffer = alloc_zeroed(get_heap_allocator(), new_size);
 				mix_buffer_size = new_size;
-				memset(mix_buffer, 0, new_size);
 			}
 			
 			void *target_buffer = mix_buffer;
@@ -1756,9 +2053,8 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 					if (!mix_buffer || mix_buffer_size < biggest_size) {
 						u64 new_size = get_next_power_of_two(biggest_size);
 						if (mix_buffer) dealloc(get_heap_allocator(), mix_buffer);
-						mix_buffer = alloc(get_heap_allocator(), new_size);
+						mix_buffer = alloc_zeroed(get_heap_allocator(), new_size);
 						mix_buffer_size = new_size;
-						memset(mix_buffer, 0, new_size);
 					}
 				}
 				
@@ -1766,62 +2062,43 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 				if (!convert_buffer || convert_buffer_size < biggest_size) {
 					u64 new_size = get_next_power_of_two(biggest_size);
 					if (convert_buffer) dealloc(get_heap_allocator(), convert_buffer);
-					convert_buffer = alloc(get_heap_allocator(), new_size);
+					convert_buffer = alloc_zeroed(get_heap_allocator(), new_size);
 					convert_buffer_size = new_size;
-					memset(convert_buffer, 0, new_size);
 				}
 				target_buffer = convert_buffer;
 				
 			}
-	
-			// :PhaseCancellation
-			if (p->frame_index == 0) { // The players' source just started playing
-			
-				s64 existing_index = growing_array_find_index_from_left_by_value((void**)&started_this_frame, &src.uid);
-				
-				if (existing_index != -1) {
-					// If this source already started playing this round from another player, then we pretend that
-					// we're already done playing by skipping to the last frame.
-					// For non-looping players, this means we don't play this instance at all.
-					// For looping players, this means we have a slight offset between the players that start
-					// playing at the exact same time. I'm not sure how else to deal with phase cancellation
-					// in looping players.
-					// #Incomplete player->is_muted_for_phase_cancellation ? 
-					p->frame_index = src.number_of_frames;
-					continue;
-				}
-				growing_array_add((void**)&started_this_frame, &src.uid);
-			}
-	
-			u64 last_frame_index = p->frame_index;
-			p->frame_index = audio_source_sample_next_frames(
+
+			u64 last_frame_index = pb->frame_index;
+			pb->frame_index = audio_source_sample_next_frames(
 				&src,
-				p->frame_index, 
+				pb->frame_index, 
 				number_of_sample_frames,
 				target_buffer,
-				p->looping
+				pb->looping
 			);
-			if (p->frame_index > last_frame_index && (p->looping || p->frame_index != src.number_of_frames)) {
-				assert(p->frame_index - last_frame_index == number_of_sample_frames);
+			if (pb->frame_index > last_frame_index && (pb->looping || pb->frame_index != src.number_of_frames)) {
+				assert(pb->frame_index - last_frame_index == number_of_sample_frames);
 			}
+			p->frame_index = pb->frame_index;
 			
-			if (p->fade_frames > 0) {
-				u64 frames_to_fade = min(p->fade_frames, number_of_sample_frames);
+			if (pb->fade_frames > 0) {
+				u64 frames_to_fade = min(pb->fade_frames, number_of_sample_frames);
 				
-				u64 frames_faded_so_far = (p->fade_frames_total-p->fade_frames);
+				u64 frames_faded_so_far = (pb->fade_frames_total-pb->fade_frames);
 				
-				switch (p->state) {
+				switch (pb->state) {
 					case AUDIO_PLAYER_STATE_PLAYING: {
 						// We need to fade in
 						float64 fade_from 
-							= (f64)frames_faded_so_far / (f64)p->fade_frames_total;
+							= (f64)frames_faded_so_far / (f64)pb->fade_frames_total;
 							
 						float64 fade_to 
-							= (f64)(frames_faded_so_far + frames_to_fade) / (f64)p->fade_frames_total;
+							= (f64)(frames_faded_so_far + frames_to_fade) / (f64)pb->fade_frames_total;
 						audio_apply_fade_in(
 							target_buffer, 
 							frames_to_fade, 
-							p->source.format, 
+							pb->source.format, 
 							fade_from,
 							fade_to
 						);
@@ -1833,14 +2110,14 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 						// I can't get this to fade out without noise.
 						// I tried dithering but that didn't help.
 						float64 fade_from 
-							= 1.0 - (f64)frames_faded_so_far / (f64)p->fade_frames_total;
+							= 1.0 - (f64)frames_faded_so_far / (f64)pb->fade_frames_total;
 							
 						float64 fade_to 
-							= 1.0 - (f64)(frames_faded_so_far + frames_to_fade) / (f64)p->fade_frames_total;
+							= 1.0 - (f64)(frames_faded_so_far + frames_to_fade) / (f64)pb->fade_frames_total;
 						audio_apply_fade_out(
 							target_buffer, 
 							frames_to_fade, 
-							p->source.format, 
+							pb->source.format, 
 							fade_from,
 							fade_to
 						);
@@ -1848,7 +2125,7 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 					}
 				}
 				
-				p->fade_frames -= frames_to_fade;
+				pb->fade_frames -= frames_to_fade;
 				
 				if (frames_to_fade < number_of_sample_frames) {
 					memset(
@@ -1858,8 +2135,6 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 					);
 				}
 			}
-			
-			spinlock_release(&p->sample_lock);
 						
 			if (need_convert) {
 				int converted = convert_frames(
@@ -1880,10 +2155,10 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 			}
 			
 			mix_frames(output, mix_buffer, number_of_output_frames, out_format);
-			
-			mutex_release(&src.mutex_for_destroy);
 		}
 		
 		block = block->next;
 	}
+	
+	temp_scope_end(temp_scope);
 }
@@ -8,6 +8,11 @@
 #define alignas _Alignas
 
 #define null 0
+
+#ifndef max
+	#define max(a, b) ((a) > (b) ? (a) : (b))
+	#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
 	
 void 
 printf(const char* fmt, ...);
@@ -62,6 +67,13 @@ typedef enum Allocator_Message {
 	ALLOCATOR_ALLOCATE,
 	ALLOCATOR_DEALLOCATE,
 	ALLOCATOR_REALLOCATE,
+	// Memory must come back zeroed. Return 0 if you don't handle this and alloc() will
+	// ALLOCATOR_ALLOCATE + memset instead. Handle it if you know when memory is already zero.
+	ALLOCATOR_ALLOCATE_ZEROED,
+	// The pointer argument is the alignment (a power of two). Return 0 if you can't and
+	// alloc_aligned() will ALLOCATOR_ALLOCATE and assert that it happens to be aligned.
+	// The result is deallocated with a normal ALLOCATOR_DEALLOCATE.
+	ALLOCATOR_ALLOCATE_ALIGNED,
 } Allocator_Message;
 typedef void*(*Allocator_Proc)(u64, void*, Allocator_Message, void*);
 
@@ -111,9 +123,24 @@ alloc(Allocator allocator, u64 size);
 ogb_instance void* 
 alloc_uninitialized(Allocator allocator, u64 size);
 
+// Zeroed even with DO_ZERO_INITIALIZATION off. Skips the memset when the allocator knows the
+// memory is fresh from the OS.
+ogb_instance void* 
+alloc_zeroed(Allocator allocator, u64 size);
+
+// alignment must be a power of two. Free it with dealloc() like anything else.
+// Zero initialized like alloc(). Reallocating may lose the alignment if the memory moves.
+ogb_instance void* 
+alloc_aligned(Allocator allocator, u64 size, u64 alignment);
+
 ogb_instance void 
 dealloc(Allocator allocator, void *p);
 
+// Keeps the first min(old_size, new_size) bytes. The allocator may resize in place, if it
+// can't (returns 0 on ALLOCATOR_REALLOCATE) we alloc, copy and dealloc.
+ogb_instance void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size);
+
 ogb_instance void 
 push_context(Context c);
 
@@ -131,11 +158,22 @@ thread_local u64 num_contexts = 0;
 
 void* 
 alloc(Allocator allocator, u64 size) {
-	assert(size > 0, "You requested an allocation of zero bytes. I'm not sure what you want with that.");
-	void *p = allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);
 #if DO_ZERO_INITIALIZATION
-	memset(p, 0, size);
+	return alloc_zeroed(allocator, size);
+#else
+	assert(size > 0, "You requested an allocation of zero bytes. I'm not sure what you want with that.");
+	return allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);
 #endif
+}
+
+void* 
+alloc_zeroed(Allocator allocator, u64 size) {
+	assert(size > 0, "You requested an allocation of zero bytes. I'm not sure what you want with that.");
+	void *p = allocator.proc(size, 0, ALLOCATOR_ALLOCATE_ZEROED, allocator.data);
+	if (!p) {
+		p = allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);
+		memset(p, 0, size);
+	}
 	return p;
 }
 
@@ -145,12 +183,44 @@ alloc_uninitialized(Allocator allocator, u64 size) {
 	return allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);	
 }
 
+void* 
+alloc_aligned(Allocator allocator, u64 size, u64 alignment) {
+	assert(size > 0, "You requested an allocation of zero bytes. I'm not sure what you want with that.");
+	assert(alignment > 0 && (alignment & (alignment-1)) == 0, "Alignment must be a power of two, got %llu", alignment);
+	void *p = allocator.proc(size, (void*)alignment, ALLOCATOR_ALLOCATE_ALIGNED, allocator.data);
+	if (!p) {
+		p = allocator.proc(size, 0, ALLOCATOR_ALLOCATE, allocator.data);
+		assert((u64)p % alignment == 0, "This allocator does not do aligned allocations and the result was not %llu byte aligned", alignment);
+	}
+#if DO_ZERO_INITIALIZATION
+	memset(p, 0, size);
+#endif
+	return p;
+}
+
 void 
 dealloc(Allocator allocator, void *p) {
 	assert(p != 0, "You tried to deallocate a pointer at adress 0. That doesn't make sense!");
 	allocator.proc(0, p, ALLOCATOR_DEALLOCATE, allocator.data);
 }
 
+void* 
+reallocate(Allocator allocator, void *p, u64 old_size, u64 new_size) {
+	if (!p) return alloc(allocator, new_size);
+	assert(new_size > 0, "You requested a reallocation to zero bytes. Use dealloc for that.");
+	
+	void *new = allocator.proc(new_size, p, ALLOCATOR_REALLOCATE, allocator.data);
+	if (!new) {
+		new = allocator.proc(new_size, 0, ALLOCATOR_ALLOCATE, allocator.data);
+		memcpy(new, p, min(old_size, new_size));
+		dealloc(allocator, p);
+	}
+#if DO_ZERO_INITIALIZATION
+	if (new_size > old_size) memset((u8*)new + old_size, 0, new_size - old_size);
+#endif
+	return new;
+}
+
 void 
 push_context(Context c) {
 	assert(num_contexts < CONTEXT_STACK_MAX, "Context stack overflow");
@@ -173,6 +243,22 @@ Context get_context() {
 
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+#if ENABLE_ALLOCATION_TRACKING && !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+// Tags allocations with where they were made, see Allocation tracking in memory.c
+thread_local const char *allocation_location = 0;
+#define ALLOCATION_LOCATION __FILE__ ":" ASSERT_STR(__LINE__)
+#define alloc(allocator, size) \
+	(allocation_location = ALLOCATION_LOCATION, alloc((allocator), (size)))
+#define alloc_uninitialized(allocator, size) \
+	(allocation_location = ALLOCATION_LOCATION, alloc_uninitialized((allocator), (size)))
+#define alloc_zeroed(allocator, size) \
+	(allocation_location = ALLOCATION_LOCATION, alloc_zeroed((allocator), (size)))
+#define alloc_aligned(allocator, size, alignment) \
+	(allocation_location = ALLOCATION_LOCATION, alloc_aligned((allocator), (size), (alignment)))
+#define reallocate(allocator, p, old_size, new_size) \
+	(allocation_location = ALLOCATION_LOCATION, reallocate((allocator), (p), (old_size), (new_size)))
+#endif
+
 u64 
 get_next_power_of_two(u64 x) {
     if (x == 0) {
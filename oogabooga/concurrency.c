@@ -2,6 +2,9 @@
 typedef struct Spinlock Spinlock;
 typedef struct Mutex Mutex;
 typedef struct Binary_Semaphore Binary_Semaphore;
+typedef struct Semaphore Semaphore;
+typedef struct Condition_Variable Condition_Variable;
+typedef struct Event Event;
 
 // These are probably your best friend for sync-free multi-processing.
 inline bool compare_and_swap_8(volatile uint8_t *a, uint8_t b, uint8_t old);
@@ -10,14 +13,51 @@ inline bool compare_and_swap_32(volatile uint32_t *a, uint32_t b, uint32_t old);
 inline bool compare_and_swap_64(volatile uint64_t *a, uint64_t b, uint64_t old);
 inline bool compare_and_swap_bool(volatile bool *a, bool b, bool old);
 
+// Read-modify-writes return the value from before and are full fences.
+// Loads and stores take a Memory_Order (see cpu.c).
+inline u32 atomic_load_32(volatile u32 *a, Memory_Order order);
+inline u64 atomic_load_64(volatile u64 *a, Memory_Order order);
+inline void atomic_store_32(volatile u32 *a, u32 value, Memory_Order order);
+inline void atomic_store_64(volatile u64 *a, u64 value, Memory_Order order);
+inline u32 atomic_fetch_add_32(volatile u32 *a, u32 value);
+inline u64 atomic_fetch_add_64(volatile u64 *a, u64 value);
+inline u32 atomic_fetch_or_32(volatile u32 *a, u32 value);
+inline u64 atomic_fetch_or_64(volatile u64 *a, u64 value);
+inline u32 atomic_exchange_32(volatile u32 *a, u32 value);
+inline u64 atomic_exchange_64(volatile u64 *a, u64 value);
+
 ///
 // Spinlock "primitive"
 // Like a mutex but it eats up the entire core while waiting.
 // Beneficial if contention is low or sync speed is important
+// It's a ticket lock, so threads get the lock in the order they started waiting for it.
+// Waiters pause and back off between looks at the lock so they don't hammer its cache line,
+// and yield to the OS if they've waited a long time (the thread holding it may not be running).
+// With ENABLE_SPINLOCK_STATS every lock counts how contended it is, see
+// spinlock_report_stats_to_profiler() in profiling.c.
+typedef struct Spinlock_Stats {
+	u64 acquire_count;
+	u64 contended_count; // Acquires that had to wait
+	u64 spin_count; // Times a waiter looked at the lock and it wasn't free
+	u64 max_wait_cycles;
+} Spinlock_Stats;
+
 typedef struct Spinlock {
-	volatile bool locked;
+	volatile u32 next_ticket;
+	volatile u32 now_serving;
+#if ENABLE_SPINLOCK_STATS
+	// Only written by whoever holds the lock
+	Spinlock_Stats stats;
+#endif
 } Spinlock;
 
+// Max number of cpu_pause() between looks at the lock
+#define SPINLOCK_MAX_BACKOFF 64
+// How long a waiter spins before it starts yielding to the OS. Spins are counted too
+// in case rdtsc() isn't available.
+#define SPINLOCK_CYCLES_BEFORE_YIELD 16384
+#define SPINLOCK_SPINS_BEFORE_YIELD 1024
+
 void ogb_instance
 spinlock_init(Spinlock *l);
 
@@ -25,23 +65,35 @@ void ogb_instance
 spinlock_acquire_or_wait(Spinlock* l);
 
 // This returns true if successfully acquired or false if timeout reached.
+// Doesn't wait in line, it only gets the lock when nobody is holding or waiting for it.
 bool ogb_instance
 spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds);
 
 void ogb_instance
 spinlock_release(Spinlock* l);
 
+// All zero unless ENABLE_SPINLOCK_STATS
+Spinlock_Stats ogb_instance
+spinlock_get_stats(Spinlock *l);
+
+void ogb_instance
+spinlock_reset_stats(Spinlock *l);
+
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
-// Just spins for a few (configurable) microseconds with a spinlock,
-// and if acquiring fails it falls back to a OS mutex.
+// High-level mutex primitive (short spin then sleep on the OS)
+// Lives entirely in user space: taking a free mutex is a single compare_and_swap and releasing
+// one nobody waits for is a single exchange. If it's taken we spin for a few (configurable)
+// microseconds, and if it's still taken we sleep with os_wait_on_address() until the holder
+// wakes us. The OS is only involved when threads actually have to wait.
+// Nothing to create or destroy in the OS, so a zero initialized Mutex works (without spinning).
 #define MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS 100
 typedef struct Mutex {
-	Spinlock spinlock;
+	// 0: Unlocked
+	// 1: Locked
+	// 2: Locked and threads might be sleeping on it
+	volatile u32 state;
 	f64 spin_time_microseconds;
-	Mutex_Handle os_handle;
-	volatile bool spinlock_acquired;
 	volatile u64 acquiring_thread;
 } Mutex;
 
@@ -58,11 +110,39 @@ void ogb_instance
 mutex_release(Mutex *m);
 
 
+///
+// Counting semaphore
+// semaphore_wait() takes one from the count, or sleeps with os_wait_on_address() until
+// there's one to take. Signaling only goes to the OS if someone is sleeping.
+// A zero initialized Semaphore has a count of 0.
+typedef struct Semaphore {
+	volatile u32 count;
+	volatile u32 waiters; // Sleeping, or about to sleep
+} Semaphore;
+
+void ogb_instance
+semaphore_init(Semaphore *sem, u32 initial_count);
+
+void ogb_instance
+semaphore_destroy(Semaphore *sem);
+
+void ogb_instance
+semaphore_wait(Semaphore *sem);
+
+// Returns false instead of waiting if the count is 0
+bool ogb_instance
+semaphore_try_wait(Semaphore *sem);
+
+// Adds count and wakes as many waiters
+void ogb_instance
+semaphore_signal(Semaphore *sem, u32 count);
+
+
 ///
 // Binary semaphore
+// A semaphore that counts to 1, so signaling it twice before anyone waits only lets one through.
 typedef struct Binary_Semaphore {
-    volatile bool signaled;
-    Mutex mutex;
+	Semaphore sem;
 } Binary_Semaphore;
 
 void ogb_instance
@@ -78,64 +158,349 @@ void ogb_instance
 binary_semaphore_signal(Binary_Semaphore *sem);
 
 
+///
+// Condition variable
+// Waits can return without a signal, so always wait in a loop that checks the condition:
+//
+//	mutex_acquire_or_wait(&queue_mutex);
+//	while (queue_count == 0) condition_variable_wait(&queue_not_empty, &queue_mutex);
+//	... take from the queue ...
+//	mutex_release(&queue_mutex);
+//
+//	// Producer, after adding to the queue under queue_mutex
+//	condition_variable_signal(&queue_not_empty);
+//
+// A zero initialized Condition_Variable works.
+typedef struct Condition_Variable {
+	volatile u32 sequence; // Bumped by every signal, waiters sleep until it changes
+	volatile u32 waiters;
+} Condition_Variable;
+
+void ogb_instance
+condition_variable_init(Condition_Variable *cv);
+
+void ogb_instance
+condition_variable_destroy(Condition_Variable *cv);
+
+// Releases the mutex while sleeping and has it acquired again when returning
+void ogb_instance
+condition_variable_wait(Condition_Variable *cv, Mutex *m);
+
+// Wakes one waiter
+void ogb_instance
+condition_variable_signal(Condition_Variable *cv);
+
+// Wakes all waiters
+void ogb_instance
+condition_variable_broadcast(Condition_Variable *cv);
+
+
+///
+// Event
+// Stays set until reset, and every thread waiting on it wakes when it's set (use a
+// Binary_Semaphore if you want it to only let one thread through).
+// A zero initialized Event is not set.
+typedef struct Event {
+	// 0: Not set
+	// 1: Set
+	// 2: Not set and threads might be sleeping on it
+	volatile u32 state;
+} Event;
+
+void ogb_instance
+event_init(Event *e, bool set);
+
+void ogb_instance
+event_destroy(Event *e);
+
+void ogb_instance
+event_set(Event *e);
+
+void ogb_instance
+event_reset(Event *e);
+
+// Returns right away if the event is set
+void ogb_instance
+event_wait(Event *e);
+
+bool ogb_instance
+event_is_set(Event *e);
+
+
+///
+// Multi-producer multi-consumer queue
+// Bounded lock-free ring buffer (Dmitry Vyukov's). Every cell has a sequence number which
+// tells producers and consumers whether it's their turn, so they only contend on one CAS
+// each and never wait on each other. Push fails when full and pop fails when empty.
+// Items are copied in and out, so keep them small.
+//
+// Usage:
+//
+//	Mpmc_Queue queue;
+//	mpmc_queue_init(&queue, Log_Message, 1024, get_heap_allocator());
+//
+//	Log_Message message = ...;
+//	if (!mpmc_queue_push(&queue, message)) { /* Full */ }
+//
+//	Log_Message received;
+//	while (mpmc_queue_pop(&queue, &received)) { ... }
+//
+//	mpmc_queue_destroy(&queue);
+//
+// Like the hash table, the item passed to mpmc_queue_push needs to be an lvalue.
+
+#define mpmc_queue_init(queue_ptr, Type, capacity, allocator) \
+	mpmc_queue_init_raw((queue_ptr), sizeof(Type), (capacity), (allocator))
+
+#define mpmc_queue_push(queue_ptr, item) \
+	mpmc_queue_push_raw((queue_ptr), &(item), sizeof(item))
+
+#define mpmc_queue_pop(queue_ptr, item_ptr) \
+	mpmc_queue_pop_raw((queue_ptr), (item_ptr), sizeof(*(item_ptr)))
+
+typedef struct Mpmc_Queue {
+	u8 *cells; // Sequence number followed by the item
+	u64 cell_stride;
+	u64 item_size;
+	u64 mask; // Capacity-1
+	Allocator allocator;
+	
+	// Producers and consumers on their own cache lines
+	alignat(64) volatile u64 enqueue_position;
+	alignat(64) volatile u64 dequeue_position;
+	u8 padding[64-sizeof(u64)];
+} Mpmc_Queue;
+
+// capacity is rounded up to a power of two
+void ogb_instance
+mpmc_queue_init_raw(Mpmc_Queue *q, u64 item_size, u64 capacity, Allocator allocator);
+
+void ogb_instance
+mpmc_queue_destroy(Mpmc_Queue *q);
+
+// Returns false if the queue is full
+bool ogb_instance
+mpmc_queue_push_raw(Mpmc_Queue *q, void *item, u64 item_size);
+
+// Returns false if the queue is empty
+bool ogb_instance
+mpmc_queue_pop_raw(Mpmc_Queue *q, void *item, u64 item_size);
+
+// Racy, only good as a hint
+u64 ogb_instance
+mpmc_queue_get_count(Mpmc_Queue *q);
+
+
+///
+// Single-producer single-consumer ring
+// Bounded wait-free ring buffer for when exactly one thread pushes and exactly one thread
+// pops, like sending commands to the audio thread. No CAS at all, each side only writes its
+// own position and keeps a cached copy of the other side's position so it rarely has to
+// touch the other side's cache line.
+// Push fails when full and pop fails when empty. Items are copied in and out.
+//
+// Usage:
+//
+//	Spsc_Ring ring;
+//	spsc_ring_init(&ring, Audio_Command, 1024, get_heap_allocator());
+//
+//	// Producer thread
+//	if (!spsc_ring_push(&ring, command)) { /* Full */ }
+//
+//	// Consumer thread
+//	while (spsc_ring_pop(&ring, &received)) { ... }
+//
+//	spsc_ring_destroy(&ring);
+//
+// Like mpmc_queue_push, the item passed to spsc_ring_push needs to be an lvalue.
+
+#define spsc_ring_init(ring_ptr, Type, capacity, allocator) \
+	spsc_ring_init_raw((ring_ptr), sizeof(Type), (capacity), (allocator))
+
+#define spsc_ring_push(ring_ptr, item) \
+	spsc_ring_push_raw((ring_ptr), &(item), sizeof(item))
+
+#define spsc_ring_pop(ring_ptr, item_ptr) \
+	spsc_ring_pop_raw((ring_ptr), (item_ptr), sizeof(*(item_ptr)))
+
+typedef struct Spsc_Ring {
+	u8 *items;
+	u64 item_size;
+	u64 mask; // Capacity-1
+	Allocator allocator;
+	
+	// Producer's cache line
+	alignat(64) volatile u64 write_position;
+	u64 cached_read_position;
+	// Consumer's cache line
+	alignat(64) volatile u64 read_position;
+	u64 cached_write_position;
+	u8 padding[64-sizeof(u64)*2];
+} Spsc_Ring;
+
+// capacity is rounded up to a power of two
+void ogb_instance
+spsc_ring_init_raw(Spsc_Ring *r, u64 item_size, u64 capacity, Allocator allocator);
+
+void ogb_instance
+spsc_ring_destroy(Spsc_Ring *r);
+
+// Producer only. Returns false if the ring is full
+bool ogb_instance
+spsc_ring_push_raw(Spsc_Ring *r, void *item, u64 item_size);
+
+// Consumer only. Returns false if the ring is empty
+bool ogb_instance
+spsc_ring_pop_raw(Spsc_Ring *r, void *item, u64 item_size);
+
+// Exact from either side if the other side is idle, otherwise only good as a hint
+u64 ogb_instance
+spsc_ring_get_count(Spsc_Ring *r);
+
+
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
 void spinlock_init(Spinlock *l) {
 	memset(l, 0, sizeof(*l));
 }
+
+inline bool spinlock_should_yield(u64 spins, u64 start) {
+	// If whoever we're waiting on got preempted, spinning only keeps it from running
+	return spins >= SPINLOCK_SPINS_BEFORE_YIELD || rdtsc()-start >= SPINLOCK_CYCLES_BEFORE_YIELD;
+}
+
+// Pauses for a while and returns the next backoff
+inline u32 spinlock_backoff(u32 backoff, u64 spins, u64 start) {
+	if (spinlock_should_yield(spins, start)) {
+		os_yield_thread();
+		return backoff;
+	}
+	for (u32 i = 0; i < backoff; i++) cpu_pause();
+	return min(backoff*2, SPINLOCK_MAX_BACKOFF);
+}
+
+inline void spinlock_count_acquire(Spinlock *l, u64 spins, u64 wait_cycles) {
+#if ENABLE_SPINLOCK_STATS
+	l->stats.acquire_count += 1;
+	if (spins > 0) {
+		l->stats.contended_count += 1;
+		l->stats.spin_count += spins;
+		l->stats.max_wait_cycles = max(l->stats.max_wait_cycles, wait_cycles);
+	}
+#endif
+}
+
 void spinlock_acquire_or_wait(Spinlock* l) {
+	u32 ticket = atomic_fetch_add_32(&l->next_ticket, 1);
+	
+	if (atomic_load_32(&l->now_serving, MEMORY_ORDER_ACQUIRE) == ticket) {
+		spinlock_count_acquire(l, 0, 0);
+		return;
+	}
+	
+	u64 start = rdtsc();
+	u64 spins = 0;
+	u32 backoff = 1;
 	while (true) {
-        bool expected = false;
-        if (compare_and_swap_bool(&l->locked, true, expected)) {
-            return;
-        }
-        while (l->locked) {
-            // spinny boi
-        }
-    }
+		u32 serving = atomic_load_32(&l->now_serving, MEMORY_ORDER_ACQUIRE);
+		if (serving == ticket) break;
+		spins += 1;
+		if (ticket-serving == 1) {
+			// We're next, so don't back off or we might miss our turn for a while
+			cpu_pause();
+			if (spinlock_should_yield(spins, start)) os_yield_thread();
+		} else {
+			backoff = spinlock_backoff(backoff, spins, start);
+		}
+	}
+	
+	spinlock_count_acquire(l, spins, rdtsc()-start);
 }
 // Returns true on aquired, false if timeout seconds reached
 bool spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds) {
-    f64 start = os_get_elapsed_seconds();
+	// rdtsc is way cheaper than asking the OS for the time
+	u64 start = rdtsc();
+	u64 timeout_cycles = (u64)(timeout_seconds*(f64)os.cycles_per_second);
+	f64 start_seconds = os.cycles_per_second ? 0 : os_get_elapsed_seconds();
+	
+	u64 spins = 0;
+	u32 backoff = 1;
 	while (true) {
-        bool expected = false;
-        if (compare_and_swap_bool(&l->locked, true, expected)) {
-            return true;
-        }
-        while (l->locked) {
-            // spinny boi
-            if ((os_get_elapsed_seconds()-start) >= timeout_seconds) return false;
-        }
-    }
-    return true;
+		u32 ticket = l->next_ticket;
+		if (l->now_serving == ticket && compare_and_swap_32(&l->next_ticket, ticket+1, ticket)) {
+			spinlock_count_acquire(l, spins, rdtsc()-start);
+			return true;
+		}
+		spins += 1;
+		
+		if (os.cycles_per_second) {
+			if (rdtsc()-start >= timeout_cycles) return false;
+		} else {
+			if (os_get_elapsed_seconds()-start_seconds >= timeout_seconds) return false;
+		}
+		
+		backoff = spinlock_backoff(backoff, spins, start);
+	}
+	return true;
 }
 void spinlock_release(Spinlock* l) {
-	bool expected = true;
-    bool success = compare_and_swap_bool(&l->locked, false, expected);
-    assert(success, "This thread should have acquired the spinlock but compare_and_swap failed");
+	// Only the holder writes this
+	u32 serving = atomic_load_32(&l->now_serving, MEMORY_ORDER_RELAXED);
+	assert(serving != l->next_ticket, "Tried to release a spinlock which is not acquired");
+	atomic_store_32(&l->now_serving, serving+1, MEMORY_ORDER_RELEASE);
+}
+
+Spinlock_Stats spinlock_get_stats(Spinlock *l) {
+#if ENABLE_SPINLOCK_STATS
+	return l->stats;
+#else
+	return ZERO(Spinlock_Stats);
+#endif
+}
+void spinlock_reset_stats(Spinlock *l) {
+#if ENABLE_SPINLOCK_STATS
+	l->stats = ZERO(Spinlock_Stats);
+#endif
 }
 
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
+// High-level mutex primitive (short spin then sleep on the OS)
 
 void mutex_init(Mutex *m) {
-	spinlock_init(&m->spinlock);
+	m->state = 0;
 	m->spin_time_microseconds = MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS;
-	m->os_handle = os_make_mutex();
-	m->spinlock_acquired = false;
 	m->acquiring_thread = 0;
 }
 void mutex_destroy(Mutex *m) {
-	os_destroy_mutex(m->os_handle);
+	assert(m->state == 0, "Destroyed a mutex which is still acquired");
 }
+
 void mutex_acquire_or_wait(Mutex *m) {
-	if (spinlock_acquire_or_wait_timeout(&m->spinlock, m->spin_time_microseconds / 1000000.0)) {
-        assert(!m->spinlock_acquired, "Internal sync error in Mutex");
-    	m->spinlock_acquired = true;
-    }
-    os_lock_mutex(m->os_handle);
-    
+	if (!compare_and_swap_32(&m->state, 1, 0)) {
+	
+		// Holders usually don't hold for long, so spin a little before we go to sleep
+		u64 spin_cycles = (u64)(m->spin_time_microseconds*(f64)os.cycles_per_second/1000000.0);
+		u64 start = rdtsc();
+		u32 backoff = 1;
+		bool acquired = false;
+		while (rdtsc()-start < spin_cycles) {
+			if (m->state == 0 && compare_and_swap_32(&m->state, 1, 0)) {
+				acquired = true;
+				break;
+			}
+			for (u32 i = 0; i < backoff; i++) cpu_pause();
+			backoff = min(backoff*2, SPINLOCK_MAX_BACKOFF);
+		}
+		
+		if (!acquired) {
+			// Mark it as having sleepers so the holder wakes us. If it happened to be unlocked,
+			// we now hold it (in the sleepers state, which only costs an extra wake on release).
+			while (atomic_exchange_32(&m->state, 2) != 0) {
+				os_wait_on_address(&m->state, 2);
+			}
+		}
+	}
     assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
     m->acquiring_thread = context.thread_id;
 }
@@ -143,40 +508,273 @@ void mutex_release(Mutex *m) {
 	assert(m->acquiring_thread != 0, "Tried to release a mutex which is not acquired");
 	assert(m->acquiring_thread == context.thread_id, "Non-owning thread tried to release mutex");
 	m->acquiring_thread = 0;
-	bool was_spinlock_acquired = m->spinlock_acquired;
-	m->spinlock_acquired = false;
-	os_unlock_mutex(m->os_handle);
-	if (was_spinlock_acquired) {
-		spinlock_release(&m->spinlock);
+	if (atomic_exchange_32(&m->state, 0) == 2) {
+		os_wake_one_on_address(&m->state);
 	}
 }
 
 
 
-void binary_semaphore_init(Binary_Semaphore *sem, bool initial_state) {
-    sem->signaled = initial_state;
-    mutex_init(&sem->mutex);
+///
+// Semaphores
+
+void semaphore_init(Semaphore *sem, u32 initial_count) {
+	sem->count = initial_count;
+	sem->waiters = 0;
+}
+void semaphore_destroy(Semaphore *sem) {
+	assert(sem->waiters == 0, "Destroyed a semaphore which threads are waiting on");
 }
 
-void binary_semaphore_destroy(Binary_Semaphore *sem) {
-    mutex_destroy(&sem->mutex);
+bool semaphore_try_wait(Semaphore *sem) {
+	u32 count = sem->count;
+	while (count > 0) {
+		if (compare_and_swap_32(&sem->count, count-1, count)) return true;
+		count = sem->count;
+	}
+	return false;
+}
+void semaphore_wait(Semaphore *sem) {
+	while (!semaphore_try_wait(sem)) {
+		// Count ourselves as waiting before the OS looks at the count again, so either the
+		// signal sees us or the OS sees the signal and doesn't put us to sleep.
+		atomic_fetch_add_32(&sem->waiters, 1);
+		os_wait_on_address(&sem->count, 0);
+		atomic_fetch_add_32(&sem->waiters, (u32)-1);
+	}
+}
+void semaphore_signal(Semaphore *sem, u32 count) {
+	if (count == 0) return;
+	atomic_fetch_add_32(&sem->count, count);
+	if (sem->waiters > 0) {
+		if (count == 1) os_wake_one_on_address(&sem->count);
+		else            os_wake_all_on_address(&sem->count);
+	}
 }
 
+void binary_semaphore_init(Binary_Semaphore *sem, bool initial_state) {
+	semaphore_init(&sem->sem, initial_state ? 1 : 0);
+}
+void binary_semaphore_destroy(Binary_Semaphore *sem) {
+	semaphore_destroy(&sem->sem);
+}
 void binary_semaphore_wait(Binary_Semaphore *sem) {
-    mutex_acquire_or_wait(&sem->mutex);
-    while (!sem->signaled) {
-        mutex_release(&sem->mutex);
-        os_yield_thread();
-        mutex_acquire_or_wait(&sem->mutex);
-    }
-    sem->signaled = false;
-    mutex_release(&sem->mutex);
+	semaphore_wait(&sem->sem);
 }
-
 void binary_semaphore_signal(Binary_Semaphore *sem) {
-    mutex_acquire_or_wait(&sem->mutex);
-    sem->signaled = true;
-    mutex_release(&sem->mutex);
+	// Already signaled is fine, it just stays at 1
+	if (compare_and_swap_32(&sem->sem.count, 1, 0) && sem->sem.waiters > 0) {
+		os_wake_one_on_address(&sem->sem.count);
+	}
+}
+
+
+///
+// Condition variables
+
+void condition_variable_init(Condition_Variable *cv) {
+	cv->sequence = 0;
+	cv->waiters = 0;
+}
+void condition_variable_destroy(Condition_Variable *cv) {
+	assert(cv->waiters == 0, "Destroyed a condition variable which threads are waiting on");
+}
+
+void condition_variable_wait(Condition_Variable *cv, Mutex *m) {
+	// Read the sequence while we still hold the mutex, so a signal that comes in after we
+	// release it changes the sequence and the OS won't let us sleep through it.
+	u32 sequence = cv->sequence;
+	atomic_fetch_add_32(&cv->waiters, 1);
+	mutex_release(m);
+	
+	os_wait_on_address(&cv->sequence, sequence);
+	
+	atomic_fetch_add_32(&cv->waiters, (u32)-1);
+	mutex_acquire_or_wait(m);
+}
+void condition_variable_signal(Condition_Variable *cv) {
+	atomic_fetch_add_32(&cv->sequence, 1);
+	if (cv->waiters > 0) os_wake_one_on_address(&cv->sequence);
+}
+void condition_variable_broadcast(Condition_Variable *cv) {
+	atomic_fetch_add_32(&cv->sequence, 1);
+	if (cv->waiters > 0) os_wake_all_on_address(&cv->sequence);
+}
+
+
+///
+// Events
+
+void event_init(Event *e, bool set) {
+	e->state = set ? 1 : 0;
+}
+void event_destroy(Event *e) {
+	assert(e->state != 2, "Destroyed an event which threads are waiting on");
+}
+
+void event_set(Event *e) {
+	if (atomic_exchange_32(&e->state, 1) == 2) {
+		os_wake_all_on_address(&e->state);
+	}
+}
+void event_reset(Event *e) {
+	// If it's not set there's nothing to reset, and we must not clear the sleepers state
+	compare_and_swap_32(&e->state, 0, 1);
+}
+void event_wait(Event *e) {
+	while (true) {
+		u32 state = atomic_load_32(&e->state, MEMORY_ORDER_ACQUIRE);
+		if (state == 1) break;
+		// Mark it as having sleepers so event_set wakes us
+		if (state == 0 && !compare_and_swap_32(&e->state, 2, 0)) continue;
+		os_wait_on_address(&e->state, 2);
+	}
+}
+bool event_is_set(Event *e) {
+	return e->state == 1;
+}
+
+
+///
+// Multi-producer multi-consumer queue
+
+void mpmc_queue_init_raw(Mpmc_Queue *q, u64 item_size, u64 capacity, Allocator allocator) {
+	assert(item_size > 0, "Queue item size can't be 0");
+	capacity = get_next_power_of_two(max(capacity, 2));
+	
+	memset(q, 0, sizeof(*q));
+	q->item_size = item_size;
+	q->cell_stride = sizeof(u64) + ((item_size+7) & ~7ULL);
+	q->mask = capacity-1;
+	q->allocator = allocator;
+	q->cells = (u8*)alloc(allocator, capacity*q->cell_stride);
+	
+	for (u64 i = 0; i < capacity; i++) {
+		*(u64*)(q->cells + i*q->cell_stride) = i;
+	}
+	q->enqueue_position = 0;
+	q->dequeue_position = 0;
+}
+
+void mpmc_queue_destroy(Mpmc_Queue *q) {
+	dealloc(q->allocator, q->cells);
+	q->cells = 0;
+}
+
+bool mpmc_queue_push_raw(Mpmc_Queue *q, void *item, u64 item_size) {
+	assert(item_size == q->item_size, "Pushed item is %llu bytes but the queue holds %llu byte items", item_size, q->item_size);
+	
+	u8 *cell;
+	u64 position = q->enqueue_position;
+	while (true) {
+		cell = q->cells + (position & q->mask)*q->cell_stride;
+		u64 sequence = atomic_load_64((volatile u64*)cell, MEMORY_ORDER_ACQUIRE);
+		s64 diff = (s64)sequence - (s64)position;
+		
+		if (diff == 0) {
+			// Our turn if nobody else claims it first
+			if (compare_and_swap_64(&q->enqueue_position, position+1, position)) break;
+		} else if (diff < 0) {
+			// Consumers haven't gotten to this cell since last lap
+			return false;
+		}
+		position = q->enqueue_position;
+	}
+	
+	memcpy(cell + sizeof(u64), item, item_size);
+	atomic_store_64((volatile u64*)cell, position+1, MEMORY_ORDER_RELEASE);
+	
+	return true;
+}
+
+bool mpmc_queue_pop_raw(Mpmc_Queue *q, void *item, u64 item_size) {
+	assert(item_size == q->item_size, "Popped item is %llu bytes but the queue holds %llu byte items", item_size, q->item_size);
+	
+	u8 *cell;
+	u64 position = q->dequeue_position;
+	while (true) {
+		cell = q->cells + (position & q->mask)*q->cell_stride;
+		u64 sequence = atomic_load_64((volatile u64*)cell, MEMORY_ORDER_ACQUIRE);
+		s64 diff = (s64)sequence - (s64)(position+1);
+		
+		if (diff == 0) {
+			if (compare_and_swap_64(&q->dequeue_position, position+1, position)) break;
+		} else if (diff < 0) {
+			// Nothing pushed here yet
+			return false;
+		}
+		position = q->dequeue_position;
+	}
+	
+	memcpy(item, cell + sizeof(u64), item_size);
+	// Free for the producer on the next lap
+	atomic_store_64((volatile u64*)cell, position + q->mask+1, MEMORY_ORDER_RELEASE);
+	
+	return true;
+}
+
+u64 mpmc_queue_get_count(Mpmc_Queue *q) {
+	u64 enqueue_position = q->enqueue_position;
+	u64 dequeue_position = q->dequeue_position;
+	return enqueue_position > dequeue_position ? enqueue_position-dequeue_position : 0;
+}
+
+
+///
+// Single-producer single-consumer ring
+
+void spsc_ring_init_raw(Spsc_Ring *r, u64 item_size, u64 capacity, Allocator allocator) {
+	assert(item_size > 0, "Ring item size can't be 0");
+	capacity = get_next_power_of_two(max(capacity, 2));
+	
+	memset(r, 0, sizeof(*r));
+	r->item_size = item_size;
+	r->mask = capacity-1;
+	r->allocator = allocator;
+	r->items = (u8*)alloc(allocator, capacity*item_size);
+}
+
+void spsc_ring_destroy(Spsc_Ring *r) {
+	dealloc(r->allocator, r->items);
+	r->items = 0;
+}
+
+bool spsc_ring_push_raw(Spsc_Ring *r, void *item, u64 item_size) {
+	assert(item_size == r->item_size, "Pushed item is %llu bytes but the ring holds %llu byte items", item_size, r->item_size);
+	
+	u64 position = r->write_position;
+	if (position - r->cached_read_position > r->mask) {
+		// Looks full, see how far the consumer actually got
+		r->cached_read_position = atomic_load_64(&r->read_position, MEMORY_ORDER_ACQUIRE);
+		if (position - r->cached_read_position > r->mask) return false;
+	}
+	
+	memcpy(r->items + (position & r->mask)*item_size, item, item_size);
+	atomic_store_64(&r->write_position, position+1, MEMORY_ORDER_RELEASE);
+	
+	return true;
+}
+
+bool spsc_ring_pop_raw(Spsc_Ring *r, void *item, u64 item_size) {
+	assert(item_size == r->item_size, "Popped item is %llu bytes but the ring holds %llu byte items", item_size, r->item_size);
+	
+	u64 position = r->read_position;
+	if (position == r->cached_write_position) {
+		// Looks empty, see if the producer pushed more since last time
+		r->cached_write_position = atomic_load_64(&r->write_position, MEMORY_ORDER_ACQUIRE);
+		if (position == r->cached_write_position) return false;
+	}
+	
+	memcpy(item, r->items + (position & r->mask)*item_size, item_size);
+	atomic_store_64(&r->read_position, position+1, MEMORY_ORDER_RELEASE);
+	
+	return true;
+}
+
+u64 spsc_ring_get_count(Spsc_Ring *r) {
+	u64 write_position = r->write_position;
+	u64 read_position = r->read_position;
+	return write_position > read_position ? write_position-read_position : 0;
 }
 
 #endif
\ No newline at end of file
@@ -23,6 +23,20 @@ typedef struct Cpu_Capabilities {
 // I think this is the standard? (sse1)
 #define COMPILER_CAN_DO_SSE 1
 
+// For atomic_load_xx & atomic_store_xx.
+// Read-modify-writes (compare_and_swap, fetch_add, fetch_or, exchange) are always full fences.
+typedef enum Memory_Order {
+	// Only the access itself is atomic, anything may be reordered around it
+	MEMORY_ORDER_RELAXED,
+	// For loads: nothing after the load happens before it. Pair with a release store to see
+	// everything that was written before it.
+	MEMORY_ORDER_ACQUIRE,
+	// For stores: nothing before the store happens after it
+	MEMORY_ORDER_RELEASE,
+	// Acquire or release, and every thread sees all seq_cst accesses in the same order
+	MEMORY_ORDER_SEQ_CST,
+} Memory_Order;
+
 ///
 // Compiler specific stuff
 #if COMPILER_MVSC
@@ -44,6 +58,12 @@ typedef struct Cpu_Capabilities {
     rdtsc() {
         return __rdtsc();
     }
+    // Tells the cpu we're spinning so it can back off the memory bus and give the other
+    // hyperthread the core.
+    inline void
+    cpu_pause() {
+    	_mm_pause();
+    }
     inline Cpu_Info_X86 cpuid(u32 function_id) {
     	Cpu_Info_X86 i;
     	__cpuid((int*)&i, function_id);
@@ -106,6 +126,73 @@ typedef struct Cpu_Capabilities {
 	}
 	
 	#define MEMORY_BARRIER _ReadWriteBarrier()
+	// Only stops the compiler from reordering. On x86 that's enough for acquire loads and
+	// release stores, the cpu doesn't reorder loads with loads or stores with stores.
+	#define COMPILER_BARRIER _ReadWriteBarrier()
+	
+	#pragma intrinsic(_InterlockedExchange)
+	#pragma intrinsic(_InterlockedExchange64)
+	#pragma intrinsic(_InterlockedExchangeAdd)
+	#pragma intrinsic(_InterlockedExchangeAdd64)
+	#pragma intrinsic(_InterlockedOr)
+	#pragma intrinsic(_InterlockedOr64)
+	
+	// x86 loads are already acquire and stores already release, so only the compiler needs
+	// to be stopped. seq_cst stores are done with an exchange, which is a full fence.
+	inline u32
+	atomic_load_32(volatile u32 *a, Memory_Order order) {
+		u32 value = *a;
+		_ReadWriteBarrier();
+		return value;
+	}
+	inline u64
+	atomic_load_64(volatile u64 *a, Memory_Order order) {
+		u64 value = *a;
+		_ReadWriteBarrier();
+		return value;
+	}
+	inline void
+	atomic_store_32(volatile u32 *a, u32 value, Memory_Order order) {
+		if (order == MEMORY_ORDER_SEQ_CST) {
+			_InterlockedExchange((volatile long*)a, (long)value);
+		} else {
+			_ReadWriteBarrier();
+			*a = value;
+		}
+	}
+	inline void
+	atomic_store_64(volatile u64 *a, u64 value, Memory_Order order) {
+		if (order == MEMORY_ORDER_SEQ_CST) {
+			_InterlockedExchange64((volatile long long*)a, (long long)value);
+		} else {
+			_ReadWriteBarrier();
+			*a = value;
+		}
+	}
+	inline u32
+	atomic_fetch_add_32(volatile u32 *a, u32 value) {
+		return (u32)_InterlockedExchangeAdd((volatile long*)a, (long)value);
+	}
+	inline u64
+	atomic_fetch_add_64(volatile u64 *a, u64 value) {
+		return (u64)_InterlockedExchangeAdd64((volatile long long*)a, (long long)value);
+	}
+	inline u32
+	atomic_fetch_or_32(volatile u32 *a, u32 value) {
+		return (u32)_InterlockedOr((volatile long*)a, (long)value);
+	}
+	inline u64
+	atomic_fetch_or_64(volatile u64 *a, u64 value) {
+		return (u64)_InterlockedOr64((volatile long long*)a, (long long)value);
+	}
+	inline u32
+	atomic_exchange_32(volatile u32 *a, u32 value) {
+		return (u32)_InterlockedExchange((volatile long*)a, (long)value);
+	}
+	inline u64
+	atomic_exchange_64(volatile u64 *a, u64 value) {
+		return (u64)_InterlockedExchange64((volatile long long*)a, (long long)value);
+	}
 	
 	#define thread_local __declspec(thread)
 	
@@ -133,6 +220,12 @@ typedef struct Cpu_Capabilities {
         __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
         return ((u64)hi << 32) | lo;
     }
+    // Tells the cpu we're spinning so it can back off the memory bus and give the other
+    // hyperthread the core.
+    inline void
+    cpu_pause() {
+    	__builtin_ia32_pause();
+    }
     
     inline 
     Cpu_Info_X86 cpuid(u32 function_id) {
@@ -226,6 +319,57 @@ typedef struct Cpu_Capabilities {
 	}
 	
 	#define MEMORY_BARRIER {__asm__ __volatile__("" ::: "memory");__sync_synchronize();}
+	// Only stops the compiler from reordering. On x86 that's enough for acquire loads and
+	// release stores, the cpu doesn't reorder loads with loads or stores with stores.
+	#define COMPILER_BARRIER __asm__ __volatile__("" ::: "memory")
+	
+	// Release makes no sense for a load and acquire makes no sense for a store, so those
+	// are treated as the one that does.
+	#define gcc_load_order(order) \
+		((order) == MEMORY_ORDER_RELAXED ? __ATOMIC_RELAXED : (order) == MEMORY_ORDER_SEQ_CST ? __ATOMIC_SEQ_CST : __ATOMIC_ACQUIRE)
+	#define gcc_store_order(order) \
+		((order) == MEMORY_ORDER_RELAXED ? __ATOMIC_RELAXED : (order) == MEMORY_ORDER_SEQ_CST ? __ATOMIC_SEQ_CST : __ATOMIC_RELEASE)
+	
+	inline u32
+	atomic_load_32(volatile u32 *a, Memory_Order order) {
+		return __atomic_load_n(a, gcc_load_order(order));
+	}
+	inline u64
+	atomic_load_64(volatile u64 *a, Memory_Order order) {
+		return __atomic_load_n(a, gcc_load_order(order));
+	}
+	inline void
+	atomic_store_32(volatile u32 *a, u32 value, Memory_Order order) {
+		__atomic_store_n(a, value, gcc_store_order(order));
+	}
+	inline void
+	atomic_store_64(volatile u64 *a, u64 value, Memory_Order order) {
+		__atomic_store_n(a, value, gcc_store_order(order));
+	}
+	inline u32
+	atomic_fetch_add_32(volatile u32 *a, u32 value) {
+		return __atomic_fetch_add(a, value, __ATOMIC_SEQ_CST);
+	}
+	inline u64
+	atomic_fetch_add_64(volatile u64 *a, u64 value) {
+		return __atomic_fetch_add(a, value, __ATOMIC_SEQ_CST);
+	}
+	inline u32
+	atomic_fetch_or_32(volatile u32 *a, u32 value) {
+		return __atomic_fetch_or(a, value, __ATOMIC_SEQ_CST);
+	}
+	inline u64
+	atomic_fetch_or_64(volatile u64 *a, u64 value) {
+		return __atomic_fetch_or(a, value, __ATOMIC_SEQ_CST);
+	}
+	inline u32
+	atomic_exchange_32(volatile u32 *a, u32 value) {
+		return __atomic_exchange_n(a, value, __ATOMIC_SEQ_CST);
+	}
+	inline u64
+	atomic_exchange_64(volatile u64 *a, u64 value) {
+		return __atomic_exchange_n(a, value, __ATOMIC_SEQ_CST);
+	}
 	
 	#define thread_local __thread
 	
@@ -243,6 +387,8 @@ typedef struct Cpu_Capabilities {
     
     inline u64 
     rdtsc() { return 0; }
+    inline void
+    cpu_pause() {}
     inline Cpu_Info_X86 cpuid(u32 function_id) {return (Cpu_Info_X86){0};}
     #define COMPILER_CAN_DO_SSE2 0
     #define COMPILER_CAN_DO_AVX 0
@@ -252,6 +398,7 @@ typedef struct Cpu_Capabilities {
     #define DEPRECATED(proc, msg) 
     
     #define MEMORY_BARRIER
+    #define COMPILER_BARRIER
     
     #warning "Compiler is not explicitly supported, some things will probably not work as expected"
 #endif
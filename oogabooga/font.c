@@ -101,7 +101,7 @@ typedef struct Gfx_Font_Variation {
 } Gfx_Font_Variation;
 typedef struct Gfx_Font {
 	stbtt_fontinfo stbtt_handle;
-	string raw_font_data;
+	string raw_font_data; // File mapping, stb_truetype reads from this for the lifetime of the font
 	Gfx_Font_Variation variations[MAX_FONT_HEIGHT]; // Variation per font height
 	Allocator allocator;
 } Gfx_Font;
@@ -109,19 +109,22 @@ typedef struct Gfx_Font {
 Gfx_Font *load_font_from_disk(string path, Allocator allocator) {
 	
 	string font_data;
-	bool read_ok = os_read_entire_file(path, &font_data, allocator);
+	bool map_ok = os_file_map(path, &font_data);
 	
-	if (!read_ok) return 0;
+	if (!map_ok) return 0;
 	
 	third_party_allocator = allocator;
 	
 	stbtt_fontinfo stbtt_handle;
 	int result = stbtt_InitFont(&stbtt_handle, font_data.data, stbtt_GetFontOffsetForIndex(font_data.data, 0));
 	
-	if (result == 0) return 0;
+	if (result == 0) {
+		os_file_unmap(font_data);
+		third_party_allocator = ZERO(Allocator);
+		return 0;
+	}
 	
-	Gfx_Font *font = alloc(allocator, sizeof(Gfx_Font));
-	memset(font, 0, sizeof(Gfx_Font));
+	Gfx_Font *font = alloc_zeroed(allocator, sizeof(Gfx_Font));
 	font->stbtt_handle = stbtt_handle;
 	font->raw_font_data = font_data;
 	font->allocator = allocator;
@@ -148,7 +151,7 @@ void destroy_font(Gfx_Font *font) {
 		
 	}
 
-	dealloc_string(font->allocator, font->raw_font_data);
+	os_file_unmap(font->raw_font_data);
 	dealloc(font->allocator, font);
 	
 	third_party_allocator = ZERO(Allocator);
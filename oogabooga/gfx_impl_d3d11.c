@@ -871,8 +871,7 @@ void gfx_init_image(Gfx_Image *image, void *initial_data) {
 	void *data = initial_data;
     if (!initial_data){
     	// #Incomplete 8 bit width assumed
-    	data = alloc(image->allocator, image->width*image->height*image->channels);
-    	memset(data, 0, image->width*image->height*image->channels);
+    	data = alloc_zeroed(image->allocator, image->width*image->height*image->channels);
     }
     
 	assert(image->channels > 0 && image->channels <= 4 && image->channels != 3, "Only 1, 2 or 4 channels allowed on images. Got %d", image->channels);
@@ -82,8 +82,9 @@ make_image(u32 width, u32 height, u32 channels, void *initial_data, Allocator al
 
 Gfx_Image *
 load_image_from_disk(string path, Allocator allocator) {
+    // Decode straight from the file mapping, no need for a copy of the compressed image
     string png;
-    bool ok = os_read_entire_file(path, &png, allocator);
+    bool ok = os_file_map(path, &png);
     if (!ok) return 0;
 
     Gfx_Image *image = alloc(allocator, sizeof(Gfx_Image));
@@ -96,7 +97,7 @@ load_image_from_disk(string path, Allocator allocator) {
     
     if (!stb_data) {
         dealloc(allocator, image);
-        dealloc_string(allocator, png);
+        os_file_unmap(png);
         return 0;
     }
     
@@ -106,7 +107,7 @@ load_image_from_disk(string path, Allocator allocator) {
     image->allocator = allocator;
     image->channels = 4;
 
-    dealloc_string(allocator, png);
+    os_file_unmap(png);
     
     gfx_init_image(image, stb_data);
     
@@ -0,0 +1,339 @@
+///
+// Jobs
+// A worker thread per logical core (minus the thread that calls job_system_init) runs jobs.
+// Every worker, and the thread that called job_system_init, has its own Chase-Lev deque: it
+// pushes and pops jobs at the bottom without locking, and workers that run out of work steal
+// from the top of the others.
+// A Job_Counter counts unfinished jobs. job_wait() runs other jobs while it waits instead of
+// blocking, so jobs can wait on jobs they started.
+// Workers that have nothing to do for a while sleep on a Semaphore, and starting jobs wakes them.
+// Workers have their own temporary storage. What a job allocates there is freed when it returns.
+// Jobs started from threads that are not part of the job system (or before job_system_init)
+// just run right away on that thread.
+//
+// Usage:
+//
+//	void update_entity(void *data, u64 index) { Entity *entities = data; ... entities[index] ... }
+//
+//	job_system_init(0);
+//	Job_Counter counter = ZERO(Job_Counter);
+//	job_run_many(update_entity, entities, entity_count, &counter);
+//	job_wait(&counter);
+
+#define JOB_DEQUE_CAPACITY 4096 // Must be a power of two. If a deque is full the job runs right away.
+#define JOB_MAX_WORKERS 64
+#define JOB_WORKER_TEMPORARY_STORAGE_SIZE (64*1024)
+
+typedef void(*Job_Proc)(void *data, u64 index);
+
+typedef struct Job_Counter {
+	volatile u64 count; // Jobs that haven't finished
+} Job_Counter;
+
+typedef struct Job {
+	Job_Proc proc;
+	void *data;
+	u64 index;
+	Job_Counter *counter;
+} Job;
+
+typedef struct alignat(64) Job_Deque {
+	volatile s64 top;    // Thieves take from here
+	u8 padding_top[64-sizeof(s64)];
+	volatile s64 bottom; // Owner pushes & pops here
+	u8 padding_bottom[64-sizeof(s64)];
+	Job jobs[JOB_DEQUE_CAPACITY];
+} Job_Deque;
+
+typedef struct Job_System {
+	Job_Deque *deques; // [0] is the main thread, [1..] the workers
+	Thread *workers;
+	u64 worker_count;
+	volatile bool running;
+	Semaphore wake_workers;
+	volatile u32 sleeping_worker_count; // Sleeping workers nobody has woken yet
+} Job_System;
+
+// #Global
+ogb_instance Job_System job_system;
+
+// worker_count 0 means one per logical core minus the calling thread.
+// The calling thread becomes the job system's main thread.
+void ogb_instance
+job_system_init(u64 worker_count);
+
+// Waits for the workers to finish what they're doing. Jobs still queued are dropped.
+void ogb_instance
+job_system_shutdown();
+
+// Worker threads, not counting the main thread
+u64 ogb_instance
+job_system_get_worker_count();
+
+// counter can be 0 if you don't need to wait on it
+void ogb_instance
+job_run(Job_Proc proc, void *data, Job_Counter *counter);
+
+// count jobs with index 0 to count-1
+void ogb_instance
+job_run_many(Job_Proc proc, void *data, u64 count, Job_Counter *counter);
+
+// Runs jobs until the counter is 0
+void ogb_instance
+job_wait(Job_Counter *counter);
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+Job_System job_system;
+thread_local s64 job_deque_index = -1; // -1 if not part of the job system
+thread_local u64 job_steal_seed = 0;
+
+inline u64 job_counter_add(Job_Counter *counter, s64 delta) {
+	return atomic_fetch_add_64(&counter->count, (u64)delta)+(u64)delta;
+}
+
+// Owner only
+bool job_deque_push(Job_Deque *deque, Job job) {
+	s64 bottom = deque->bottom;
+	s64 top = deque->top;
+	if (bottom - top >= JOB_DEQUE_CAPACITY) return false;
+	
+	deque->jobs[bottom & (JOB_DEQUE_CAPACITY-1)] = job;
+	MEMORY_BARRIER; // Job must be visible before the new bottom
+	deque->bottom = bottom+1;
+	return true;
+}
+
+// Owner only. Takes the newest job.
+bool job_deque_pop(Job_Deque *deque, Job *job) {
+	s64 bottom = deque->bottom - 1;
+	// Has to be a full fence: thieves must see the new bottom before we read top
+	atomic_store_64((volatile u64*)&deque->bottom, (u64)bottom, MEMORY_ORDER_SEQ_CST);
+	s64 top = deque->top;
+	
+	if (top > bottom) {
+		// Empty
+		deque->bottom = bottom+1;
+		return false;
+	}
+	
+	*job = deque->jobs[bottom & (JOB_DEQUE_CAPACITY-1)];
+	if (top == bottom) {
+		// Last one, might be racing a thief for it
+		bool won = compare_and_swap_64((volatile u64*)&deque->top, (u64)(top+1), (u64)top);
+		deque->bottom = bottom+1;
+		return won;
+	}
+	return true;
+}
+
+// Any thread. Takes the oldest job.
+bool job_deque_steal(Job_Deque *deque, Job *job) {
+	s64 top = deque->top;
+	MEMORY_BARRIER;
+	s64 bottom = deque->bottom;
+	if (top >= bottom) return false;
+	
+	// If the owner or another thief took it first the CAS fails and we throw this away
+	*job = deque->jobs[top & (JOB_DEQUE_CAPACITY-1)];
+	return compare_and_swap_64((volatile u64*)&deque->top, (u64)(top+1), (u64)top);
+}
+
+void job_execute(Job job) {
+	// Workers own their temporary storage, the main thread resets its own every frame.
+	// A scope rather than a reset, since a job waiting in job_wait runs other jobs on top
+	// of its own temporary allocations.
+	bool scoped = job_deque_index > 0;
+	Temp_Scope scope;
+	if (scoped) scope = temp_scope_begin();
+	
+	job.proc(job.data, job.index);
+	
+	if (scoped) temp_scope_end(scope);
+	
+	if (job.counter) job_counter_add(job.counter, -1);
+}
+
+// Own deque first, then try to steal
+bool job_try_run_one() {
+	if (job_deque_index < 0 || !job_system.running) return false;
+	
+	Job job;
+	if (job_deque_pop(&job_system.deques[job_deque_index], &job)) {
+		job_execute(job);
+		return true;
+	}
+	
+	u64 deque_count = job_system.worker_count+1;
+	job_steal_seed = job_steal_seed*6364136223846793005ULL + 1442695040888963407ULL;
+	u64 first = (job_steal_seed >> 33) % deque_count;
+	for (u64 i = 0; i < deque_count; i++) {
+		u64 victim = (first+i) % deque_count;
+		if ((s64)victim == job_deque_index) continue;
+		if (job_deque_steal(&job_system.deques[victim], &job)) {
+			job_execute(job);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool job_any_queued() {
+	for (u64 i = 0; i < job_system.worker_count+1; i++) {
+		Job_Deque *deque = &job_system.deques[i];
+		if (deque->top < deque->bottom) return true;
+	}
+	return false;
+}
+
+// Wakes up to count sleeping workers
+void job_wake_workers(u64 count) {
+	MEMORY_BARRIER; // Sleeping workers look at the deques after counting themselves, so they must see the new jobs
+	
+	u32 woken = 0;
+	while (woken < count) {
+		u32 sleeping = job_system.sleeping_worker_count;
+		if (sleeping == 0) break;
+		if (compare_and_swap_32(&job_system.sleeping_worker_count, sleeping-1, sleeping)) woken += 1;
+	}
+	if (woken > 0) semaphore_signal(&job_system.wake_workers, woken);
+}
+
+void job_worker_sleep() {
+	atomic_fetch_add_32(&job_system.sleeping_worker_count, 1);
+	
+	// A job might have been started before it could see us sleeping
+	if (!job_system.running || job_any_queued()) {
+		u32 sleeping = job_system.sleeping_worker_count;
+		while (sleeping > 0) {
+			if (compare_and_swap_32(&job_system.sleeping_worker_count, sleeping-1, sleeping)) return;
+			sleeping = job_system.sleeping_worker_count;
+		}
+		// Somebody already counted us as woken, so there's a signal for us on its way
+	}
+	
+	semaphore_wait(&job_system.wake_workers);
+}
+
+void job_worker_proc(Thread *t) {
+	job_deque_index = (s64)(u64)t->data;
+	job_steal_seed = rdtsc() + (u64)job_deque_index;
+	
+	u64 idle_count = 0;
+	while (job_system.running) {
+		if (job_try_run_one()) {
+			idle_count = 0;
+			continue;
+		}
+		
+		// New work usually comes in bursts, so look around for a bit before going to sleep
+		idle_count += 1;
+		if      (idle_count < 64)  { /* spin */ }
+		else if (idle_count < 128) os_yield_thread();
+		else {
+			job_worker_sleep();
+			idle_count = 0;
+		}
+	}
+}
+
+void job_system_init(u64 worker_count) {
+	assert(!job_system.running, "Job system is already running");
+	
+	if (worker_count == 0) {
+		u64 processors = os_get_number_of_logical_processors();
+		worker_count = processors > 1 ? processors-1 : 1;
+	}
+	worker_count = min(worker_count, JOB_MAX_WORKERS);
+	
+	job_system.worker_count = worker_count;
+	job_system.deques = (Job_Deque*)alloc_aligned(get_heap_allocator(), (worker_count+1)*sizeof(Job_Deque), 64);
+	for (u64 i = 0; i < worker_count+1; i++) {
+		job_system.deques[i].top = 0;
+		job_system.deques[i].bottom = 0;
+	}
+	job_system.workers = (Thread*)alloc(get_heap_allocator(), worker_count*sizeof(Thread));
+	
+	semaphore_init(&job_system.wake_workers, 0);
+	job_system.sleeping_worker_count = 0;
+	
+	job_deque_index = 0;
+	job_steal_seed = rdtsc();
+	job_system.running = true;
+	MEMORY_BARRIER;
+	
+	for (u64 i = 0; i < worker_count; i++) {
+		Thread *t = &job_system.workers[i];
+		os_thread_init(t, job_worker_proc);
+		t->data = (void*)(i+1);
+		t->temporary_storage_size = JOB_WORKER_TEMPORARY_STORAGE_SIZE;
+		os_thread_start(t);
+	}
+}
+
+void job_system_shutdown() {
+	assert(job_deque_index == 0, "job_system_shutdown must be called from the thread that called job_system_init");
+	
+	job_system.running = false;
+	MEMORY_BARRIER;
+	// Enough for every worker, whether it's sleeping or about to
+	semaphore_signal(&job_system.wake_workers, (u32)job_system.worker_count);
+	for (u64 i = 0; i < job_system.worker_count; i++) {
+		os_thread_destroy(&job_system.workers[i]); // Joins
+	}
+	semaphore_init(&job_system.wake_workers, 0);
+	
+	dealloc(get_heap_allocator(), job_system.workers);
+	dealloc(get_heap_allocator(), job_system.deques);
+	job_system.workers = 0;
+	job_system.deques = 0;
+	job_system.worker_count = 0;
+	job_deque_index = -1;
+}
+
+u64 job_system_get_worker_count() {
+	return job_system.worker_count;
+}
+
+void job_run(Job_Proc proc, void *data, Job_Counter *counter) {
+	job_run_many(proc, data, 1, counter);
+}
+
+void job_run_many(Job_Proc proc, void *data, u64 count, Job_Counter *counter) {
+	if (counter) job_counter_add(counter, (s64)count);
+	
+	u64 queued = 0;
+	for (u64 i = 0; i < count; i++) {
+		Job job;
+		job.proc = proc;
+		job.data = data;
+		job.index = i;
+		job.counter = counter;
+		
+		if (job_deque_index < 0 || !job_system.running || !job_deque_push(&job_system.deques[job_deque_index], job)) {
+			// Full, get help with what's queued while we run this one
+			if (queued > 0) job_wake_workers(queued);
+			queued = 0;
+			job_execute(job);
+		} else {
+			queued += 1;
+		}
+	}
+	if (queued > 0) job_wake_workers(queued);
+}
+
+void job_wait(Job_Counter *counter) {
+	u64 idle_count = 0;
+	while (counter->count != 0) {
+		if (job_try_run_one()) {
+			idle_count = 0;
+		} else {
+			// Whatever we're waiting on is running on another thread
+			idle_count += 1;
+			if (idle_count > 64) os_yield_thread();
+		}
+	}
+	MEMORY_BARRIER; // See what the jobs wrote
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
@@ -14,6 +14,11 @@ u8 *init_memory_head = init_memory_arena;
 
 void* initialization_allocator_proc(u64 size, void *p, Allocator_Message message, void *data) {
 	switch (message) {
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			init_memory_head = (u8*)align_next((u64)init_memory_head, (u64)p);
+		} // fallthrough
+		// Never handed out twice, so it's still zero
+		case ALLOCATOR_ALLOCATE_ZEROED:
 		case ALLOCATOR_ALLOCATE: {
 			p = init_memory_head;
 			init_memory_head += size;
@@ -45,6 +50,9 @@ Allocator get_initialization_allocator() {
 ///
 // Basic general heap allocator, free list
 ///
+// Small allocations (<= HEAP_SLAB_MAX_SIZE) don't go here, they're served from size-class
+// slabs (see Heap slabs below) which is O(1) and doesn't fragment the free list.
+// For everything bigger:
 // Technically thread safe but synchronization is horrible.
 // Fragmentation is catastrophic.
 // We could fix it by merging free nodes every now and then
@@ -56,8 +64,16 @@ Allocator get_initialization_allocator() {
 typedef struct Heap_Free_Node Heap_Free_Node;
 typedef struct Heap_Block Heap_Block;
 
+// What heap_trim() left of the whole pages inside a free node (never the page with the header)
+typedef enum Heap_Free_Pages {
+	HEAP_FREE_PAGES_COMMITTED   = 0,
+	HEAP_FREE_PAGES_DECOMMITTED = 1,
+	HEAP_FREE_PAGES_MIXED       = 2, // Merged from nodes where not all pages were decommitted
+} Heap_Free_Pages;
+
 typedef struct Heap_Free_Node {
-	u64 size;
+	u64 size  : 62;
+	u64 pages : 2; // Heap_Free_Pages. Squeezed in here to keep free nodes at 16 bytes.
 	Heap_Free_Node *next;
 } Heap_Free_Node;
 
@@ -83,18 +99,48 @@ typedef alignat(16) struct Heap_Allocation_Metadata {
 #endif
 } Heap_Allocation_Metadata;
 
+// Live allocations by size for heap_get_stats: [0] is <= 16 bytes, [1] <= 32 bytes and so on.
+#define HEAP_STATS_SIZE_BUCKET_COUNT 32
+
 // #Global
 ogb_instance Heap_Block *heap_head;
 ogb_instance bool heap_initted;
 ogb_instance Spinlock heap_lock;
+// Protected by heap_lock
+ogb_instance u64 heap_block_committed;
+ogb_instance u64 heap_block_allocated; // Including metadata
+ogb_instance u64 heap_block_live_counts[HEAP_STATS_SIZE_BUCKET_COUNT];
+ogb_instance u64 heap_validation_counter;
+ogb_instance u64 heap_block_decommitted; // Free pages given back by heap_trim(), roughly
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Heap_Block *heap_head;
 bool heap_initted = false;
 Spinlock heap_lock;
+u64 heap_block_committed = 0;
+u64 heap_block_allocated = 0;
+u64 heap_block_live_counts[HEAP_STATS_SIZE_BUCKET_COUNT];
+u64 heap_validation_counter = 0;
+u64 heap_block_decommitted = 0;
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 	
 
+inline u64 heap_stats_get_size_bucket(u64 size) {
+	u64 bucket = 0;
+	while (bucket < HEAP_STATS_SIZE_BUCKET_COUNT-1 && (16ULL << bucket) < size) bucket += 1;
+	return bucket;
+}
+
+// meta->size of a Heap_Block allocation, must hold heap_lock
+inline void heap_block_stats_add(u64 size) {
+	heap_block_allocated += size;
+	heap_block_live_counts[heap_stats_get_size_bucket(size-sizeof(Heap_Allocation_Metadata))] += 1;
+}
+inline void heap_block_stats_remove(u64 size) {
+	heap_block_allocated -= size;
+	heap_block_live_counts[heap_stats_get_size_bucket(size-sizeof(Heap_Allocation_Metadata))] -= 1;
+}
+
 u64 get_heap_block_size_excluding_metadata(Heap_Block *block) {
 	return block->size - sizeof(Heap_Block);
 }
@@ -128,22 +174,21 @@ void sanity_check_block(Heap_Block *block) {
 	assert((u64)block->start == (u64)block + sizeof(Heap_Block), "A heap block is corrupt.");
 	
 
+	// Free nodes are sorted by address and never overlap, so checking that every node starts
+	// after the previous one ends also rules out circular references. O(n).
 	Heap_Free_Node *node = block->free_head;	
+	u8 *previous_end = (u8*)block->start;
+	u8 *block_end = (u8*)block + block->size;
 	
 	u64 total_free = 0;
 	while (node != 0) {
-		Heap_Free_Node *other_node = node->next;
-		
-		assert(node->size < GB(256), "Heap is corrupt");
 		assert(is_pointer_in_program_memory(node), "Heap is corrupt");
+		assert((u8*)node >= previous_end, "Heap free nodes are out of order or overlapping. This is probably an internal error, or an extremely unlucky result from heap corruption.");
+		assert(node->size < GB(256), "Heap is corrupt");
+		assert(node->size <= (u64)(block_end-(u8*)node), "Heap free node goes past the end of its block. This might be heap corruption, or possibly an internal error.");
 		
-		while (other_node != 0) {
-			assert(is_pointer_in_program_memory(other_node), "Heap is corrupt");
-			assert(other_node != node, "Circular reference in heap free node tree. This is probably an internal error, or an extremely unlucky result from heap corruption.");
-			other_node = other_node->next;
-		}
 		total_free += node->size;
-		assert(total_free <= block->size, "Free nodes are fucky wucky. This might be heap corruption, or possibly an internal error.");
+		previous_end = (u8*)node + node->size;
 		node = node->next;
 	}
 	
@@ -162,6 +207,64 @@ inline void check_meta(Heap_Allocation_Metadata *meta) {
 	assert((u64)meta >= (u64)meta->block->start && (u64)meta < (u64)meta->block->start+meta->block->size, "Heap error: Pointer is not in it's metadata block. This could be heap corruption but it's more likely an internal error. That's not good.");
 }
 
+// Every HEAP_VALIDATION_INTERVAL:th change to the block heap checks all heap blocks.
+// Called with heap_lock held.
+void heap_validate_sampled() {
+#if CONFIGURATION == DEBUG && HEAP_VALIDATION_INTERVAL > 0
+	heap_validation_counter += 1;
+	if (heap_validation_counter < HEAP_VALIDATION_INTERVAL) return;
+	heap_validation_counter = 0;
+	
+	for (Heap_Block *block = heap_head; block != 0; block = block->next) {
+		sanity_check_block(block);
+	}
+#endif
+}
+
+// In debug, freed memory is filled with 0x69 so reads after free stand out.
+// Whole pages inside a free node are locked instead, so we only fill what stays accessible.
+void heap_debug_fill_freed(void *p, u64 size) {
+#if CONFIGURATION == DEBUG
+	u8 *start = (u8*)p;
+	u8 *end = start + size;
+	u8 *locked_start = (u8*)align_next(start, os.page_size);
+	u8 *locked_end = (u8*)align_previous(end, os.page_size);
+	
+	if (os.large_page_size || locked_end <= locked_start) {
+		// Pages can't be locked (or nothing is page sized), fill everything
+		memset(start, 0x69, size);
+	} else {
+		memset(start, 0x69, (u64)(locked_start-start));
+		memset(locked_end, 0x69, (u64)(end-locked_end));
+	}
+#endif
+}
+
+// Pages between two merged nodes (the end of one, the header of the other) are always committed
+inline u64 heap_merged_free_pages(u64 a, u64 b) {
+	if (a == HEAP_FREE_PAGES_COMMITTED && b == HEAP_FREE_PAGES_COMMITTED) return HEAP_FREE_PAGES_COMMITTED;
+	return HEAP_FREE_PAGES_MIXED;
+}
+
+// heap_trim() may have decommitted the pages inside a free node (but never the page with the
+// node header). Recommits what we're about to use of it: the first used bytes plus the header
+// of whatever free node is left after. That node keeps node->pages, the pages we didn't touch
+// are still in the same state. Called with heap_lock held.
+void heap_block_recommit_free_pages(Heap_Free_Node *node, u64 node_size, u64 used) {
+	if (node->pages == HEAP_FREE_PAGES_COMMITTED) return;
+	
+	u8 *first_page = (u8*)align_next((u8*)node + sizeof(Heap_Free_Node), os.page_size);
+	u8 *end = (u8*)align_next((u8*)node + min(used + sizeof(Heap_Free_Node), node_size), os.page_size);
+	u8 *last_page_end = (u8*)align_previous((u8*)node + node_size, os.page_size);
+	if (end > last_page_end) end = last_page_end;
+	
+	if (end > first_page) {
+		bool ok = os_recommit_program_memory_pages(first_page, (u64)(end-first_page));
+		assert(ok, "Failed recommitting heap memory. Out of memory?");
+		heap_block_decommitted -= min(heap_block_decommitted, (u64)(end-first_page));
+	}
+}
+
 typedef struct {
 	Heap_Free_Node *best_fit;
 	Heap_Free_Node *previous;
@@ -217,7 +320,8 @@ Heap_Block *make_heap_block(Heap_Block *parent, u64 size) {
 
 	size += sizeof(Heap_Block);
 
-	size = align_next(size, os.page_size);
+	// Program memory is committed in whole large pages anyway
+	size = align_next(size, os.large_page_size ? os.large_page_size : os.page_size);
 
 	Heap_Block *block = (Heap_Block*)os_reserve_next_memory_pages(size);
 		
@@ -230,16 +334,619 @@ Heap_Block *make_heap_block(Heap_Block *parent, u64 size) {
 	block->total_allocated = 0;
 #endif
 	
+	heap_block_committed += size;
+	
 	block->start = ((u8*)block)+sizeof(Heap_Block);
 	block->size = size;
 	block->next = 0;
 	block->free_head = (Heap_Free_Node*)block->start;
 	block->free_head->size = get_heap_block_size_excluding_metadata(block);
+	block->free_head->pages = HEAP_FREE_PAGES_COMMITTED;
 	block->free_head->next = 0;
 	
 	return block;
 }
 
+///
+///
+// Heap slabs
+///
+// Allocations up to HEAP_SLAB_MAX_SIZE are rounded up to a size class, and each size class
+// has its own slabs: HEAP_SLAB_CHUNK_SIZE chunks of program memory cut into equally sized
+// slots. Allocating pops a slot from a free list, deallocating pushes it back, both O(1).
+// There is no per-allocation metadata, the Heap_Slab header lives at the start of the chunk
+// and chunks are aligned to HEAP_SLAB_CHUNK_SIZE so we find it by aligning the pointer down.
+// A bitmap over program memory tells us whether a chunk is a slab or part of a Heap_Block.
+//
+// Every thread has its own Heap_Thread_Cache which owns its slabs, so allocating and freeing
+// on the owning thread doesn't lock anything. heap_slab_lock is only taken when a cache needs
+// a whole new chunk or gives an empty one back.
+// Freeing a slot from another thread pushes it to the owning cache's remote_free list
+// (lock-free), and the owner picks those up on its next allocation.
+// When a thread exits its cache is abandoned (slabs and all) and adopted by the next thread
+// that needs one. Threads not started with os_thread_start never give theirs back.
+
+#define HEAP_SLAB_MAX_SIZE    4096
+#define HEAP_SLAB_CHUNK_SIZE  KB(64)
+#define HEAP_SLAB_SPAN_SIZE   MB(1) // How much we take from program memory at a time
+#define HEAP_SLAB_CLASS_COUNT 28
+
+// 16 byte steps up to 128, then 4 classes per power of two. Worst case waste is 25%.
+const u32 heap_slab_class_sizes[HEAP_SLAB_CLASS_COUNT] = {
+	16,   32,   48,   64,   80,   96,   112,  128,
+	160,  192,  224,  256,
+	320,  384,  448,  512,
+	640,  768,  896,  1024,
+	1280, 1536, 1792, 2048,
+	2560, 3072, 3584, 4096,
+};
+
+typedef struct Heap_Slab Heap_Slab;
+typedef struct Heap_Thread_Cache Heap_Thread_Cache;
+
+typedef struct Heap_Slab {
+	Heap_Slab *next;
+	Heap_Slab *previous;
+	Heap_Thread_Cache *owner;
+	void *free_list;
+	u8 *untouched; // Slots from here to end have never been handed out
+	u8 *end;
+	u32 size_class;
+	u32 slot_size;
+	u64 used_count;
+	bool decommitted; // Empty chunk that heap_trim() gave back, all but the first page
+} Heap_Slab;
+
+typedef struct Heap_Thread_Cache {
+	Heap_Slab *partial[HEAP_SLAB_CLASS_COUNT]; // Owned slabs with free slots
+	volatile u64 remote_free; // void*, slots freed by other threads. Lock-free stack.
+	Heap_Thread_Cache *next_abandoned;
+	Heap_Thread_Cache *next_cache; // All caches, for heap_get_stats
+	u64 live_counts[HEAP_SLAB_CLASS_COUNT]; // Only written by the owning thread
+} Heap_Thread_Cache;
+
+// Slots are HEAP_SLAB_MAX_ALIGNMENT aligned when the slot size is a multiple of it, which is how
+// aligned allocations pick their size class.
+#define HEAP_SLAB_MAX_ALIGNMENT 128
+#define HEAP_SLAB_FIRST_SLOT_OFFSET (align_next(sizeof(Heap_Slab), HEAP_SLAB_MAX_ALIGNMENT))
+
+// #Global
+ogb_instance Spinlock heap_slab_lock;
+ogb_instance Heap_Slab *heap_slab_empty_chunks;
+ogb_instance Heap_Thread_Cache *heap_abandoned_thread_caches;
+ogb_instance Heap_Thread_Cache *heap_all_thread_caches;
+ogb_instance u64 heap_slab_committed;
+ogb_instance u8 *heap_slab_span_next;
+ogb_instance u8 *heap_slab_span_end;
+ogb_instance u64 *heap_slab_chunk_bits;
+ogb_instance u64 heap_slab_chunk_bit_count;
+ogb_instance u8 heap_slab_class_lookup[HEAP_SLAB_MAX_SIZE/HEAP_ALIGNMENT+1];
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Spinlock heap_slab_lock;
+Heap_Slab *heap_slab_empty_chunks = 0;
+Heap_Thread_Cache *heap_abandoned_thread_caches = 0;
+Heap_Thread_Cache *heap_all_thread_caches = 0;
+u64 heap_slab_committed = 0;
+u8 *heap_slab_span_next = 0;
+u8 *heap_slab_span_end = 0;
+u64 *heap_slab_chunk_bits = 0;
+u64 heap_slab_chunk_bit_count = 0;
+u8 heap_slab_class_lookup[HEAP_SLAB_MAX_SIZE/HEAP_ALIGNMENT+1];
+thread_local Heap_Thread_Cache *heap_thread_cache = 0;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void *heap_block_alloc(u64 size);
+void heap_init();
+
+inline u64 heap_slab_get_chunk_index(void *p) {
+	u64 first_chunk = align_previous((u64)program_memory, HEAP_SLAB_CHUNK_SIZE);
+	return (align_previous((u64)p, HEAP_SLAB_CHUNK_SIZE) - first_chunk) / HEAP_SLAB_CHUNK_SIZE;
+}
+
+bool heap_is_slab_pointer(void *p) {
+	if (!is_pointer_in_program_memory(p)) return false;
+	u64 index = heap_slab_get_chunk_index(p);
+	if (index >= heap_slab_chunk_bit_count) return false;
+	return (heap_slab_chunk_bits[index/64] & (1ULL << (index%64))) != 0;
+}
+
+void heap_slabs_init() {
+	spinlock_init(&heap_slab_lock);
+	heap_slab_empty_chunks = 0;
+	heap_abandoned_thread_caches = 0;
+	heap_all_thread_caches = 0;
+	heap_slab_committed = 0;
+	heap_slab_span_next = 0;
+	heap_slab_span_end = 0;
+	
+	u32 size_class = 0;
+	for (u64 i = 0; i < HEAP_SLAB_MAX_SIZE/HEAP_ALIGNMENT+1; i++) {
+		while (heap_slab_class_sizes[size_class] < i*HEAP_ALIGNMENT) size_class += 1;
+		heap_slab_class_lookup[i] = (u8)size_class;
+	}
+	
+	// One bit per chunk of the whole reserved program memory range
+	heap_slab_chunk_bit_count = program_memory_reserved / HEAP_SLAB_CHUNK_SIZE + 1;
+	u64 bits_size = align_next(align_next(heap_slab_chunk_bit_count, 64)/8, os.page_size);
+	heap_slab_chunk_bits = (u64*)os_reserve_next_memory_pages(bits_size);
+	os_unlock_program_memory_pages(heap_slab_chunk_bits, bits_size);
+	memset(heap_slab_chunk_bits, 0, bits_size);
+}
+
+Heap_Thread_Cache *heap_get_thread_cache() {
+	if (heap_thread_cache) return heap_thread_cache;
+	
+	spinlock_acquire_or_wait(&heap_slab_lock);
+	Heap_Thread_Cache *cache = heap_abandoned_thread_caches;
+	if (cache) heap_abandoned_thread_caches = cache->next_abandoned;
+	spinlock_release(&heap_slab_lock);
+	
+	if (!cache) {
+		// Not from a slab, a slab would need a cache to allocate from
+		cache = (Heap_Thread_Cache*)heap_block_alloc(sizeof(Heap_Thread_Cache));
+		memset(cache, 0, sizeof(Heap_Thread_Cache));
+		
+		spinlock_acquire_or_wait(&heap_slab_lock);
+		cache->next_cache = heap_all_thread_caches;
+		heap_all_thread_caches = cache;
+		spinlock_release(&heap_slab_lock);
+	}
+	cache->next_abandoned = 0;
+	
+	heap_thread_cache = cache;
+	return cache;
+}
+
+// Called by the os layer when a thread exits
+void heap_thread_cache_release() {
+	Heap_Thread_Cache *cache = heap_thread_cache;
+	if (!cache) return;
+	heap_thread_cache = 0;
+	
+	spinlock_acquire_or_wait(&heap_slab_lock);
+	cache->next_abandoned = heap_abandoned_thread_caches;
+	heap_abandoned_thread_caches = cache;
+	spinlock_release(&heap_slab_lock);
+}
+
+inline void heap_slab_unlink(Heap_Slab *slab) {
+	if (slab->previous) slab->previous->next = slab->next;
+	else                slab->owner->partial[slab->size_class] = slab->next;
+	if (slab->next) slab->next->previous = slab->previous;
+	slab->next = 0;
+	slab->previous = 0;
+}
+inline void heap_slab_link(Heap_Slab *slab) {
+	slab->previous = 0;
+	slab->next = slab->owner->partial[slab->size_class];
+	if (slab->next) slab->next->previous = slab;
+	slab->owner->partial[slab->size_class] = slab;
+}
+inline bool heap_slab_is_full(Heap_Slab *slab) {
+	return !slab->free_list && slab->untouched+slab->slot_size > slab->end;
+}
+
+Heap_Slab *heap_slab_make(Heap_Thread_Cache *owner, u32 size_class) {
+	Heap_Slab *slab = 0;
+	
+	spinlock_acquire_or_wait(&heap_slab_lock);
+	if (heap_slab_empty_chunks) {
+		slab = heap_slab_empty_chunks;
+		heap_slab_empty_chunks = slab->next;
+		if (slab->decommitted) {
+			bool ok = os_recommit_program_memory_pages((u8*)slab + os.page_size, HEAP_SLAB_CHUNK_SIZE - os.page_size);
+			assert(ok, "Failed recommitting heap memory. Out of memory?");
+			heap_slab_committed += HEAP_SLAB_CHUNK_SIZE - os.page_size;
+		}
+	} else {
+		if (heap_slab_span_next >= heap_slab_span_end) {
+			// Chunks need to be aligned to their size, so skip ahead in program memory.
+			// The skipped pages are never touched so they only cost address space.
+			os_lock_mutex(program_memory_mutex); // #Sync
+			u64 misalignment = align_next((u64)program_memory_next, HEAP_SLAB_CHUNK_SIZE) - (u64)program_memory_next;
+			if (misalignment) os_reserve_next_memory_pages(misalignment);
+			u8 *span = (u8*)os_reserve_next_memory_pages(HEAP_SLAB_SPAN_SIZE);
+			os_unlock_mutex(program_memory_mutex); // #Sync
+			
+			assert((u64)span % HEAP_SLAB_CHUNK_SIZE == 0, "Internal heap error: slab span is not aligned");
+			os_unlock_program_memory_pages(span, HEAP_SLAB_SPAN_SIZE);
+			heap_slab_span_next = span;
+			heap_slab_span_end = span + HEAP_SLAB_SPAN_SIZE;
+			heap_slab_committed += HEAP_SLAB_SPAN_SIZE;
+		}
+		slab = (Heap_Slab*)heap_slab_span_next;
+		heap_slab_span_next += HEAP_SLAB_CHUNK_SIZE;
+		
+		u64 index = heap_slab_get_chunk_index(slab);
+		assert(index < heap_slab_chunk_bit_count, "Internal heap error: slab chunk out of range");
+		heap_slab_chunk_bits[index/64] |= 1ULL << (index%64);
+	}
+	spinlock_release(&heap_slab_lock);
+	
+	slab->next = 0;
+	slab->previous = 0;
+	slab->owner = owner;
+	slab->free_list = 0;
+	slab->untouched = (u8*)slab + HEAP_SLAB_FIRST_SLOT_OFFSET;
+	slab->end = (u8*)slab + HEAP_SLAB_CHUNK_SIZE;
+	slab->size_class = size_class;
+	slab->slot_size = heap_slab_class_sizes[size_class];
+	slab->used_count = 0;
+	slab->decommitted = false;
+	
+	return slab;
+}
+
+// Only ever called by the thread owning the slab
+void heap_slab_free_local(Heap_Slab *slab, void *p) {
+	assert(slab->used_count > 0, "Heap slab double free or corruption");
+	
+	bool was_full = heap_slab_is_full(slab);
+	
+	*(void**)p = slab->free_list;
+	slab->free_list = p;
+	slab->used_count -= 1;
+	slab->owner->live_counts[slab->size_class] -= 1;
+	
+	if (was_full) {
+		heap_slab_link(slab);
+	} else if (slab->used_count == 0 && (slab->next || slab->previous)) {
+		// Keep one empty slab per class around so we don't thrash, give the rest back
+		// for other threads and size classes to use.
+		heap_slab_unlink(slab);
+		slab->owner = 0;
+		slab->decommitted = false;
+		spinlock_acquire_or_wait(&heap_slab_lock);
+		slab->next = heap_slab_empty_chunks;
+		heap_slab_empty_chunks = slab;
+		spinlock_release(&heap_slab_lock);
+	}
+}
+
+void heap_thread_cache_collect_remote_frees(Heap_Thread_Cache *cache) {
+	// Take the whole stack. Other threads only ever push, so there's no ABA problem.
+	u64 head = atomic_exchange_64(&cache->remote_free, 0);
+	
+	void *p = (void*)head;
+	while (p) {
+		void *next = *(void**)p;
+		Heap_Slab *slab = (Heap_Slab*)align_previous((u64)p, HEAP_SLAB_CHUNK_SIZE);
+		assert(slab->owner == cache, "Internal heap error: remote free ended up in the wrong cache");
+		heap_slab_free_local(slab, p);
+		p = next;
+	}
+}
+
+void *heap_slab_alloc_from_class(u32 size_class) {
+	Heap_Thread_Cache *cache = heap_get_thread_cache();
+	
+	if (cache->remote_free) heap_thread_cache_collect_remote_frees(cache);
+	
+	Heap_Slab *slab = cache->partial[size_class];
+	if (!slab) {
+		slab = heap_slab_make(cache, size_class);
+		heap_slab_link(slab);
+	}
+	
+	void *p;
+	if (slab->free_list) {
+		p = slab->free_list;
+		slab->free_list = *(void**)p;
+	} else {
+		p = slab->untouched;
+		slab->untouched += slab->slot_size;
+	}
+	slab->used_count += 1;
+	cache->live_counts[size_class] += 1;
+	
+	if (heap_slab_is_full(slab)) heap_slab_unlink(slab);
+	
+	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Slab pointer is not aligned to HEAP_ALIGNMENT");
+	return p;
+}
+
+void *heap_slab_alloc(u64 size) {
+	assert(size <= HEAP_SLAB_MAX_SIZE, "Internal heap error: too big for slab");
+	return heap_slab_alloc_from_class(heap_slab_class_lookup[(size+HEAP_ALIGNMENT-1)/HEAP_ALIGNMENT]);
+}
+
+// Smallest size class that fits and whose slots all land on the alignment
+void *heap_slab_alloc_aligned(u64 size, u64 alignment) {
+	assert(size <= HEAP_SLAB_MAX_SIZE && alignment <= HEAP_SLAB_MAX_ALIGNMENT, "Internal heap error: can't do that in a slab");
+	u32 size_class = heap_slab_class_lookup[(size+HEAP_ALIGNMENT-1)/HEAP_ALIGNMENT];
+	while (heap_slab_class_sizes[size_class] % alignment != 0) size_class += 1;
+	
+	void *p = heap_slab_alloc_from_class(size_class);
+	assert((u64)p % alignment == 0, "Internal heap error. Aligned slab pointer is not aligned");
+	return p;
+}
+
+void heap_slab_dealloc(void *p) {
+	Heap_Slab *slab = (Heap_Slab*)align_previous((u64)p, HEAP_SLAB_CHUNK_SIZE);
+	
+#if CONFIGURATION == DEBUG
+	u64 slot_offset = (u64)p - ((u64)slab + HEAP_SLAB_FIRST_SLOT_OFFSET);
+	assert((u8*)p >= (u8*)slab + HEAP_SLAB_FIRST_SLOT_OFFSET && slot_offset % slab->slot_size == 0, "A bad pointer was passed to heap_dealloc: it points into a slab but not at the start of an allocation.");
+	assert(slab->owner != 0, "A bad pointer was passed to heap_dealloc: it points into an empty slab. Double free?");
+	memset(p, 0x69, slab->slot_size);
+#endif
+	
+	Heap_Thread_Cache *owner = slab->owner;
+	
+	if (owner == heap_thread_cache) {
+		heap_slab_free_local(slab, p);
+	} else {
+		// Not ours, hand it to the owner
+		u64 head;
+		do {
+			head = owner->remote_free;
+			*(void**)p = (void*)head;
+		} while (!compare_and_swap_64(&owner->remote_free, (u64)p, head));
+	}
+}
+
+///
+///
+// Large allocations
+///
+// Allocations of HEAP_LARGE_ALLOCATION_THRESHOLD or more get their own page-aligned region of
+// program memory instead of going in a Heap_Block. Dealloc decommits the pages so the memory
+// goes straight back to the OS, and the address range is kept around for later large allocations.
+// The region starts with a Heap_Allocation_Metadata where block is 0 and size is the region size.
+// Aligned allocations push the metadata further into the first page so it's still right before
+// the pointer.
+
+#ifndef HEAP_LARGE_ALLOCATION_THRESHOLD
+	#define HEAP_LARGE_ALLOCATION_THRESHOLD MB(1)
+#endif
+#define HEAP_MAX_FREE_LARGE_REGIONS 256
+
+typedef struct Heap_Large_Region {
+	u8 *start;
+	u64 size;
+} Heap_Large_Region;
+
+// #Global
+ogb_instance Spinlock heap_large_lock;
+ogb_instance Heap_Large_Region heap_free_large_regions[HEAP_MAX_FREE_LARGE_REGIONS]; // Sorted by address
+ogb_instance u64 heap_free_large_region_count;
+ogb_instance u64 heap_large_allocated; // Protected by heap_large_lock
+ogb_instance u64 heap_large_live_counts[HEAP_STATS_SIZE_BUCKET_COUNT];
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Spinlock heap_large_lock;
+Heap_Large_Region heap_free_large_regions[HEAP_MAX_FREE_LARGE_REGIONS];
+u64 heap_free_large_region_count = 0;
+u64 heap_large_allocated = 0;
+u64 heap_large_live_counts[HEAP_STATS_SIZE_BUCKET_COUNT];
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+inline bool heap_is_large_allocation(Heap_Allocation_Metadata *meta) {
+	return meta->block == 0;
+}
+inline u8 *heap_large_get_region(Heap_Allocation_Metadata *meta) {
+	return (u8*)align_previous(meta, os.page_size);
+}
+
+// Region size of a large allocation, must hold heap_large_lock
+inline void heap_large_stats_add(u64 region_size) {
+	heap_large_allocated += region_size;
+	heap_large_live_counts[heap_stats_get_size_bucket(region_size-sizeof(Heap_Allocation_Metadata))] += 1;
+}
+inline void heap_large_stats_remove(u64 region_size) {
+	heap_large_allocated -= region_size;
+	heap_large_live_counts[heap_stats_get_size_bucket(region_size-sizeof(Heap_Allocation_Metadata))] -= 1;
+}
+
+// Best fit from the address ranges of previous large allocations. Pages are still decommitted.
+u8 *heap_large_take_free_region(u64 region_size) {
+	u8 *region = 0;
+	
+	spinlock_acquire_or_wait(&heap_large_lock);
+	s64 best = -1;
+	for (u64 i = 0; i < heap_free_large_region_count; i++) {
+		if (heap_free_large_regions[i].size < region_size) continue;
+		if (best == -1 || heap_free_large_regions[i].size < heap_free_large_regions[best].size) best = (s64)i;
+	}
+	if (best != -1) {
+		Heap_Large_Region *free_region = &heap_free_large_regions[best];
+		region = free_region->start;
+		if (free_region->size == region_size) {
+			heap_free_large_region_count -= 1;
+			memmove(free_region, free_region+1, (heap_free_large_region_count-(u64)best)*sizeof(Heap_Large_Region));
+		} else {
+			free_region->start += region_size;
+			free_region->size  -= region_size;
+		}
+	}
+	spinlock_release(&heap_large_lock);
+	
+	return region;
+}
+
+// Address range for things that commit their own pages as they go (arenas).
+// Pages come back decommitted, give the range back with heap_large_release_region.
+u8 *heap_large_reserve_region(u64 region_size) {
+	assert(region_size % os.page_size == 0, "Region size must be aligned to page size");
+	if (!heap_initted) heap_init();
+	
+	u8 *region = heap_large_take_free_region(region_size);
+	if (!region) region = (u8*)os_reserve_next_memory_pages_decommitted(region_size);
+	return region;
+}
+
+// pages_zeroed tells if the OS handed us zeroed pages. Recommitted pages always are, fresh program
+// memory only in release since debug builds fill it with 0xBA.
+void *heap_large_alloc_pages(u64 size, u64 alignment, bool *pages_zeroed) {
+	assert(alignment <= os.page_size, "Internal heap error: large allocations can't be aligned to more than a page");
+	u64 header_size = align_next(sizeof(Heap_Allocation_Metadata), alignment);
+	u64 region_size = align_next(size + header_size, os.page_size);
+	
+	u8 *region = heap_large_take_free_region(region_size);
+	if (region) {
+		bool ok = os_recommit_program_memory_pages(region, region_size);
+		assert(ok, "Failed recommitting %d bytes for a large allocation. Out of memory?", region_size);
+		*pages_zeroed = true;
+	} else {
+		region = (u8*)os_reserve_next_memory_pages(region_size);
+		os_unlock_program_memory_pages(region, region_size);
+		*pages_zeroed = CONFIGURATION != DEBUG;
+	}
+	
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(region + header_size - sizeof(Heap_Allocation_Metadata));
+	meta->size = region_size;
+	meta->block = 0;
+#if CONFIGURATION == DEBUG
+	meta->signature = HEAP_META_SIGNATURE;
+#endif
+	
+	spinlock_acquire_or_wait(&heap_large_lock);
+	heap_large_stats_add(region_size);
+	spinlock_release(&heap_large_lock);
+	
+	return region + header_size;
+}
+void *heap_large_alloc_aligned(u64 size, u64 alignment) {
+	bool pages_zeroed;
+	return heap_large_alloc_pages(size, alignment, &pages_zeroed);
+}
+void *heap_large_alloc(u64 size) {
+	return heap_large_alloc_aligned(size, HEAP_ALIGNMENT);
+}
+
+// Decommits the pages and keeps the address range around for later large allocations
+void heap_large_release_region(u8 *region, u64 region_size) {
+	os_decommit_program_memory_pages(region, region_size);
+	
+	spinlock_acquire_or_wait(&heap_large_lock);
+	
+	u64 index = 0;
+	while (index < heap_free_large_region_count && heap_free_large_regions[index].start < region) index += 1;
+	
+	bool placed = true;
+	if (index > 0 && heap_free_large_regions[index-1].start + heap_free_large_regions[index-1].size == region) {
+		index -= 1;
+		heap_free_large_regions[index].size += region_size;
+	} else if (index < heap_free_large_region_count && region + region_size == heap_free_large_regions[index].start) {
+		heap_free_large_regions[index].start = region;
+		heap_free_large_regions[index].size += region_size;
+	} else if (heap_free_large_region_count < HEAP_MAX_FREE_LARGE_REGIONS) {
+		memmove(&heap_free_large_regions[index+1], &heap_free_large_regions[index], (heap_free_large_region_count-index)*sizeof(Heap_Large_Region));
+		heap_free_large_regions[index].start = region;
+		heap_free_large_regions[index].size = region_size;
+		heap_free_large_region_count += 1;
+	} else {
+		// Out of slots, so the address range is lost. The memory itself is still given back.
+		placed = false;
+	}
+	
+	// Might have closed the gap to the next one
+	if (placed && index+1 < heap_free_large_region_count) {
+		Heap_Large_Region *current = &heap_free_large_regions[index];
+		Heap_Large_Region *next = &heap_free_large_regions[index+1];
+		if (current->start + current->size == next->start) {
+			current->size += next->size;
+			heap_free_large_region_count -= 1;
+			memmove(next, next+1, (heap_free_large_region_count-(index+1))*sizeof(Heap_Large_Region));
+		}
+	}
+	
+	spinlock_release(&heap_large_lock);
+}
+
+
+void heap_large_dealloc(void *p) {
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p - sizeof(Heap_Allocation_Metadata));
+#if CONFIGURATION == DEBUG
+	assert(meta->signature == HEAP_META_SIGNATURE, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+#endif
+	assert(meta->size % os.page_size == 0, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+	
+	spinlock_acquire_or_wait(&heap_large_lock);
+	heap_large_stats_remove(meta->size);
+	spinlock_release(&heap_large_lock);
+	
+	heap_large_release_region(heap_large_get_region(meta), meta->size);
+}
+
+// Grows or shrinks a large allocation without moving it. Growing needs the address range right
+// after the region to be free, either a released large region or the end of reserved program memory.
+bool heap_large_try_resize(void *p, u64 size) {
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p - sizeof(Heap_Allocation_Metadata));
+	u8 *region = heap_large_get_region(meta);
+	u64 region_size = meta->size;
+	u64 new_region_size = align_next(size + (u64)((u8*)p - region), os.page_size);
+	
+	if (new_region_size == region_size) return true;
+	
+	if (new_region_size < region_size) {
+		spinlock_acquire_or_wait(&heap_large_lock);
+		heap_large_stats_remove(region_size);
+		heap_large_stats_add(new_region_size);
+		spinlock_release(&heap_large_lock);
+		meta->size = new_region_size;
+		heap_large_release_region(region + new_region_size, region_size - new_region_size);
+		return true;
+	}
+	
+	u8 *region_end = region + region_size;
+	u64 extra = new_region_size - region_size;
+	bool got_it = false;
+	
+	spinlock_acquire_or_wait(&heap_large_lock);
+	for (u64 i = 0; i < heap_free_large_region_count; i++) {
+		Heap_Large_Region *free_region = &heap_free_large_regions[i];
+		if (free_region->start != region_end) continue;
+		if (free_region->size < extra) break;
+		
+		if (free_region->size == extra) {
+			heap_free_large_region_count -= 1;
+			memmove(free_region, free_region+1, (heap_free_large_region_count-i)*sizeof(Heap_Large_Region));
+		} else {
+			free_region->start += extra;
+			free_region->size  -= extra;
+		}
+		got_it = true;
+		break;
+	}
+	spinlock_release(&heap_large_lock);
+	
+	if (got_it) {
+		bool ok = os_recommit_program_memory_pages(region_end, extra);
+		assert(ok, "Failed recommitting %d bytes for a large allocation. Out of memory?", extra);
+	} else {
+		// If we're the last thing in program memory we can just keep going
+		os_lock_mutex(program_memory_mutex); // #Sync
+		if (program_memory_next == region_end) {
+			os_reserve_next_memory_pages(extra);
+			got_it = true;
+		}
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		
+		if (!got_it) return false;
+		os_unlock_program_memory_pages(region_end, extra);
+	}
+	
+	spinlock_acquire_or_wait(&heap_large_lock);
+	heap_large_stats_remove(region_size);
+	heap_large_stats_add(new_region_size);
+	spinlock_release(&heap_large_lock);
+	meta->size = new_region_size;
+	return true;
+}
+// Usable size of a heap allocation, which may be more than was asked for.
+u64 heap_get_allocation_size(void *p) {
+	if (heap_is_slab_pointer(p)) {
+		Heap_Slab *slab = (Heap_Slab*)align_previous((u64)p, HEAP_SLAB_CHUNK_SIZE);
+		return slab->slot_size;
+	}
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(((u64)p)-sizeof(Heap_Allocation_Metadata));
+	if (heap_is_large_allocation(meta)) return (u64)(heap_large_get_region(meta) + meta->size - (u8*)p);
+	check_meta(meta);
+	return meta->size - sizeof(Heap_Allocation_Metadata);
+}
+
 void heap_init() {
 	if (heap_initted) return;
 	assert(HEAP_ALIGNMENT == 16);
@@ -247,11 +954,12 @@ void heap_init() {
 	heap_initted = true;
 	heap_head = make_heap_block(0, DEFAULT_HEAP_BLOCK_SIZE);
 	spinlock_init(&heap_lock);
+	heap_slabs_init();
+	spinlock_init(&heap_large_lock);
+	heap_free_large_region_count = 0;
 }
 
-void *heap_alloc(u64 size) {
-
-	if (!heap_initted) heap_init();
+void *heap_block_alloc(u64 size) {
 
 	// #Sync #Speed oof
 	spinlock_acquire_or_wait(&heap_lock);
@@ -264,19 +972,8 @@ void *heap_alloc(u64 size) {
 	
 	size = (size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
 	
-	assert(size < MAX_HEAP_BLOCK_SIZE, "Past Charlie has been lazy and did not handle large allocations like this. I apologize on behalf of past Charlie. A quick fix could be to increase the heap block size for now. #Incomplete #Limitation");
-	
+	assert(size < MAX_HEAP_BLOCK_SIZE, "Internal heap error: large allocations should not end up in a heap block");
 	
-#if VERY_DEBUG
-	{
-		Heap_Block *block = heap_head;
-		
-		while (block != 0) {
-			sanity_check_block(block);
-			block = block->next;
-		}
-	}
-#endif
 	
 	Heap_Block *block = heap_head;
 	Heap_Block *last_block = 0;
@@ -338,12 +1035,14 @@ void *heap_alloc(u64 size) {
 	if ((u8*)last_page_end > (u8*)first_page) {
 		os_unlock_program_memory_pages(first_page, (u64)last_page_end-(u64)first_page);
 	}
+	heap_block_recommit_free_pages(best_fit, best_fit->size, size);
 	
 	Heap_Free_Node *new_free_node = 0;
 	if (size != best_fit->size) {
 		u64 remainder = best_fit->size - size;
 		new_free_node = (Heap_Free_Node*)(((u8*)best_fit)+size);
 		new_free_node->size = remainder;
+		new_free_node->pages = best_fit->pages;
 		new_free_node->next = best_fit->next;
 		
 		// Lock remaining free node
@@ -377,16 +1076,15 @@ void *heap_alloc(u64 size) {
 	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)best_fit;
 	meta->size = size;
 	meta->block = best_fit_block;
+	heap_block_stats_add(size);
 #if CONFIGURATION == DEBUG
 	meta->signature = HEAP_META_SIGNATURE;
 	meta->block->total_allocated += size;
 #endif
 
 	check_meta(meta);
-
-#if VERY_DEBUG
-	sanity_check_block(meta->block);
-#endif
+	
+	heap_validate_sampled();
 	
 	// #Sync #Speed oof
 	spinlock_release(&heap_lock);
@@ -396,10 +1094,8 @@ void *heap_alloc(u64 size) {
 	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
 	return p;
 }
-void heap_dealloc(void *p) {
+void heap_block_dealloc(void *p) {
 	// #Sync #Speed oof
-	
-	if (!heap_initted) heap_init();
 
 	spinlock_acquire_or_wait(&heap_lock);
 	
@@ -411,17 +1107,13 @@ void heap_dealloc(void *p) {
 	// Yoink meta data before we start overwriting it
 	Heap_Block *block = meta->block;
 	u64 size = meta->size;
+	heap_block_stats_remove(size);
 	
-#if CONFIGURATION == DEBUG
-	memset(p, 0x69696969, size);
-#endif
-	
-	#if VERY_DEBUG
-		sanity_check_block(block);
-	#endif
+	heap_debug_fill_freed(p, size);
 	
 	Heap_Free_Node *new_node = cast(Heap_Free_Node*)p;
 	new_node->size = size;
+	new_node->pages = HEAP_FREE_PAGES_COMMITTED;
 	
 	if (new_node < block->free_head) {
 		// #Copypaste
@@ -434,6 +1126,7 @@ void heap_dealloc(void *p) {
 		
 		if ((u8*)new_node+size == (u8*)block->free_head) {
 			new_node->size = size + block->free_head->size;
+			new_node->pages = heap_merged_free_pages(new_node->pages, block->free_head->pages);
 			new_node->next = block->free_head->next;
 			block->free_head = new_node;
 		} else {
@@ -457,6 +1150,9 @@ void heap_dealloc(void *p) {
 			
 		} else {
 			Heap_Free_Node *node = block->free_head;
+			
+			// Keep the free nodes sorted by address: new_node goes after the last node before it
+			while (node->next && node->next < new_node) node = node->next;
 		
 			while (true) {
 			
@@ -490,6 +1186,15 @@ void heap_dealloc(void *p) {
 						}
 						
 						node->size += new_node_size;
+						// Freed memory is committed, and new_node might be locked by now
+						node->pages = heap_merged_free_pages(node->pages, HEAP_FREE_PAGES_COMMITTED);
+						
+						// Might have closed the gap to the next one
+						if (node->next && (u8*)node + node->size == (u8*)node->next) {
+							node->pages = heap_merged_free_pages(node->pages, node->next->pages);
+							node->size += node->next->size;
+							node->next = node->next->next;
+						}
 						
 						break;
 					} else {
@@ -498,6 +1203,7 @@ void heap_dealloc(void *p) {
 						
 						u8* new_node_tail = (u8*)new_node + new_node->size;
 						if (new_node->next && (u8*)new_node->next == new_node_tail) {
+							new_node->pages = heap_merged_free_pages(new_node->pages, new_node->next->pages);
 							new_node->size += new_node->next->size;
 							new_node->next = new_node->next->next;
 						}
@@ -524,56 +1230,997 @@ void heap_dealloc(void *p) {
 	block->total_allocated -= size;
 #endif
 
-#if VERY_DEBUG
-	sanity_check_block(block);
-#endif
+	heap_validate_sampled();
 	// #Sync #Speed oof
 	spinlock_release(&heap_lock);
 }
 
-void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	switch (message) {
-		case ALLOCATOR_ALLOCATE: {
-			return heap_alloc(size);
-			break;
-		}
-		case ALLOCATOR_DEALLOCATE: {
-			heap_dealloc(p);
-			return 0;
-		}
-		case ALLOCATOR_REALLOCATE: {
-			if (!p) {
-				return heap_alloc(size);
-			}
-			assert(is_pointer_valid(p), "Invalid pointer passed to heap allocator reallocate");
-			Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(((u64)p)-sizeof(Heap_Allocation_Metadata));
-			check_meta(meta);
-			void *new = heap_alloc(size);
-			memcpy(new, p, min(size, meta->size));
-			heap_dealloc(p);
-			return new;
-		}
-	}
-	return 0;
-}
-
-Allocator get_heap_allocator() {
-	Allocator heap_allocator;
+// Grows the allocation into the free node right after it, or gives back the tail when shrinking.
+// Returns false if there is no room to grow in place.
+bool heap_block_try_resize(void *p, u64 size) {
 	
-	heap_allocator.proc = heap_allocator_proc;
-	heap_allocator.data = 0;
+	size += sizeof(Heap_Allocation_Metadata);
+	size = (size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
 	
-	return heap_allocator;
-}
-
-///
-///
-// Temporary storage
-///
+	if (size >= MAX_HEAP_BLOCK_SIZE) return false;
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	check_meta(meta);
+	Heap_Block *block = meta->block;
+	
+	if (size <= meta->size) {
+		u64 remainder = meta->size - size;
+		if (remainder < sizeof(Heap_Allocation_Metadata)+HEAP_ALIGNMENT) {
+			spinlock_release(&heap_lock);
+			return true;
+		}
+		
+		// Make the tail look like its own allocation and free it, which merges it with whatever
+		// free node follows.
+		heap_block_stats_remove(meta->size);
+		heap_block_stats_add(size);
+		heap_block_stats_add(remainder);
+		meta->size = size;
+		Heap_Allocation_Metadata *tail = (Heap_Allocation_Metadata*)((u8*)meta + size);
+		tail->size = remainder;
+		tail->block = block;
+#if CONFIGURATION == DEBUG
+		tail->signature = HEAP_META_SIGNATURE;
+#endif
+		spinlock_release(&heap_lock);
+		
+		heap_block_dealloc((u8*)tail + sizeof(Heap_Allocation_Metadata));
+		return true;
+	}
+	
+	u8 *allocation_tail = (u8*)meta + meta->size;
+	u64 extra = size - meta->size;
+	
+	// Free nodes are sorted by address
+	Heap_Free_Node *node = block->free_head;
+	Heap_Free_Node *previous = 0;
+	while (node && (u8*)node < allocation_tail) {
+		previous = node;
+		node = node->next;
+	}
+	
+	if ((u8*)node != allocation_tail || node->size < extra) {
+		spinlock_release(&heap_lock);
+		return false;
+	}
+	
+	u64 node_size = node->size;
+	Heap_Free_Node *next = node->next;
+	
+	// #Copypaste
+	void *free_tail = (u8*)node + node_size;
+	void *first_page = (void*)align_previous(node, os.page_size);
+	void *last_page_end = (void*)align_previous(free_tail, os.page_size);
+	if ((u8*)last_page_end > (u8*)first_page) {
+		os_unlock_program_memory_pages(first_page, (u64)last_page_end-(u64)first_page);
+	}
+	heap_block_recommit_free_pages(node, node_size, extra);
+	
+	if (node_size != extra) {
+		Heap_Free_Node *new_free_node = (Heap_Free_Node*)((u8*)node + extra);
+		new_free_node->size = node_size - extra;
+		new_free_node->pages = node->pages;
+		new_free_node->next = next;
+		next = new_free_node;
+		
+		// Lock remaining free node
+		// #Copypaste
+		void *free_tail = (u8*)new_free_node + new_free_node->size;
+		void *next_page = (void*)align_next(new_free_node, os.page_size);
+		void *last_page_end = (void*)align_previous(free_tail, os.page_size);
+		if ((u8*)last_page_end > (u8*)next_page) {
+			os_lock_program_memory_pages(next_page, (u64)last_page_end-(u64)next_page);
+		}
+	}
+	
+	if (previous) previous->next = next;
+	else          block->free_head = next;
+	
+	heap_block_stats_remove(meta->size);
+	heap_block_stats_add(size);
+	meta->size = size;
+#if CONFIGURATION == DEBUG
+	block->total_allocated += extra;
+#endif
+
+	heap_validate_sampled();
+	
+	// #Sync #Speed oof
+	spinlock_release(&heap_lock);
+	
+	return true;
+}
+
+// Over-allocates, then gives back the unaligned head as its own allocation (the same trick as
+// shrinking in heap_block_try_resize) and trims the tail.
+void *heap_block_alloc_aligned(u64 size, u64 alignment) {
+	u64 min_head_size = sizeof(Heap_Allocation_Metadata)+HEAP_ALIGNMENT;
+	u8 *p = (u8*)heap_block_alloc(size + alignment + min_head_size);
+	
+	u8 *aligned = p;
+	if ((u64)p % alignment != 0) {
+		aligned = (u8*)align_next(p + min_head_size, alignment);
+		
+		// #Sync #Speed oof
+		spinlock_acquire_or_wait(&heap_lock);
+		
+		Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(p - sizeof(Heap_Allocation_Metadata));
+		Heap_Allocation_Metadata *aligned_meta = (Heap_Allocation_Metadata*)(aligned - sizeof(Heap_Allocation_Metadata));
+		u64 head_size = (u64)(aligned - p);
+		
+		heap_block_stats_remove(meta->size);
+		heap_block_stats_add(meta->size - head_size);
+		heap_block_stats_add(head_size);
+		aligned_meta->size = meta->size - head_size;
+		aligned_meta->block = meta->block;
+#if CONFIGURATION == DEBUG
+		aligned_meta->signature = HEAP_META_SIGNATURE;
+#endif
+		meta->size = head_size;
+		
+		spinlock_release(&heap_lock);
+		
+		heap_block_dealloc(p);
+	}
+	
+	heap_block_try_resize(aligned, size);
+	return aligned;
+}
+
+///
+///
+// Allocation tracking
+///
+// With ENABLE_ALLOCATION_TRACKING, every live heap allocation is recorded in a side table
+// (pointer -> tag & size) so Heap_Allocation_Metadata stays the same either way.
+// The tag is the innermost push_allocation_tag() on the thread, or else the file:line of the
+// alloc() call. Containers allocate for you, so their allocations show up with their own
+// file:line unless you push a tag.
+// Tags are grouped by pointer, so use string literals.
+//
+// Usage:
+//
+//	push_allocation_tag("audio");
+//	...
+//	pop_allocation_tag();
+//
+//	Allocation_Snapshot before = allocation_tracking_snapshot(get_heap_allocator());
+//	...
+//	Allocation_Snapshot after = allocation_tracking_snapshot(get_heap_allocator());
+//	allocation_tracking_log_diff(before, after);
+//	allocation_tracking_log_live(); // Everything live right now, grouped by tag
+
+#define ALLOCATION_TRACKING_MAX_TAGS 4096
+#define ALLOCATION_TAG_STACK_MAX 32
+
+typedef struct Allocation_Tag_Stats {
+	const char *tag;
+	u64 count;
+	u64 bytes;
+} Allocation_Tag_Stats;
+
+typedef struct Allocation_Snapshot {
+	Allocation_Tag_Stats *tags; // Sorted by bytes, biggest first
+	u64 tag_count;
+	Allocator allocator;
+} Allocation_Snapshot;
+
+typedef struct Allocation_Record {
+	void *p; // 0 if empty
+	u64 size;
+	u32 tag;
+	u32 padding;
+} Allocation_Record;
+
+// #Global
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+thread_local const char *allocation_tag_stack[ALLOCATION_TAG_STACK_MAX];
+thread_local u64 allocation_tag_stack_count = 0;
+#endif
+#if ENABLE_ALLOCATION_TRACKING
+Spinlock allocation_tracking_lock;
+// Open addressing, linear probing
+Allocation_Record *allocation_records = 0;
+u64 allocation_record_capacity = 0;
+u64 allocation_record_count = 0;
+const char *allocation_tags[ALLOCATION_TRACKING_MAX_TAGS];
+u32 allocation_tag_lookup[ALLOCATION_TRACKING_MAX_TAGS*2]; // Tag index+1, 0 if empty
+u32 allocation_tag_count = 0;
+#endif
+
+ogb_instance void
+push_allocation_tag(const char *tag);
+ogb_instance void
+pop_allocation_tag();
+
+// Live allocations grouped by tag, in memory from allocator
+ogb_instance Allocation_Snapshot
+allocation_tracking_snapshot(Allocator allocator);
+ogb_instance void
+allocation_tracking_free_snapshot(Allocation_Snapshot snapshot);
+// Logs the tags whose allocations changed from before to after
+ogb_instance void
+allocation_tracking_log_diff(Allocation_Snapshot before, Allocation_Snapshot after);
+ogb_instance void
+allocation_tracking_log_live();
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+void push_allocation_tag(const char *tag) {
+	assert(allocation_tag_stack_count < ALLOCATION_TAG_STACK_MAX, "Allocation tag stack overflow");
+	allocation_tag_stack[allocation_tag_stack_count] = tag;
+	allocation_tag_stack_count += 1;
+}
+void pop_allocation_tag() {
+	assert(allocation_tag_stack_count > 0, "No allocation tags to pop!");
+	allocation_tag_stack_count -= 1;
+}
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+#if ENABLE_ALLOCATION_TRACKING
+
+inline u64 allocation_record_home(void *p, u64 capacity) {
+	return (((u64)p >> 4) * 0x9E3779B97F4A7C15ULL) & (capacity-1);
+}
+
+// Must hold allocation_tracking_lock
+u32 allocation_tracking_intern_tag(const char *tag) {
+	u64 mask = ALLOCATION_TRACKING_MAX_TAGS*2-1;
+	u64 i = ((u64)tag * 0x9E3779B97F4A7C15ULL) >> 40 & mask;
+	while (allocation_tag_lookup[i]) {
+		u32 index = allocation_tag_lookup[i]-1;
+		if (allocation_tags[index] == tag) return index;
+		i = (i+1) & mask;
+	}
+	// Out of tags, lump the rest together
+	if (allocation_tag_count >= ALLOCATION_TRACKING_MAX_TAGS-1) {
+		allocation_tags[ALLOCATION_TRACKING_MAX_TAGS-1] = "(too many tags)";
+		allocation_tag_count = ALLOCATION_TRACKING_MAX_TAGS;
+		return ALLOCATION_TRACKING_MAX_TAGS-1;
+	}
+	allocation_tags[allocation_tag_count] = tag;
+	allocation_tag_lookup[i] = allocation_tag_count+1;
+	allocation_tag_count += 1;
+	return allocation_tag_count-1;
+}
+
+// Must hold allocation_tracking_lock
+Allocation_Record *allocation_tracking_find(void *p) {
+	if (!allocation_records) return 0;
+	u64 i = allocation_record_home(p, allocation_record_capacity);
+	while (allocation_records[i].p) {
+		if (allocation_records[i].p == p) return &allocation_records[i];
+		i = (i+1) & (allocation_record_capacity-1);
+	}
+	return 0;
+}
+
+// Must hold allocation_tracking_lock
+void allocation_tracking_insert(Allocation_Record record) {
+	u64 i = allocation_record_home(record.p, allocation_record_capacity);
+	while (allocation_records[i].p) i = (i+1) & (allocation_record_capacity-1);
+	allocation_records[i] = record;
+	allocation_record_count += 1;
+}
+
+// Must hold allocation_tracking_lock
+void allocation_tracking_grow() {
+	// Not from the heap, we're tracking the heap
+	Allocation_Record *old_records = allocation_records;
+	u64 old_capacity = allocation_record_capacity;
+	
+	allocation_record_capacity = old_capacity ? old_capacity*2 : 4096;
+	u64 region_size = align_next(allocation_record_capacity*sizeof(Allocation_Record), os.page_size);
+	allocation_records = (Allocation_Record*)heap_large_reserve_region(region_size);
+	bool ok = os_recommit_program_memory_pages(allocation_records, region_size);
+	assert(ok, "Failed committing memory for allocation tracking. Out of memory?");
+	
+	allocation_record_count = 0;
+	for (u64 i = 0; i < old_capacity; i++) {
+		if (old_records[i].p) allocation_tracking_insert(old_records[i]);
+	}
+	if (old_records) {
+		heap_large_release_region((u8*)old_records, align_next(old_capacity*sizeof(Allocation_Record), os.page_size));
+	}
+}
+
+void allocation_tracking_add(void *p, u64 size) {
+	const char *tag;
+	if (allocation_tag_stack_count) tag = allocation_tag_stack[allocation_tag_stack_count-1];
+	else if (allocation_location)   tag = allocation_location;
+	else                            tag = "(untagged)";
+	allocation_location = 0;
+	
+	spinlock_acquire_or_wait(&allocation_tracking_lock);
+	if ((allocation_record_count+1)*4 > allocation_record_capacity*3) allocation_tracking_grow();
+	
+	Allocation_Record record = ZERO(Allocation_Record);
+	record.p = p;
+	record.size = size;
+	record.tag = allocation_tracking_intern_tag(tag);
+	allocation_tracking_insert(record);
+	spinlock_release(&allocation_tracking_lock);
+}
+
+void allocation_tracking_remove(void *p) {
+	spinlock_acquire_or_wait(&allocation_tracking_lock);
+	Allocation_Record *record = allocation_tracking_find(p);
+	assert(record, "Internal error: a heap allocation was not in the allocation tracking table");
+	
+	// Shift back following records that would no longer be found past the hole
+	u64 mask = allocation_record_capacity-1;
+	u64 hole = (u64)(record - allocation_records);
+	u64 i = hole;
+	while (true) {
+		i = (i+1) & mask;
+		if (!allocation_records[i].p) break;
+		u64 home = allocation_record_home(allocation_records[i].p, allocation_record_capacity);
+		bool home_in_range = hole <= i ? (home > hole && home <= i) : (home > hole || home <= i);
+		if (!home_in_range) {
+			allocation_records[hole] = allocation_records[i];
+			hole = i;
+		}
+	}
+	allocation_records[hole].p = 0;
+	allocation_record_count -= 1;
+	spinlock_release(&allocation_tracking_lock);
+}
+
+// When reallocate moved, new_p is already tracked. It gets old_p's tag and heap_dealloc removes old_p.
+void allocation_tracking_resize(void *old_p, void *new_p, u64 size) {
+	spinlock_acquire_or_wait(&allocation_tracking_lock);
+	Allocation_Record *old_record = allocation_tracking_find(old_p);
+	Allocation_Record *new_record = allocation_tracking_find(new_p);
+	assert(old_record && new_record, "Internal error: a heap allocation was not in the allocation tracking table");
+	new_record->tag = old_record->tag;
+	new_record->size = size;
+	spinlock_release(&allocation_tracking_lock);
+	allocation_location = 0;
+}
+
+#endif // ENABLE_ALLOCATION_TRACKING
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Allocation_Snapshot allocation_tracking_snapshot(Allocator allocator) {
+	Allocation_Snapshot snapshot = ZERO(Allocation_Snapshot);
+	snapshot.allocator = allocator;
+#if ENABLE_ALLOCATION_TRACKING
+	// Allocate first, the lock can't be held while we allocate from the heap.
+	// Some slack in case tags are added in the meantime.
+	u64 tag_capacity = min(allocation_tag_count+64, ALLOCATION_TRACKING_MAX_TAGS);
+	snapshot.tags = (Allocation_Tag_Stats*)alloc(allocator, tag_capacity*sizeof(Allocation_Tag_Stats));
+	
+	spinlock_acquire_or_wait(&allocation_tracking_lock);
+	snapshot.tag_count = min(allocation_tag_count, tag_capacity);
+	for (u64 i = 0; i < snapshot.tag_count; i++) {
+		snapshot.tags[i].tag = allocation_tags[i];
+		snapshot.tags[i].count = 0;
+		snapshot.tags[i].bytes = 0;
+	}
+	for (u64 i = 0; i < allocation_record_capacity; i++) {
+		Allocation_Record *record = &allocation_records[i];
+		if (!record->p || record->tag >= snapshot.tag_count) continue;
+		snapshot.tags[record->tag].count += 1;
+		snapshot.tags[record->tag].bytes += record->size;
+	}
+	spinlock_release(&allocation_tracking_lock);
+	
+	// Biggest first, insertion sort is fine for the number of tags we have
+	for (u64 i = 1; i < snapshot.tag_count; i++) {
+		Allocation_Tag_Stats stats = snapshot.tags[i];
+		u64 j = i;
+		while (j > 0 && snapshot.tags[j-1].bytes < stats.bytes) {
+			snapshot.tags[j] = snapshot.tags[j-1];
+			j -= 1;
+		}
+		snapshot.tags[j] = stats;
+	}
+#endif
+	return snapshot;
+}
+
+void allocation_tracking_free_snapshot(Allocation_Snapshot snapshot) {
+	if (snapshot.tags) dealloc(snapshot.allocator, snapshot.tags);
+}
+
+void allocation_tracking_log_diff(Allocation_Snapshot before, Allocation_Snapshot after) {
+#if ENABLE_ALLOCATION_TRACKING
+	log_info("Allocation changes by tag:");
+	for (u64 i = 0; i < after.tag_count; i++) {
+		Allocation_Tag_Stats *now = &after.tags[i];
+		Allocation_Tag_Stats then = ZERO(Allocation_Tag_Stats);
+		for (u64 j = 0; j < before.tag_count; j++) {
+			if (before.tags[j].tag == now->tag) { then = before.tags[j]; break; }
+		}
+		if (now->bytes == then.bytes && now->count == then.count) continue;
+		log_info("\t%cs: %lld bytes in %lld allocations (now %llu bytes in %llu)", now->tag, (s64)now->bytes-(s64)then.bytes, (s64)now->count-(s64)then.count, now->bytes, now->count);
+	}
+#else
+	log_warning("allocation_tracking_log_diff: ENABLE_ALLOCATION_TRACKING is off");
+#endif
+}
+
+void allocation_tracking_log_live() {
+#if ENABLE_ALLOCATION_TRACKING
+	Allocation_Snapshot snapshot = allocation_tracking_snapshot(get_heap_allocator());
+	log_info("Live allocations by tag:");
+	for (u64 i = 0; i < snapshot.tag_count; i++) {
+		Allocation_Tag_Stats *stats = &snapshot.tags[i];
+		if (!stats->count) continue;
+		log_info("\t%cs: %llu bytes in %llu allocations", stats->tag, stats->bytes, stats->count);
+	}
+	allocation_tracking_free_snapshot(snapshot);
+#else
+	log_warning("allocation_tracking_log_live: ENABLE_ALLOCATION_TRACKING is off");
+#endif
+}
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+void *heap_alloc(u64 size) {
+	if (!heap_initted) heap_init();
+	
+	void *p;
+	if      (size <= HEAP_SLAB_MAX_SIZE)               p = heap_slab_alloc(size);
+	else if (size >= HEAP_LARGE_ALLOCATION_THRESHOLD)  p = heap_large_alloc(size);
+	else                                               p = heap_block_alloc(size);
+	
+#if ENABLE_ALLOCATION_TRACKING
+	allocation_tracking_add(p, size);
+#endif
+	return p;
+}
+void heap_dealloc(void *p) {
+	if (!heap_initted) heap_init();
+	
+	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!"); 
+	
+#if ENABLE_ALLOCATION_TRACKING
+	allocation_tracking_remove(p);
+#endif
+	
+	if (heap_is_slab_pointer(p)) {
+		heap_slab_dealloc(p);
+	} else if (heap_is_large_allocation((Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata)))) {
+		heap_large_dealloc(p);
+	} else {
+		heap_block_dealloc(p);
+	}
+}
+
+// Large allocations can skip the memset when the OS zeroed their pages for us
+void *heap_alloc_zeroed(u64 size) {
+	if (size < HEAP_LARGE_ALLOCATION_THRESHOLD) {
+		void *p = heap_alloc(size);
+		memset(p, 0, size);
+		return p;
+	}
+	if (!heap_initted) heap_init();
+	
+	bool pages_zeroed;
+	void *p = heap_large_alloc_pages(size, HEAP_ALIGNMENT, &pages_zeroed);
+#if ENABLE_ALLOCATION_TRACKING
+	allocation_tracking_add(p, size);
+#endif
+	if (!pages_zeroed) memset(p, 0, size);
+	return p;
+}
+
+// Alignment must be a power of two and at most os.page_size
+void *heap_alloc_aligned(u64 size, u64 alignment) {
+	if (alignment <= HEAP_ALIGNMENT) return heap_alloc(size);
+	if (!heap_initted) heap_init();
+	
+	assert(alignment <= os.page_size, "The heap can't align to more than a page (%llu bytes), got %llu", os.page_size, alignment);
+	
+	void *p;
+	if      (size <= HEAP_SLAB_MAX_SIZE && alignment <= HEAP_SLAB_MAX_ALIGNMENT) p = heap_slab_alloc_aligned(size, alignment);
+	else if (size >= HEAP_LARGE_ALLOCATION_THRESHOLD)                            p = heap_large_alloc_aligned(size, alignment);
+	else                                                                         p = heap_block_alloc_aligned(size, alignment);
+	
+#if ENABLE_ALLOCATION_TRACKING
+	allocation_tracking_add(p, size);
+#endif
+	return p;
+}
+
+// Resizes without moving if the allocation has room to grow where it is, otherwise moves it.
+void *heap_realloc(void *p, u64 size) {
+	if (!p) return heap_alloc(size);
+	
+	assert(is_pointer_in_program_memory(p), "A bad pointer was passed to heap_realloc: it is out of program memory bounds!");
+	
+	bool resized;
+	u64 old_size;
+	if (heap_is_slab_pointer(p)) {
+		Heap_Slab *slab = (Heap_Slab*)align_previous((u64)p, HEAP_SLAB_CHUNK_SIZE);
+		old_size = slab->slot_size;
+		resized = size <= old_size;
+	} else {
+		Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+		old_size = heap_get_allocation_size(p);
+		if (heap_is_large_allocation(meta)) resized = heap_large_try_resize(p, size);
+		else                                 resized = heap_block_try_resize(p, size);
+	}
+	if (resized) {
+#if ENABLE_ALLOCATION_TRACKING
+		allocation_tracking_resize(p, p, size);
+#endif
+		return p;
+	}
+	
+	void *new = heap_alloc(size);
+	memcpy(new, p, min(size, old_size));
+#if ENABLE_ALLOCATION_TRACKING
+	allocation_tracking_resize(p, new, size);
+#endif
+	heap_dealloc(p);
+	return new;
+}
+
+void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			return heap_alloc(size);
+			break;
+		}
+		case ALLOCATOR_ALLOCATE_ZEROED: {
+			return heap_alloc_zeroed(size);
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			return heap_alloc_aligned(size, (u64)p);
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			heap_dealloc(p);
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			return heap_realloc(p, size);
+		}
+	}
+	return 0;
+}
+
+Allocator get_heap_allocator() {
+	Allocator heap_allocator;
+	
+	heap_allocator.proc = heap_allocator_proc;
+	heap_allocator.data = 0;
+	
+	return heap_allocator;
+}
+
+///
+///
+// Heap stats
+///
+// Counters are kept as we go, so this is cheap enough to call every frame. The only walk is over
+// the free list heap's free nodes (for the node count and largest free block), which stays short
+// since small allocations never go there.
+// Slab counts of other threads are read without synchronization, and slots freed from another
+// thread count as allocated until the owning thread picks them up.
+
+typedef struct Heap_Stats {
+	u64 committed_bytes;    // Memory the heap holds from the OS
+	u64 allocated_bytes;    // Handed out, including metadata and rounding up to size classes/pages
+	u64 free_bytes;         // Committed but not handed out
+	u64 free_node_count;    // Free list heap only
+	u64 largest_free_block; // Biggest allocation the free list heap can serve without growing
+	u64 allocation_count;
+	// Live allocations by size: [0] is <= 16 bytes, [1] <= 32 bytes and so on, twice as big each time.
+	u64 live_allocations_by_size[HEAP_STATS_SIZE_BUCKET_COUNT];
+} Heap_Stats;
+
+Heap_Stats heap_get_stats() {
+	Heap_Stats stats = ZERO(Heap_Stats);
+	if (!heap_initted) return stats;
+	
+	// Free list heap
+	spinlock_acquire_or_wait(&heap_lock);
+	stats.committed_bytes += heap_block_committed - heap_block_decommitted;
+	stats.allocated_bytes += heap_block_allocated;
+	for (u64 i = 0; i < HEAP_STATS_SIZE_BUCKET_COUNT; i++) {
+		stats.live_allocations_by_size[i] += heap_block_live_counts[i];
+	}
+	for (Heap_Block *block = heap_head; block; block = block->next) {
+		stats.allocated_bytes += sizeof(Heap_Block);
+		for (Heap_Free_Node *node = block->free_head; node; node = node->next) {
+			stats.free_node_count += 1;
+			if (node->size > stats.largest_free_block) stats.largest_free_block = node->size;
+		}
+	}
+	spinlock_release(&heap_lock);
+	if (stats.largest_free_block > sizeof(Heap_Allocation_Metadata)) {
+		stats.largest_free_block -= sizeof(Heap_Allocation_Metadata);
+	} else {
+		stats.largest_free_block = 0;
+	}
+	
+	// Slabs
+	spinlock_acquire_or_wait(&heap_slab_lock);
+	stats.committed_bytes += heap_slab_committed;
+	for (Heap_Thread_Cache *cache = heap_all_thread_caches; cache; cache = cache->next_cache) {
+		for (u64 i = 0; i < HEAP_SLAB_CLASS_COUNT; i++) {
+			u64 count = cache->live_counts[i];
+			stats.allocated_bytes += count*heap_slab_class_sizes[i];
+			stats.live_allocations_by_size[heap_stats_get_size_bucket(heap_slab_class_sizes[i])] += count;
+		}
+	}
+	spinlock_release(&heap_slab_lock);
+	
+	// Large allocations
+	spinlock_acquire_or_wait(&heap_large_lock);
+	stats.committed_bytes += heap_large_allocated;
+	stats.allocated_bytes += heap_large_allocated;
+	for (u64 i = 0; i < HEAP_STATS_SIZE_BUCKET_COUNT; i++) {
+		stats.live_allocations_by_size[i] += heap_large_live_counts[i];
+	}
+	spinlock_release(&heap_large_lock);
+	
+	for (u64 i = 0; i < HEAP_STATS_SIZE_BUCKET_COUNT; i++) {
+		stats.allocation_count += stats.live_allocations_by_size[i];
+	}
+	stats.free_bytes = stats.committed_bytes > stats.allocated_bytes ? stats.committed_bytes - stats.allocated_bytes : 0;
+	
+	return stats;
+}
+
+#if ENABLE_PROFILING
+// Called once per frame by os_update
+void heap_report_stats_to_profiler() {
+	Heap_Stats stats = heap_get_stats();
+	tm_counter("heap committed bytes", stats.committed_bytes);
+	tm_counter("heap allocated bytes", stats.allocated_bytes);
+	tm_counter("heap free bytes", stats.free_bytes);
+	tm_counter("heap free nodes", stats.free_node_count);
+	tm_counter("heap largest free block", stats.largest_free_block);
+	tm_counter("heap allocation count", stats.allocation_count);
+	
+	spinlock_report_stats_to_profiler(&heap_lock, STR("heap lock"));
+	spinlock_report_stats_to_profiler(&heap_slab_lock, STR("heap slab lock"));
+	spinlock_report_stats_to_profiler(&heap_large_lock, STR("heap large lock"));
+}
+#endif // ENABLE_PROFILING
+
+///
+///
+// Heap trimming
+///
+// Freed memory in the free list heap and empty slab chunks stays committed, so after a big load
+// and unload the process would keep its peak memory forever. heap_trim() decommits every whole
+// free page, and they're recommitted when they're handed out again.
+// Large allocations don't need this, they give their pages back as soon as they're freed.
+// With HEAP_AUTO_TRIM_THRESHOLD, os_update() calls heap_trim() when the free list heap has more
+// than that much free memory that hasn't been given back.
+// Does nothing with large pages on windows, MEM_LARGE_PAGES can't be decommitted.
+
+ogb_instance void
+heap_trim();
+
+// Called from os_update()
+ogb_instance void
+heap_trim_if_needed();
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+void heap_trim() {
+	if (!heap_initted) return;
+#if TARGET_OS == WINDOWS
+	if (os.large_page_size) return;
+#endif
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	u64 decommitted = 0;
+	for (Heap_Block *block = heap_head; block; block = block->next) {
+		for (Heap_Free_Node *node = block->free_head; node; node = node->next) {
+			// Same pages heap_block_recommit_free_pages() expects
+			u8 *first_page = (u8*)align_next((u8*)node + sizeof(Heap_Free_Node), os.page_size);
+			u8 *last_page_end = (u8*)align_previous((u8*)node + node->size, os.page_size);
+			if (last_page_end <= first_page) continue;
+			
+			if (node->pages != HEAP_FREE_PAGES_DECOMMITTED) {
+				os_decommit_program_memory_pages(first_page, (u64)(last_page_end-first_page));
+				node->pages = HEAP_FREE_PAGES_DECOMMITTED;
+			}
+			decommitted += (u64)(last_page_end-first_page);
+		}
+	}
+	// Every free page is decommitted now, so this is exact until the next allocation
+	heap_block_decommitted = decommitted;
+	spinlock_release(&heap_lock);
+	
+	spinlock_acquire_or_wait(&heap_slab_lock);
+	for (Heap_Slab *slab = heap_slab_empty_chunks; slab; slab = slab->next) {
+		if (slab->decommitted) continue;
+		os_decommit_program_memory_pages((u8*)slab + os.page_size, HEAP_SLAB_CHUNK_SIZE - os.page_size);
+		slab->decommitted = true;
+		heap_slab_committed -= HEAP_SLAB_CHUNK_SIZE - os.page_size;
+	}
+	spinlock_release(&heap_slab_lock);
+}
+
+void heap_trim_if_needed() {
+#if HEAP_AUTO_TRIM_THRESHOLD > 0
+	if (!heap_initted) return;
+	
+	// Racy read, but it's only a heuristic
+	u64 not_free = heap_block_allocated + heap_block_decommitted;
+	u64 free_committed = heap_block_committed > not_free ? heap_block_committed - not_free : 0;
+	if (free_committed > HEAP_AUTO_TRIM_THRESHOLD) heap_trim();
+#endif
+}
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+///
+///
+// Arenas
+///
+// An arena reserves an address range up front and commits pages as the bump pointer reaches them,
+// so it grows without ever moving. Freeing single allocations is a no-op. Instead you take an
+// arena_checkpoint() and arena_rewind() back to it, or arena_reset() the whole thing.
+// Arenas are not thread safe.
+//
+// Usage:
+//
+//	Arena *level_arena = make_arena(GB(1));
+//	Allocator level_allocator = get_arena_allocator(level_arena);
+//	...
+//	Arena_Checkpoint checkpoint = arena_checkpoint(level_arena);
+//	void *scratch = arena_alloc(level_arena, 1024);
+//	arena_rewind(checkpoint);
+//	...
+//	arena_release(level_arena);
+
+#ifndef ARENA_ALIGNMENT
+	#define ARENA_ALIGNMENT 16
+#endif
+#ifndef ARENA_COMMIT_SIZE
+	#define ARENA_COMMIT_SIZE KB(64)
+#endif
+
+typedef struct Arena {
+	u8 *start;
+	u8 *next;
+	u8 *committed_end; // Memory between next and committed_end is ready to use
+	u8 *end;
+	u8 *last_allocation; // So we can grow the last allocation in place
+	u8 *dirty_end; // Nothing from here on was handed out yet, so it's still zero from the OS
+	bool owns_memory;
+} Arena;
+
+typedef struct Arena_Checkpoint {
+	Arena *arena;
+	u8 *next;
+} Arena_Checkpoint;
+
+ogb_instance Arena*
+make_arena(u64 reserve_size);
+
+// Arena in memory you own. It can't grow past size and the Arena itself lives at the start of p.
+ogb_instance Arena*
+make_arena_with_memory(u64 size, void *p);
+
+ogb_instance void
+arena_release(Arena *arena);
+
+ogb_instance void*
+arena_alloc_aligned(Arena *arena, u64 size, u64 alignment);
+
+ogb_instance void*
+arena_alloc(Arena *arena, u64 size);
+
+// Only zeroes what was handed out before, pages fresh from the OS are zero already
+ogb_instance void*
+arena_alloc_zeroed(Arena *arena, u64 size);
+
+ogb_instance Arena_Checkpoint
+arena_checkpoint(Arena *arena);
+
+// Everything allocated after the checkpoint is freed. Pages stay committed for reuse.
+ogb_instance void
+arena_rewind(Arena_Checkpoint checkpoint);
+
+ogb_instance void
+arena_reset(Arena *arena);
+
+ogb_instance u64
+arena_get_used_size(Arena *arena);
+
+ogb_instance void*
+arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
+
+ogb_instance Allocator
+get_arena_allocator(Arena *arena);
+
+ogb_instance Allocator
+make_arena_allocator(u64 reserve_size);
+
+ogb_instance Allocator
+make_arena_allocator_with_memory(u64 size, void *p);
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+Arena *make_arena(u64 reserve_size) {
+	u64 region_size = align_next(reserve_size + sizeof(Arena), os.page_size);
+	u8 *region = heap_large_reserve_region(region_size);
+	
+	u64 first_commit = align_next(sizeof(Arena), ARENA_COMMIT_SIZE);
+	first_commit = min(align_next(first_commit, os.page_size), region_size);
+	bool ok = os_recommit_program_memory_pages(region, first_commit);
+	assert(ok, "Failed committing memory for arena. Out of memory?");
+	
+	Arena *arena = (Arena*)region;
+	arena->start = (u8*)align_next((u64)(region + sizeof(Arena)), ARENA_ALIGNMENT);
+	arena->next = arena->start;
+	arena->committed_end = region + first_commit;
+	arena->end = region + region_size;
+	arena->last_allocation = 0;
+	arena->dirty_end = arena->start;
+	arena->owns_memory = true;
+	
+	return arena;
+}
+
+Arena *make_arena_with_memory(u64 size, void *p) {
+	assert(size > sizeof(Arena), "Arena memory is too small to even fit the Arena");
+	
+	Arena *arena = (Arena*)p;
+	arena->start = (u8*)align_next((u64)((u8*)p + sizeof(Arena)), ARENA_ALIGNMENT);
+	arena->next = arena->start;
+	arena->committed_end = (u8*)p + size;
+	arena->end = arena->committed_end;
+	arena->last_allocation = 0;
+	arena->dirty_end = arena->end; // Can't know what's in memory we didn't commit
+	arena->owns_memory = false;
+	
+	return arena;
+}
+
+void arena_release(Arena *arena) {
+	if (!arena->owns_memory) return;
+	
+	heap_large_release_region((u8*)arena, (u64)(arena->end - (u8*)arena));
+}
+
+// Makes sure everything up to new_next is committed
+bool arena_commit_to(Arena *arena, u8 *new_next) {
+	if (new_next <= arena->committed_end) return true;
+	if (new_next > arena->end) return false;
+	
+	u8 *new_committed_end = (u8*)align_next((u64)new_next, ARENA_COMMIT_SIZE);
+	new_committed_end = (u8*)align_next((u64)new_committed_end, os.page_size);
+	if (new_committed_end > arena->end) new_committed_end = arena->end;
+	
+	bool ok = os_recommit_program_memory_pages(arena->committed_end, (u64)(new_committed_end - arena->committed_end));
+	if (!ok) return false;
+	
+	arena->committed_end = new_committed_end;
+	return true;
+}
+
+void *arena_alloc_aligned(Arena *arena, u64 size, u64 alignment) {
+	assert(alignment && (alignment & (alignment-1)) == 0, "Arena alignment must be a power of two, got %llu", alignment);
+	
+	u8 *p = (u8*)align_next((u64)arena->next, alignment);
+	u8 *new_next = p + size;
+	
+	bool ok = arena_commit_to(arena, new_next);
+	assert(ok, "Arena is out of memory. Tried allocating %llu bytes with %llu bytes left of what was reserved.", size, (u64)(arena->end - arena->next));
+	
+	arena->next = new_next;
+	arena->last_allocation = p;
+	if (new_next > arena->dirty_end) arena->dirty_end = new_next;
+	
+	return p;
+}
+
+void *arena_alloc(Arena *arena, u64 size) {
+	return arena_alloc_aligned(arena, size, ARENA_ALIGNMENT);
+}
+
+void *arena_alloc_zeroed(Arena *arena, u64 size) {
+	u8 *dirty_end = arena->dirty_end;
+	u8 *p = (u8*)arena_alloc(arena, size);
+	if (p < dirty_end) memset(p, 0, min(size, (u64)(dirty_end-p)));
+	return p;
+}
+
+Arena_Checkpoint arena_checkpoint(Arena *arena) {
+	Arena_Checkpoint checkpoint;
+	checkpoint.arena = arena;
+	checkpoint.next = arena->next;
+	return checkpoint;
+}
+
+void arena_rewind(Arena_Checkpoint checkpoint) {
+	Arena *arena = checkpoint.arena;
+	assert(checkpoint.next >= arena->start && checkpoint.next <= arena->next, "Bad arena checkpoint. Did you rewind past it already?");
+	
+	arena->next = checkpoint.next;
+	arena->last_allocation = 0;
+}
+
+void arena_reset(Arena *arena) {
+	arena->next = arena->start;
+	arena->last_allocation = 0;
+}
+
+u64 arena_get_used_size(Arena *arena) {
+	return (u64)(arena->next - arena->start);
+}
+
+void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	Arena *arena = (Arena*)data;
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			return arena_alloc(arena, size);
+		}
+		case ALLOCATOR_ALLOCATE_ZEROED: {
+			return arena_alloc_zeroed(arena, size);
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			return arena_alloc_aligned(arena, size, (u64)p);
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			// The last allocation can just move the bump pointer
+			if (p && p == arena->last_allocation && arena_commit_to(arena, (u8*)p + size)) {
+				arena->next = (u8*)p + size;
+				if (arena->next > arena->dirty_end) arena->dirty_end = arena->next;
+				return p;
+			}
+			// Can't resize, reallocate() falls back to alloc + copy
+			return 0;
+		}
+	}
+	return 0;
+}
+
+Allocator get_arena_allocator(Arena *arena) {
+	Allocator allocator;
+	allocator.data = arena;
+	allocator.proc = arena_allocator_proc;
+	return allocator;
+}
+
+Allocator make_arena_allocator(u64 reserve_size) {
+	return get_arena_allocator(make_arena(reserve_size));
+}
+Allocator make_arena_allocator_with_memory(u64 size, void *p) {
+	return get_arena_allocator(make_arena_with_memory(size, p));
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+
+///
+///
+// Temporary storage
+///
+// Every thread has its own temporary storage, an arena that grows on demand. If a bigger
+// allocation than what's reserved comes along, another (at least twice as big) arena is chained
+// on. reset_temporary_storage() frees everything, and folds the chain into one arena so the
+// next frame fits without chaining.
+// temp_scope_begin()/temp_scope_end() only free what was allocated in between, and nest.
 
 #ifndef TEMPORARY_STORAGE_SIZE
-	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb
+	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb, reserved, committed as it's used
 #endif
+#define TEMPORARY_STORAGE_MAX_CHAIN 32
+
+typedef struct Temp_Scope {
+	u64 chain_index;
+	Arena_Checkpoint checkpoint;
+	u64 used_before;
+} Temp_Scope;
 
 ogb_instance void* talloc(u64);
 ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
@@ -583,9 +2230,12 @@ ogb_instance Allocator
 get_temporary_allocator();
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-thread_local void * temporary_storage = 0;
-thread_local void * temporary_storage_pointer = 0;
-thread_local bool   has_warned_temporary_storage_overflow = false;
+thread_local Arena *temporary_storage = 0;
+thread_local Arena *temporary_storage_chain[TEMPORARY_STORAGE_MAX_CHAIN];
+thread_local u64    temporary_storage_chain_count = 0;
+thread_local u64    temporary_storage_chain_index = 0;
+thread_local u64    temporary_storage_used_before = 0; // By the arenas before chain_index
+thread_local u64    temporary_storage_high_water_mark = 0;
 thread_local Allocator temp_allocator;
 
 ogb_instance Allocator 
@@ -601,12 +2251,32 @@ temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
 ogb_instance void 
 temporary_storage_init(u64 arena_size);
 
+// Called by the os layer when a thread exits
+ogb_instance void 
+temporary_storage_release();
+
 ogb_instance void* 
 talloc(u64 size);
 
+ogb_instance void* 
+talloc_zeroed(u64 size);
+
+ogb_instance void* 
+talloc_aligned(u64 size, u64 alignment);
+
 ogb_instance void 
 reset_temporary_storage();
 
+ogb_instance Temp_Scope 
+temp_scope_begin();
+
+ogb_instance void 
+temp_scope_end(Temp_Scope scope);
+
+// Most temporary storage this thread has had in use at once. Use it to size TEMPORARY_STORAGE_SIZE.
+ogb_instance u64 
+get_temporary_storage_high_water_mark();
+
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
@@ -615,11 +2285,17 @@ void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* da
 			return talloc(size);
 			break;
 		}
+		case ALLOCATOR_ALLOCATE_ZEROED: {
+			return talloc_zeroed(size);
+		}
+		case ALLOCATOR_ALLOCATE_ALIGNED: {
+			return talloc_aligned(size, (u64)p);
+		}
 		case ALLOCATOR_DEALLOCATE: {
 			return 0;
 		}
 		case ALLOCATOR_REALLOCATE: {
-			panic("Temporary allocator cannot 'reallocate'");
+			// Can't resize, reallocate() falls back to alloc + copy
 			return 0;
 		}
 	}
@@ -628,111 +2304,311 @@ void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* da
 
 void temporary_storage_init(u64 arena_size) {
 	
-	temporary_storage = heap_alloc(arena_size);
+	temporary_storage = make_arena(arena_size);
 	assert(temporary_storage, "Failed allocating temporary storage");
-	temporary_storage_pointer = temporary_storage;
+	temporary_storage_chain[0] = temporary_storage;
+	temporary_storage_chain_count = 1;
+	temporary_storage_chain_index = 0;
+	temporary_storage_used_before = 0;
+	temporary_storage_high_water_mark = 0;
 
 	temp_allocator.proc = temp_allocator_proc;
 	temp_allocator.data = 0;
-	
-	temp_allocator.proc = temp_allocator_proc;
 }
 
-void* talloc(u64 size) {
-	
-	assert(size < TEMPORARY_STORAGE_SIZE, "Bruddah this is too large for temp allocator");
-	
-	void* p = temporary_storage_pointer;
+void temporary_storage_release() {
+	for (u64 i = 0; i < temporary_storage_chain_count; i++) {
+		arena_release(temporary_storage_chain[i]);
+	}
+	temporary_storage = 0;
+	temporary_storage_chain_count = 0;
+}
+
+// Arena in the chain that can fit size
+Arena *temporary_storage_get_arena(u64 size) {
 	
-	temporary_storage_pointer = (u8*)temporary_storage_pointer + size;
+	Arena *arena = temporary_storage_chain[temporary_storage_chain_index];
 	
-	if ((u8*)temporary_storage_pointer >= (u8*)temporary_storage+TEMPORARY_STORAGE_SIZE) {
-		if (!has_warned_temporary_storage_overflow) {
-			os_write_string_to_stdout(STR("WARNING: temporary storage was overflown, we wrap around at the start.\n"));
-			has_warned_temporary_storage_overflow = true;
+	// Move on to the next arena in the chain until it fits, chaining on a new one if needed
+	while ((u8*)align_next((u64)arena->next, ARENA_ALIGNMENT) + size > arena->end) {
+		temporary_storage_used_before += arena_get_used_size(arena);
+		temporary_storage_chain_index += 1;
+		
+		if (temporary_storage_chain_index == temporary_storage_chain_count) {
+			assert(temporary_storage_chain_count < TEMPORARY_STORAGE_MAX_CHAIN, "Temporary storage chain is full. Are you never resetting temporary storage?");
+			u64 reserve_size = max((u64)(arena->end-arena->start)*2, size*2);
+			temporary_storage_chain[temporary_storage_chain_count] = make_arena(reserve_size);
+			temporary_storage_chain_count += 1;
 		}
-		temporary_storage_pointer = temporary_storage;
-		return talloc(size);;
+		
+		arena = temporary_storage_chain[temporary_storage_chain_index];
+		arena_reset(arena);
 	}
 	
-	return p;
+	return arena;
 }
 
-void reset_temporary_storage() {
-	temporary_storage_pointer = temporary_storage;	
-	has_warned_temporary_storage_overflow = false;
+void temporary_storage_update_high_water_mark(Arena *arena) {
+	u64 used = temporary_storage_used_before + arena_get_used_size(arena);
+	if (used > temporary_storage_high_water_mark) temporary_storage_high_water_mark = used;
 }
 
-#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+void* talloc(u64 size) {
+	Arena *arena = temporary_storage_get_arena(size);
+	void *p = arena_alloc(arena, size);
+	temporary_storage_update_high_water_mark(arena);
+	return p;
+}
 
+void* talloc_zeroed(u64 size) {
+	Arena *arena = temporary_storage_get_arena(size);
+	void *p = arena_alloc_zeroed(arena, size);
+	temporary_storage_update_high_water_mark(arena);
+	return p;
+}
 
-typedef struct Arena {
-	void *start;
-	void *next;
-	u64 size;
-} Arena;
+void* talloc_aligned(u64 size, u64 alignment) {
+	Arena *arena = temporary_storage_get_arena(size + alignment);
+	void *p = arena_alloc_aligned(arena, size, alignment);
+	temporary_storage_update_high_water_mark(arena);
+	return p;
+}
 
-void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	if (size > 8) size = align_next(size, 8);
-	Arena *arena = (Arena*)data;
-	switch (message) {
-		case ALLOCATOR_ALLOCATE: {
-			void *p = arena->next;
-			
-			arena->next = (u8*)arena->next + size;
-			break;
-		}
-		case ALLOCATOR_DEALLOCATE: {
-			return 0;
-		}
-		case ALLOCATOR_REALLOCATE: {
-			panic("Arena allocator cannot 'reallocate'");
-			return 0;
+void reset_temporary_storage() {
+	
+	// Fold the chain into one arena big enough for all of it
+	if (temporary_storage_chain_count > 1) {
+		u64 reserve_size = 0;
+		for (u64 i = 0; i < temporary_storage_chain_count; i++) {
+			Arena *arena = temporary_storage_chain[i];
+			reserve_size += (u64)(arena->end-arena->start);
+			arena_release(arena);
 		}
+		temporary_storage = make_arena(reserve_size);
+		temporary_storage_chain[0] = temporary_storage;
+		temporary_storage_chain_count = 1;
 	}
-	return 0;
+	
+	temporary_storage_chain_index = 0;
+	temporary_storage_used_before = 0;
+	arena_reset(temporary_storage);
 }
 
-// Allocates arena from heap
-Arena make_arena(u64 size) {
-	size = align_next(size, 8);
-	Arena arena;
-	
-	arena.start = alloc(get_heap_allocator(), size);
-	arena.next = arena.start;
-	arena.size = size;
-	
-	return arena;
+Temp_Scope temp_scope_begin() {
+	Temp_Scope scope;
+	scope.chain_index = temporary_storage_chain_index;
+	scope.checkpoint = arena_checkpoint(temporary_storage_chain[temporary_storage_chain_index]);
+	scope.used_before = temporary_storage_used_before;
+	return scope;
+}
+
+void temp_scope_end(Temp_Scope scope) {
+	assert(scope.chain_index <= temporary_storage_chain_index, "Temp scopes ended out of order, or temporary storage was reset inside the scope");
+	temporary_storage_chain_index = scope.chain_index;
+	temporary_storage_used_before = scope.used_before;
+	arena_rewind(scope.checkpoint);
 }
 
-// Allocates arena from heap
-Allocator make_arena_allocator(u64 size) {
-	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
+u64 get_temporary_storage_high_water_mark() {
+	return temporary_storage_high_water_mark;
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+
+///
+///
+// Pools
+///
+// Fixed size objects with O(1) add & remove, addressed by 32-bit handles.
+// A handle is the slot index in the low POOL_INDEX_BITS and the slot's generation in the rest.
+// The generation is bumped when the slot is added to and again when it's removed (so it's odd
+// while alive), which is how pool_get() tells a stale handle from a live one. After
+// 2^(32-POOL_INDEX_BITS-1) reuses of the same slot an old handle would look alive again.
+// 0 is never a valid handle.
+// Like arenas, the pool reserves its max_count up front and commits pages as it grows, so
+// objects never move and pointers to them stay valid until they're removed.
+// Pools are not thread safe.
+//
+// Usage:
+//
+//	Pool *things = make_pool(Thing, 10000);
+//	Pool_Handle handle = pool_add(things);
+//	Thing *thing = pool_get(things, handle); // 0 if the handle is stale
+//	pool_remove(things, handle);
+//
+//	for (Thing *thing = pool_first(things); thing; thing = pool_next(things, thing)) { ... }
+
+#define POOL_INDEX_BITS 20
+#define POOL_MAX_COUNT (1u << POOL_INDEX_BITS)
+#define POOL_INDEX_MASK (POOL_MAX_COUNT-1)
+#define POOL_NO_FREE_SLOT 0xFFFFFFFF
+
+typedef u32 Pool_Handle;
+
+typedef struct Pool {
+	u8 *items;
+	u32 *generations;
+	u8 *committed_end;
+	u8 *end;
+	u64 item_stride;
+	u32 max_count;
+	u32 slot_count; // Slots ever handed out, everything past this is untouched
+	u32 count;      // Alive
+	u32 free_head;  // Removed slots, linked through the first 4 bytes of the item
+} Pool;
+
+#define make_pool(Type, max_count) make_pool_raw(sizeof(Type), (max_count))
+// Every item starts on alignment (a power of two, at most os.page_size)
+#define make_pool_aligned(Type, max_count, alignment) make_pool_aligned_raw(sizeof(Type), (max_count), (alignment))
+
+ogb_instance Pool*
+make_pool_raw(u64 item_size, u32 max_count);
+
+ogb_instance Pool*
+make_pool_aligned_raw(u64 item_size, u32 max_count, u64 alignment);
+
+ogb_instance void
+pool_release(Pool *pool);
+
+// The object comes zeroed
+ogb_instance Pool_Handle
+pool_add(Pool *pool);
+
+ogb_instance void
+pool_remove(Pool *pool, Pool_Handle handle);
+
+// Returns 0 if the handle is stale
+ogb_instance void*
+pool_get(Pool *pool, Pool_Handle handle);
+
+ogb_instance bool
+pool_is_valid(Pool *pool, Pool_Handle handle);
+
+// Handle of an object in the pool
+ogb_instance Pool_Handle
+pool_get_handle(Pool *pool, void *item);
+
+// Iterating live objects, returns 0 when there are no more
+ogb_instance void*
+pool_first(Pool *pool);
+ogb_instance void*
+pool_next(Pool *pool, void *item);
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+Pool *make_pool_aligned_raw(u64 item_size, u32 max_count, u64 alignment) {
+	assert(max_count > 0 && max_count <= POOL_MAX_COUNT, "Pool max_count must be between 1 and %u, got %u", POOL_MAX_COUNT, max_count);
+	assert(alignment > 0 && (alignment & (alignment-1)) == 0 && alignment <= os.page_size, "Pool alignment must be a power of two up to os.page_size, got %llu", alignment);
 	
-	Arena *arena = (Arena*)mem;
+	u64 item_stride = align_next(max(item_size, sizeof(u32)), max(alignment, sizeof(u32)));
 	
-	arena->start = (u8*)mem + sizeof(Arena);
-	arena->next = arena->start;
-	arena->size = size;
+	u64 generations_offset = align_next(sizeof(Pool), 16);
+	u64 items_offset = align_next(generations_offset + max_count*sizeof(u32), max(alignment, 16));
+	u64 region_size = align_next(items_offset + max_count*item_stride, os.page_size);
 	
-	Allocator allocator;
-	allocator.data = arena;
-	allocator.proc = arena_allocator_proc;
+	u8 *region = heap_large_reserve_region(region_size);
 	
-	return allocator;
+	// Pool & generations are committed right away, items as we go
+	u64 first_commit = align_next(items_offset, os.page_size);
+	bool ok = os_recommit_program_memory_pages(region, first_commit);
+	assert(ok, "Failed committing memory for pool. Out of memory?");
+	
+	Pool *pool = (Pool*)region;
+	pool->generations = (u32*)(region + generations_offset);
+	pool->items = region + items_offset;
+	pool->committed_end = region + first_commit;
+	pool->end = region + region_size;
+	pool->item_stride = item_stride;
+	pool->max_count = max_count;
+	pool->slot_count = 0;
+	pool->count = 0;
+	pool->free_head = POOL_NO_FREE_SLOT;
+	
+	return pool;
 }
-Allocator make_arena_allocator_with_memory(u64 size, void *p) {
-	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
+
+Pool *make_pool_raw(u64 item_size, u32 max_count) {
+	// Keeps the item alignment since sizeof(Type) is a multiple of it
+	return make_pool_aligned_raw(item_size, max_count, sizeof(u32));
+}
+
+void pool_release(Pool *pool) {
+	heap_large_release_region((u8*)pool, (u64)(pool->end - (u8*)pool));
+}
+
+Pool_Handle pool_add(Pool *pool) {
+	u32 index;
+	if (pool->free_head != POOL_NO_FREE_SLOT) {
+		index = pool->free_head;
+		pool->free_head = *(u32*)(pool->items + index*pool->item_stride);
+		memset(pool->items + index*pool->item_stride, 0, pool->item_stride);
+	} else {
+		// Never used, so it's still zero from the OS
+		assert(pool->slot_count < pool->max_count, "Pool is full (%u objects)", pool->max_count);
+		index = pool->slot_count;
+		pool->slot_count += 1;
+		
+		u8 *item_end = pool->items + pool->slot_count*pool->item_stride;
+		if (item_end > pool->committed_end) {
+			u8 *new_committed_end = (u8*)align_next((u64)item_end, ARENA_COMMIT_SIZE);
+			new_committed_end = (u8*)align_next((u64)new_committed_end, os.page_size);
+			if (new_committed_end > pool->end) new_committed_end = pool->end;
+			bool ok = os_recommit_program_memory_pages(pool->committed_end, (u64)(new_committed_end - pool->committed_end));
+			assert(ok, "Failed committing memory for pool. Out of memory?");
+			pool->committed_end = new_committed_end;
+		}
+	}
 	
-	Arena *arena = (Arena*)alloc(get_heap_allocator(), sizeof(Arena));
+	pool->generations[index] += 1;
+	pool->count += 1;
 	
-	arena->start = p;
-	arena->next = arena->start;
-	arena->size = size;
+	return index | (pool->generations[index] << POOL_INDEX_BITS);
+}
+
+bool pool_is_valid(Pool *pool, Pool_Handle handle) {
+	u32 index = handle & POOL_INDEX_MASK;
+	if (index >= pool->slot_count) return false;
 	
-	Allocator allocator;
-	allocator.data = arena;
-	allocator.proc = arena_allocator_proc;
+	u32 generation = pool->generations[index];
+	return (generation & 1) && (generation << POOL_INDEX_BITS) == (handle & ~POOL_INDEX_MASK);
+}
+
+void *pool_get(Pool *pool, Pool_Handle handle) {
+	if (!pool_is_valid(pool, handle)) return 0;
+	return pool->items + (handle & POOL_INDEX_MASK)*pool->item_stride;
+}
+
+void pool_remove(Pool *pool, Pool_Handle handle) {
+	assert(pool_is_valid(pool, handle), "Tried removing a stale handle from a pool");
 	
-	return allocator;
+	u32 index = handle & POOL_INDEX_MASK;
+	pool->generations[index] += 1;
+	pool->count -= 1;
+	
+	*(u32*)(pool->items + index*pool->item_stride) = pool->free_head;
+	pool->free_head = index;
+}
+
+Pool_Handle pool_get_handle(Pool *pool, void *item) {
+	assert((u8*)item >= pool->items && (u8*)item < pool->items + pool->slot_count*pool->item_stride, "Pointer is not in the pool");
+	u32 index = (u32)(((u8*)item - pool->items) / pool->item_stride);
+	assert(pool->generations[index] & 1, "Object is not alive in the pool");
+	return index | (pool->generations[index] << POOL_INDEX_BITS);
 }
+
+void *pool_next_from_index(Pool *pool, u32 index) {
+	for (; index < pool->slot_count; index += 1) {
+		if (pool->generations[index] & 1) return pool->items + index*pool->item_stride;
+	}
+	return 0;
+}
+void *pool_first(Pool *pool) {
+	return pool_next_from_index(pool, 0);
+}
+void *pool_next(Pool *pool, void *item) {
+	u32 index = (u32)(((u8*)item - pool->items) / pool->item_stride);
+	return pool_next_from_index(pool, index+1);
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
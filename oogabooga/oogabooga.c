@@ -76,6 +76,21 @@
 				minimum requirements for example to fit the temporary storage in program 
 				memory. It's more of a rough guideline.
 			
+		- PROGRAM_MEMORY_RESERVE_SIZE
+			Size of the virtual address range reserved for program memory up front (default GB(64)).
+			Only pages that are actually used are committed, so this doesn't cost memory, it's
+			just the limit for how much program memory can grow.
+			
+		- ENABLE_LARGE_PAGES
+			Back program memory (and with that the heap) with 2MB pages to cut down on TLB misses
+			when walking big buffers every frame.
+			Windows: MEM_LARGE_PAGES. Needs the "Lock pages in memory" privilege (SeLockMemoryPrivilege).
+			Linux: transparent huge pages (madvise MADV_HUGEPAGE). Needs THP set to "always" or "madvise".
+			Falls back to normal pages if not available. Check os.large_page_size to see if it worked.
+			Windows can't commit large pages into a reservation, so only the initial program memory
+			(INITIAL_PROGRAM_MEMORY_SIZE) is large pages there, growth uses normal pages. That part
+			isn't page locked in debug, and heap_trim() does nothing since it can't be decommitted.
+			
 		- RUN_TESTS
 			Run ooga booga tests.
 		
@@ -101,6 +116,45 @@
 					tm_scope
 					tm_scope_var
 					tm_scope_accum
+					tm_counter
+					
+		- ENABLE_ALLOCATION_TRACKING
+			Record the tag of every live heap allocation in a side table, so you can see which
+			subsystem holds how much memory. Cheap enough to leave on for soak tests.
+			The tag is the innermost push_allocation_tag(), or the file:line of the alloc() call.
+			See allocation tracking in memory.c
+			
+			0: Disable
+			1: Enable
+			
+		- ENABLE_SPINLOCK_STATS
+			Count acquires, contended acquires, spins and the longest wait for every Spinlock.
+			With ENABLE_PROFILING, the heap and profiler locks show up as counters in
+			google_trace.json every frame. See spinlock_report_stats_to_profiler() in profiling.c
+			
+			0: Disable
+			1: Enable
+			
+		- HEAP_AUTO_TRIM_THRESHOLD
+			When the heap holds more than this many bytes of freed memory, os_update() gives the
+			free pages back to the OS with heap_trim(). Default MB(64), 0 disables it.
+			You can always call heap_trim() yourself, for example after unloading a level.
+			
+			Example:
+			
+				#define HEAP_AUTO_TRIM_THRESHOLD MB(16)
+			
+		- HEAP_VALIDATION_INTERVAL
+			In DEBUG, check the whole block heap for corruption on every Nth heap block change
+			(alloc, dealloc, resize). Each check is O(free nodes).
+			
+			0: Disable (default)
+			1: Check every time (this is what VERY_DEBUG used to do, which now implies 1)
+			
+			Example:
+			
+				// Sampled validation that is still playable
+				#define HEAP_VALIDATION_INTERVAL 64
 					
 		- OOGABOOGA_HEADLESS
             Run oogabooga in headless mode, i.e. no window, no graphics, no audio.
@@ -112,6 +166,11 @@
             Example:
             
                 #define OOGABOOGA_HEADLESS 1
+                
+            Note:
+                This is required on linux, where we only have a headless os layer (os_impl_linux.c).
+                Build with something like:
+                    gcc -O2 -std=c11 build.c -o game -lpthread -ldl -lm
 		
 
 */
@@ -122,9 +181,18 @@
 
 #define OGB_VERSION (OGB_VERSION_MAJOR*1000000+OGB_VERSION_MINOR*1000+OGB_VERSION_PATCH)
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	// Needs to be defined before ANY system header
+	#define _GNU_SOURCE
+#endif
+
 #include <math.h>
 #include <immintrin.h>
-#include <intrin.h>
+#ifdef _WIN32
+	#include <intrin.h>
+#else
+	#include <x86intrin.h>
+#endif
 #include <stdint.h>
 
 typedef uint8_t  u8;
@@ -200,6 +268,28 @@ typedef u8 bool;
 #ifndef INITIAL_PROGRAM_MEMORY_SIZE
     #define INITIAL_PROGRAM_MEMORY_SIZE MB(5)
 #endif
+#ifndef PROGRAM_MEMORY_RESERVE_SIZE
+    #define PROGRAM_MEMORY_RESERVE_SIZE GB(64)
+#endif
+#ifndef ENABLE_LARGE_PAGES
+    #define ENABLE_LARGE_PAGES 0
+#endif
+#ifndef ENABLE_ALLOCATION_TRACKING
+    #define ENABLE_ALLOCATION_TRACKING 0
+#endif
+#ifndef ENABLE_SPINLOCK_STATS
+    #define ENABLE_SPINLOCK_STATS 0
+#endif
+#ifndef HEAP_AUTO_TRIM_THRESHOLD
+    #define HEAP_AUTO_TRIM_THRESHOLD MB(64)
+#endif
+#ifndef HEAP_VALIDATION_INTERVAL
+    #if defined(VERY_DEBUG) && VERY_DEBUG
+        #define HEAP_VALIDATION_INTERVAL 1
+    #else
+        #define HEAP_VALIDATION_INTERVAL 0
+    #endif
+#endif
 
 #if ENABLE_SIMD && !defined(SIMD_ENABLE_SSE2)
 	#if COMPILER_CAN_DO_SSE2
@@ -236,9 +326,32 @@ typedef u8 bool;
 	#define TARGET_OS WINDOWS
 	#define OS_PATHS_HAVE_BACKSLASH 1
 #elif defined(__linux__)
-	// Include whatever #Incomplete #Portability
+	#include <stddef.h>
+	#include <stdarg.h>
+	#include <limits.h>
+	#include <string.h>
+	#include <stdlib.h>
+	#include <unistd.h>
+	#include <fcntl.h>
+	#include <errno.h>
+	#include <time.h>
+	#include <sched.h>
+	#include <pthread.h>
+	#include <dlfcn.h>
+	#include <dirent.h>
+	#include <link.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/syscall.h>
+	#include <linux/futex.h>
+	#include <linux/io_uring.h>
+    #if CONFIGURATION == DEBUG
+    	#include <execinfo.h>
+    #endif
+	// msvc-isms that are spelled out in shared code
+	#define __cdecl
+	#define _In_
 	#define TARGET_OS LINUX
-	#error "Linux is not supported yet";
 	#define OS_PATHS_HAVE_BACKSLASH 0
 #elif defined(__APPLE__) && defined(__MACH__)
 	// Include whatever #Incomplete #Portability
@@ -310,6 +423,7 @@ typedef u8 bool;
 #include "random.c"
 #include "color.c"
 #include "memory.c"
+#include "jobs.c"
 #include "input.c"
 
 #ifndef OOGABOOGA_HEADLESS
@@ -402,7 +516,9 @@ void oogabooga_init(u64 program_memory_size) {
 	log_verbose("CPU has avx512: %cs", features.avx512 ? "true" : "false");
 	
 	Os_Monitor *m = os.primary_monitor;
-	log_verbose("Primary Monitor:\n\t%s\n\t%dhz\n\t%dx%d\n\tdpi: %d", m->name, m->refresh_rate, m->resolution_x, m->resolution_y, m->dpi);
+	if (m) {
+		log_verbose("Primary Monitor:\n\t%s\n\t%dhz\n\t%dx%d\n\tdpi: %d", m->name, m->refresh_rate, m->resolution_x, m->resolution_y, m->dpi);
+	}
 }
 #endif
 
@@ -0,0 +1,1312 @@
+
+// Headless only. There is no window, graphics or audio on linux (yet), but everything else in
+// os_interface.c is implemented so the oogabooga standard library, tests and profiling can run
+// natively on linux machines (game servers, build machines).
+
+#define VIRTUAL_MEMORY_BASE ((void*)0x0000690000000000ULL)
+
+void* heap_alloc(u64);
+void heap_dealloc(void*);
+
+// #Global
+struct timespec linux_time_at_start;
+bool has_os_update_been_called_at_all = false;
+
+thread_local void *linux_stack_base  = 0;
+thread_local void *linux_stack_limit = 0;
+
+// impl input.c
+const u64 MAX_NUMBER_OF_GAMEPADS = 0;
+
+int linux_find_static_memory_callback(struct dl_phdr_info *info, size_t size, void *data) {
+	for (u64 i = 0; i < info->dlpi_phnum; i++) {
+		const ElfW(Phdr) *header = &info->dlpi_phdr[i];
+		if (header->p_type != PT_LOAD) continue;
+
+		u8 *start = (u8*)(info->dlpi_addr + header->p_vaddr);
+		u8 *end   = start + header->p_memsz;
+
+		if (os.static_memory_start == 0 || start < (u8*)os.static_memory_start) os.static_memory_start = start;
+		if (end > (u8*)os.static_memory_end) os.static_memory_end = end;
+	}
+	return 0;
+}
+
+#if ENABLE_LARGE_PAGES
+// We go with transparent huge pages rather than MAP_HUGETLB. hugetlbfs pages have to be
+// reserved up front by the admin, and they can't be committed/decommitted page by page
+// inside our program memory reservation.
+// Returns 0 if THP is turned off.
+u64 linux_get_transparent_huge_page_size() {
+	char buffer[128];
+	
+	int fd = open("/sys/kernel/mm/transparent_hugepage/enabled", O_RDONLY);
+	if (fd < 0) return 0;
+	ssize_t n = read(fd, buffer, sizeof(buffer)-1);
+	close(fd);
+	if (n <= 0) return 0;
+	buffer[n] = 0;
+	if (strstr(buffer, "[never]")) {
+		os_write_string_to_stdout(STR("ENABLE_LARGE_PAGES: Transparent huge pages are disabled, using normal pages.\n"));
+		return 0;
+	}
+	
+	u64 size = MB(2);
+	fd = open("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", O_RDONLY);
+	if (fd >= 0) {
+		n = read(fd, buffer, sizeof(buffer)-1);
+		close(fd);
+		if (n > 0) {
+			buffer[n] = 0;
+			u64 parsed = strtoull(buffer, 0, 10);
+			if (parsed) size = parsed;
+		}
+	}
+	return size;
+}
+#endif // ENABLE_LARGE_PAGES
+
+void os_init(u64 program_memory_capacity) {
+
+    // #Volatile
+    // Any printing uses vsnprintf, and printing may happen in init,
+    // especially on errors, so this needs to happen first.
+	os.crt = os_load_dynamic_library(STR("libc.so.6"));
+	assert(os.crt != 0, "Could not load libc.so.6 #Incomplete #Portability");
+	os.crt_vsnprintf = (Crt_Vsnprintf_Proc)os_dynamic_library_load_symbol(os.crt, STR("vsnprintf"));
+	assert(os.crt_vsnprintf, "Missing vsnprintf in crt");
+
+	context.thread_id = (u64)pthread_self();
+
+	os.page_size = (u64)sysconf(_SC_PAGESIZE);
+	// mmap only cares about pages
+	os.granularity = os.page_size;
+
+	os.static_memory_start = 0;
+	os.static_memory_end = 0;
+	dl_iterate_phdr(linux_find_static_memory_callback, 0);
+
+	os.large_page_size = 0;
+#if ENABLE_LARGE_PAGES
+	os.large_page_size = linux_get_transparent_huge_page_size();
+#endif
+
+	program_memory_mutex = os_make_mutex();
+	os_grow_program_memory(program_memory_capacity);
+
+	heap_init();
+
+	clock_gettime(CLOCK_MONOTONIC, &linux_time_at_start);
+	os.cycles_per_second = os_measure_cycles_per_second();
+
+	os.number_of_connected_monitors = 0;
+	os.monitors = 0;
+	os.primary_monitor = 0;
+}
+
+///
+///
+// Threading
+///
+
+
+///
+// Thread primitive
+
+void *linux_thread_invoker(void *param) {
+
+	Thread *t = (Thread*)param;
+
+	temporary_storage_init(t->temporary_storage_size);
+
+	context = t->initial_context;
+	context.thread_id = (u64)pthread_self();
+
+	t->proc(t);
+
+	temporary_storage_release();
+	heap_thread_cache_release();
+
+	return 0;
+}
+
+////// DEPRECATED   vvvvvvvvvvvvvvvvv
+Thread* os_make_thread(Thread_Proc proc, Allocator allocator) {
+	Thread *t = (Thread*)alloc(allocator, sizeof(Thread));
+	t->id = 0; // This is set when we start it
+	t->proc = proc;
+	t->initial_context = context;
+	t->allocator = allocator;
+	t->temporary_storage_size = KB(10);
+
+	return t;
+}
+void os_destroy_thread(Thread *t) {
+	os_thread_join(t);
+	dealloc(t->allocator, t);
+}
+void os_start_thread(Thread *t) {
+	os_thread_start(t);
+}
+void os_join_thread(Thread *t) {
+	pthread_join(t->os_handle, 0);
+}
+////// DEPRECATED   ^^^^^^^^^^^^^^^^
+
+void os_thread_init(Thread *t, Thread_Proc proc) {
+	memset(t, 0, sizeof(Thread));
+	t->id = 0;
+	t->proc = proc;
+	t->initial_context = context;
+	t->temporary_storage_size = KB(10);
+}
+void os_thread_destroy(Thread *t) {
+	os_thread_join(t);
+}
+void os_thread_start(Thread *t) {
+	int err = pthread_create(&t->os_handle, 0, linux_thread_invoker, t);
+	assert(err == 0, "Failed creating thread (error %d)", err);
+
+	t->id = (u64)t->os_handle;
+}
+void os_thread_join(Thread *t) {
+	pthread_join(t->os_handle, 0);
+}
+
+///
+// Mutex primitive
+
+Mutex_Handle os_make_mutex() {
+	// The program memory mutex is made before the heap is ready
+	pthread_mutex_t *m;
+	if (heap_initted) m = (pthread_mutex_t*)heap_alloc(sizeof(pthread_mutex_t));
+	else              m = (pthread_mutex_t*)alloc(get_initialization_allocator(), sizeof(pthread_mutex_t));
+
+	// Win32 mutexes are recursive so we do the same here
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	int err = pthread_mutex_init(m, &attr);
+	pthread_mutexattr_destroy(&attr);
+	assert(err == 0, "Failed creating pthread mutex. error %d", err);
+
+	return m;
+}
+void os_destroy_mutex(Mutex_Handle m) {
+	pthread_mutex_destroy(m);
+	if (is_pointer_in_program_memory(m)) heap_dealloc(m);
+}
+void os_lock_mutex(Mutex_Handle m) {
+	int err = pthread_mutex_lock(m);
+	assert(err == 0, "Unexpected mutex lock result %d", err);
+}
+void os_unlock_mutex(Mutex_Handle m) {
+	int err = pthread_mutex_unlock(m);
+	assert(err == 0, "Unlock mutex 0x%x failed with error %d", m, err);
+}
+
+
+///
+// Wait on address
+
+void os_wait_on_address(volatile u32 *address, u32 expected) {
+	syscall(SYS_futex, (u32*)address, FUTEX_WAIT_PRIVATE, expected, 0, 0, 0);
+}
+void os_wake_one_on_address(volatile u32 *address) {
+	syscall(SYS_futex, (u32*)address, FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+}
+void os_wake_all_on_address(volatile u32 *address) {
+	syscall(SYS_futex, (u32*)address, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+}
+
+void os_sleep(u32 ms) {
+	struct timespec t;
+	t.tv_sec  = ms / 1000;
+	t.tv_nsec = (ms % 1000) * 1000000;
+	while (nanosleep(&t, &t) == -1 && errno == EINTR) {}
+}
+
+void os_yield_thread() {
+	sched_yield();
+}
+
+void os_high_precision_sleep(f64 ms) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	u64 ns = (u64)(ms*1000000.0);
+	end.tv_sec  += ns / 1000000000ULL;
+	end.tv_nsec += ns % 1000000000ULL;
+	if (end.tv_nsec >= 1000000000L) {
+		end.tv_sec  += 1;
+		end.tv_nsec -= 1000000000L;
+	}
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end, 0) == EINTR) {}
+}
+
+
+///
+///
+// Time
+///
+
+
+// #Cleanup deprecated
+float64
+os_get_current_time_in_seconds() {
+	struct timespec t;
+	if (clock_gettime(CLOCK_MONOTONIC, &t) != 0) return -1.0;
+	return (float64)t.tv_sec + (float64)t.tv_nsec / 1000000000.0;
+}
+
+float64
+os_get_elapsed_seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (float64)(t.tv_sec-linux_time_at_start.tv_sec) + (float64)(t.tv_nsec-linux_time_at_start.tv_nsec) / 1000000000.0;
+}
+
+
+///
+///
+// Dynamic Libraries
+///
+
+Dynamic_Library_Handle os_load_dynamic_library(string path) {
+	return dlopen(temp_convert_to_null_terminated_string(path), RTLD_NOW);
+}
+void *os_dynamic_library_load_symbol(Dynamic_Library_Handle l, string identifier) {
+	return dlsym(l, temp_convert_to_null_terminated_string(identifier));
+}
+void os_unload_dynamic_library(Dynamic_Library_Handle l) {
+	dlclose(l);
+}
+
+
+///
+///
+// IO
+///
+
+// #Global
+const File OS_INVALID_FILE = -1;
+void os_write_string_to_stdout(string s) {
+	os_file_write_bytes(STDOUT_FILENO, s.data, s.count);
+}
+
+
+File os_file_open_s(string path, Os_Io_Open_Flags flags) {
+	int linux_flags = O_CLOEXEC;
+
+	if (flags & O_WRITE) linux_flags |= O_RDWR;
+	else                 linux_flags |= O_RDONLY;
+
+	if (flags & O_CREATE) linux_flags |= O_CREAT | O_TRUNC;
+
+	int f;
+	do { f = open(temp_convert_to_null_terminated_string(path), linux_flags, 0644); } while (f == -1 && errno == EINTR);
+
+	return f;
+}
+
+void os_file_close(File f) {
+	if (f == OS_INVALID_FILE) return;
+	close(f);
+}
+
+bool os_file_delete_s(string path) {
+	return unlink(temp_convert_to_null_terminated_string(path)) == 0;
+}
+
+bool os_file_copy_s(string from, string to, bool replace_if_exists) {
+	File src = os_file_open_s(from, O_READ);
+	if (src == OS_INVALID_FILE) return false;
+
+	struct stat src_stat;
+	if (fstat(src, &src_stat) != 0) {
+		os_file_close(src);
+		return false;
+	}
+
+	int dst_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+	if (!replace_if_exists) dst_flags |= O_EXCL;
+	File dst = open(temp_convert_to_null_terminated_string(to), dst_flags, src_stat.st_mode & 0777);
+	if (dst == OS_INVALID_FILE) {
+		os_file_close(src);
+		return false;
+	}
+
+	u8 buffer[KB(64)];
+	bool ok = true;
+	while (ok) {
+		u64 read = 0;
+		ok = os_file_read(src, buffer, sizeof(buffer), &read);
+		if (!ok || read == 0) break;
+		ok = os_file_write_bytes(dst, buffer, read);
+	}
+
+	os_file_close(src);
+	os_file_close(dst);
+	return ok;
+}
+
+bool os_make_directory_s(string path, bool recursive) {
+	char *cpath = temp_convert_to_null_terminated_string(path);
+
+	if (recursive) {
+		for (char *sep = strchr(cpath + 1, '/'); sep; sep = strchr(sep + 1, '/')) {
+			*sep = 0;
+			if (mkdir(cpath, 0755) != 0 && errno != EEXIST) {
+				return false;
+			}
+			*sep = '/';
+		}
+	}
+
+	if (mkdir(cpath, 0755) != 0 && errno != EEXIST) {
+		return false;
+	}
+
+	return true;
+}
+bool os_delete_directory_s(string path, bool recursive) {
+	char *cpath = temp_convert_to_null_terminated_string(path);
+
+	if (recursive) {
+		DIR *dir = opendir(cpath);
+		if (!dir) return false;
+
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != 0) {
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+			string child_path = tprint("%s/%cs", path, entry->d_name);
+
+			struct stat child_stat;
+			if (lstat(temp_convert_to_null_terminated_string(child_path), &child_stat) != 0) {
+				closedir(dir);
+				return false;
+			}
+
+			bool ok;
+			if (S_ISDIR(child_stat.st_mode)) ok = os_delete_directory_s(child_path, true);
+			else                             ok = os_file_delete_s(child_path);
+
+			if (!ok) {
+				closedir(dir);
+				return false;
+			}
+		}
+		closedir(dir);
+	}
+
+	return rmdir(cpath) == 0;
+}
+
+bool os_file_write_string(File f, string s) {
+	return os_file_write_bytes(f, s.data, s.count);
+}
+
+bool os_file_write_bytes(File f, void *buffer, u64 size_in_bytes) {
+	u64 written = 0;
+	while (written < size_in_bytes) {
+		ssize_t result = write(f, (u8*)buffer + written, size_in_bytes - written);
+		if (result < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		written += (u64)result;
+	}
+	return true;
+}
+
+bool os_file_read(File f, void* buffer, u64 bytes_to_read, u64 *actual_read_bytes) {
+	u64 read_bytes = 0;
+	bool ok = true;
+
+	// read() may return less than asked for before end of file, so keep going until EOF
+	while (read_bytes < bytes_to_read) {
+		ssize_t result = read(f, (u8*)buffer + read_bytes, bytes_to_read - read_bytes);
+		if (result < 0) {
+			if (errno == EINTR) continue;
+			ok = false;
+			break;
+		}
+		if (result == 0) break;
+		read_bytes += (u64)result;
+	}
+
+	if (actual_read_bytes) {
+		*actual_read_bytes = read_bytes;
+	}
+	return ok;
+}
+
+bool os_file_set_pos(File f, s64 pos_in_bytes) {
+	if (pos_in_bytes < 0) return false;
+	return lseek(f, (off_t)pos_in_bytes, SEEK_SET) != (off_t)-1;
+}
+
+s64
+os_file_get_size(File f) {
+	struct stat s;
+	if (fstat(f, &s) != 0) return -1;
+	return (s64)s.st_size;
+}
+
+s64
+os_file_get_size_from_path(string path) {
+	struct stat s;
+	if (stat(temp_convert_to_null_terminated_string(path), &s) != 0) return -1;
+	return (s64)s.st_size;
+}
+
+s64 os_file_get_pos(File f) {
+	off_t pos = lseek(f, 0, SEEK_CUR);
+	if (pos == (off_t)-1) return (s64)-1;
+	return (s64)pos;
+}
+
+bool os_write_entire_file_handle(File f, string data) {
+	return os_file_write_string(f, data);
+}
+
+bool os_write_entire_file_s(string path, string data) {
+	File file = os_file_open_s(path, O_WRITE | O_CREATE);
+	if (file == OS_INVALID_FILE) {
+		return false;
+	}
+	bool result = os_file_write_string(file, data);
+	os_file_close(file);
+	return result;
+}
+
+bool os_read_entire_file_handle(File f, string *result, Allocator allocator) {
+	s64 file_size = os_file_get_size(f);
+	if (file_size < 0) {
+		return false;
+	}
+
+	u64 actual_read = 0;
+	result->data = (u8*)alloc(allocator, file_size);
+	result->count = file_size;
+
+	bool ok = os_file_read(f, result->data, file_size, &actual_read);
+	if (!ok) {
+		dealloc(allocator, result->data);
+		result->data = 0;
+		return false;
+	}
+
+	return actual_read == (u64)file_size;
+}
+
+bool os_read_entire_file_s(string path, string *result, Allocator allocator) {
+	File file = os_file_open_s(path, O_READ);
+	if (file == OS_INVALID_FILE) {
+		return false;
+	}
+	bool res = os_read_entire_file_handle(file, result, allocator);
+	os_file_close(file);
+	return res;
+}
+
+bool os_file_map_s(string path, string *result) {
+	File file = os_file_open_s(path, O_READ);
+	if (file == OS_INVALID_FILE) return false;
+
+	s64 size = os_file_get_size(file);
+	if (size <= 0) {
+		os_file_close(file);
+		return false;
+	}
+
+	// The mapping keeps the file alive, so we don't need the descriptor anymore
+	void *view = mmap(0, (u64)size, PROT_READ, MAP_PRIVATE, file, 0);
+	os_file_close(file);
+	if (view == MAP_FAILED) return false;
+
+	result->data = (u8*)view;
+	result->count = (u64)size;
+	return true;
+}
+
+void os_file_unmap(string mapped) {
+	if (!mapped.data) return;
+	munmap(mapped.data, mapped.count);
+}
+
+///
+// Async file IO
+// io_uring through raw syscalls (no liburing). If the kernel won't give us a ring (old kernel,
+// seccomp, containers) or a request is too big for one sqe, it goes to a small thread pool instead.
+
+// Linux never transfers more than this in one read/write, bigger requests complete short.
+// The pool loops until everything is transferred, the ring doesn't, so they go to the pool.
+#define LINUX_MAX_SINGLE_TRANSFER 0x7ffff000ULL
+
+typedef struct Linux_Io_Uring {
+	bool initted;
+	bool available;
+	int fd;
+	u32 entries;
+	u32 in_flight;
+	u32 *sq_head, *sq_tail, *sq_mask, *sq_array;
+	u32 *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	pthread_mutex_t lock;
+	// Set while one thread blocks in io_uring_enter for completions. Only that thread reaps
+	// until it's back, everyone else waits on has_completed.
+	bool reaping;
+	pthread_cond_t has_completed;
+} Linux_Io_Uring;
+
+typedef struct Linux_Async_Io_Pool {
+	bool started;
+	Os_Async_Io *first;
+	Os_Async_Io *last;
+	Thread threads[OS_ASYNC_IO_THREAD_COUNT];
+	pthread_mutex_t lock;
+	pthread_cond_t has_work;
+	pthread_cond_t has_completed;
+} Linux_Async_Io_Pool;
+
+// #Global
+Linux_Io_Uring linux_io_uring = { .lock = PTHREAD_MUTEX_INITIALIZER, .has_completed = PTHREAD_COND_INITIALIZER };
+Linux_Async_Io_Pool linux_async_io_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.has_work = PTHREAD_COND_INITIALIZER,
+	.has_completed = PTHREAD_COND_INITIALIZER
+};
+
+#define LINUX_IO_URING_ENTRIES 64
+
+void linux_async_io_execute_blocking(Os_Async_Io *io) {
+	u64 done = 0;
+	bool ok = true;
+	while (done < io->size) {
+		ssize_t n;
+		if (io->write) n = pwrite(io->file, (u8*)io->buffer + done, io->size - done, (off_t)(io->offset + done));
+		else           n = pread (io->file, (u8*)io->buffer + done, io->size - done, (off_t)(io->offset + done));
+		
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) { ok = false; break; }
+		if (n == 0) {
+			// End of file is fine for reads, but a write that makes no progress failed
+			if (io->write) ok = false;
+			break;
+		}
+		done += (u64)n;
+	}
+	io->bytes_transferred = done;
+	MEMORY_BARRIER;
+	io->status = ok ? OS_ASYNC_IO_DONE : OS_ASYNC_IO_FAILED;
+}
+
+void linux_async_io_worker(Thread *t) {
+	Linux_Async_Io_Pool *pool = &linux_async_io_pool;
+	while (true) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->first) pthread_cond_wait(&pool->has_work, &pool->lock);
+		Os_Async_Io *io = pool->first;
+		pool->first = io->_next;
+		if (!pool->first) pool->last = 0;
+		pthread_mutex_unlock(&pool->lock);
+		
+		// Status is set under the lock so waiters can't miss the broadcast
+		Os_Async_Io result = *io;
+		linux_async_io_execute_blocking(&result);
+		
+		pthread_mutex_lock(&pool->lock);
+		io->bytes_transferred = result.bytes_transferred;
+		io->status = result.status;
+		pthread_cond_broadcast(&pool->has_completed);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+void linux_async_io_pool_submit(Os_Async_Io *io) {
+	Linux_Async_Io_Pool *pool = &linux_async_io_pool;
+	io->_native = false;
+	io->_next = 0;
+	
+	pthread_mutex_lock(&pool->lock);
+	if (!pool->started) {
+		for (u64 i = 0; i < OS_ASYNC_IO_THREAD_COUNT; i++) {
+			os_thread_init(&pool->threads[i], linux_async_io_worker);
+			os_thread_start(&pool->threads[i]);
+		}
+		pool->started = true;
+	}
+	if (pool->last) pool->last->_next = io;
+	else            pool->first = io;
+	pool->last = io;
+	pthread_cond_signal(&pool->has_work);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void linux_io_uring_init(Linux_Io_Uring *ring) {
+	ring->initted = true;
+	ring->available = false;
+	
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = (int)syscall(__NR_io_uring_setup, LINUX_IO_URING_ENTRIES, &params);
+	if (fd < 0) return;
+	
+	u64 sq_ring_size = params.sq_off.array + params.sq_entries*sizeof(u32);
+	u64 cq_ring_size = params.cq_off.cqes  + params.cq_entries*sizeof(struct io_uring_cqe);
+	bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap) sq_ring_size = cq_ring_size = max(sq_ring_size, cq_ring_size);
+	
+	u8 *sq_ring = (u8*)mmap(0, sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_ring == MAP_FAILED) { close(fd); return; }
+	
+	u8 *cq_ring = sq_ring;
+	if (!single_mmap) {
+		cq_ring = (u8*)mmap(0, cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq_ring == MAP_FAILED) { munmap(sq_ring, sq_ring_size); close(fd); return; }
+	}
+	
+	void *sqes = mmap(0, params.sq_entries*sizeof(struct io_uring_sqe), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		munmap(sq_ring, sq_ring_size);
+		if (!single_mmap) munmap(cq_ring, cq_ring_size);
+		close(fd);
+		return;
+	}
+	
+	ring->fd       = fd;
+	ring->sq_head  = (u32*)(sq_ring + params.sq_off.head);
+	ring->sq_tail  = (u32*)(sq_ring + params.sq_off.tail);
+	ring->sq_mask  = (u32*)(sq_ring + params.sq_off.ring_mask);
+	ring->sq_array = (u32*)(sq_ring + params.sq_off.array);
+	ring->cq_head  = (u32*)(cq_ring + params.cq_off.head);
+	ring->cq_tail  = (u32*)(cq_ring + params.cq_off.tail);
+	ring->cq_mask  = (u32*)(cq_ring + params.cq_off.ring_mask);
+	ring->cqes     = (struct io_uring_cqe*)(cq_ring + params.cq_off.cqes);
+	ring->sqes     = (struct io_uring_sqe*)sqes;
+	// Never have more in flight than the completion queue can hold so it can't overflow
+	ring->entries  = min(params.sq_entries, params.cq_entries);
+	ring->in_flight = 0;
+	ring->available = true;
+}
+
+// Expects ring->lock to be held
+void linux_io_uring_reap(Linux_Io_Uring *ring) {
+	// The thread in the kernel has to see the completions it's waiting for, or it could sleep
+	// on an empty queue forever.
+	if (ring->reaping) return;
+	
+	u32 head = *ring->cq_head;
+	u32 tail = atomic_load_32(ring->cq_tail, MEMORY_ORDER_ACQUIRE);
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+		Os_Async_Io *io = (Os_Async_Io*)cqe->user_data;
+		s32 res = cqe->res;
+		head += 1;
+		ring->in_flight -= 1;
+		
+		if (res == -EINVAL || res == -EOPNOTSUPP) {
+			// Kernel has a ring but not IORING_OP_READ/WRITE (< 5.6). Stop using it.
+			ring->available = false;
+			linux_async_io_pool_submit(io);
+			continue;
+		}
+		
+		if (res < 0) {
+			io->bytes_transferred = 0;
+			MEMORY_BARRIER;
+			io->status = OS_ASYNC_IO_FAILED;
+		} else {
+			io->bytes_transferred = (u64)res;
+			MEMORY_BARRIER;
+			// Short writes only happen when something is wrong (disk full)
+			io->status = (io->write && (u64)res != io->size) ? OS_ASYNC_IO_FAILED : OS_ASYNC_IO_DONE;
+		}
+	}
+	atomic_store_32(ring->cq_head, head, MEMORY_ORDER_RELEASE);
+}
+
+// Expects ring->lock to be held. The lock is released while blocking, so other threads can
+// keep submitting and polling in the meantime.
+void linux_io_uring_wait_for_completions(Linux_Io_Uring *ring) {
+	if (ring->reaping) {
+		// Someone else is already waiting in the kernel and wakes us when they reaped
+		pthread_cond_wait(&ring->has_completed, &ring->lock);
+		return;
+	}
+	
+	ring->reaping = true;
+	pthread_mutex_unlock(&ring->lock);
+	int err = (int)syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, 0, 0);
+	(void)err; // EINTR is fine, callers loop
+	pthread_mutex_lock(&ring->lock);
+	ring->reaping = false;
+	
+	linux_io_uring_reap(ring);
+	pthread_cond_broadcast(&ring->has_completed);
+}
+
+bool linux_io_uring_submit(Os_Async_Io *io) {
+	Linux_Io_Uring *ring = &linux_io_uring;
+	
+	pthread_mutex_lock(&ring->lock);
+	if (!ring->initted) linux_io_uring_init(ring);
+	
+	if (!ring->available || io->size > LINUX_MAX_SINGLE_TRANSFER) {
+		pthread_mutex_unlock(&ring->lock);
+		return false;
+	}
+	
+	while (ring->in_flight >= ring->entries) linux_io_uring_wait_for_completions(ring);
+	
+	io->_native = true;
+	io->_next = 0;
+	
+	u32 tail = *ring->sq_tail;
+	u32 index = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode    = io->write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd        = io->file;
+	sqe->off       = io->offset;
+	sqe->addr      = (u64)io->buffer;
+	sqe->len       = (u32)io->size;
+	sqe->user_data = (u64)io;
+	ring->sq_array[index] = index;
+	atomic_store_32(ring->sq_tail, tail+1, MEMORY_ORDER_RELEASE);
+	
+	int submitted;
+	do {
+		submitted = (int)syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, 0, 0);
+	} while (submitted < 0 && errno == EINTR);
+	
+	if (submitted != 1) {
+		// Take back the sqe and let the pool deal with it
+		atomic_store_32(ring->sq_tail, tail, MEMORY_ORDER_RELEASE);
+		pthread_mutex_unlock(&ring->lock);
+		return false;
+	}
+	
+	ring->in_flight += 1;
+	pthread_mutex_unlock(&ring->lock);
+	return true;
+}
+
+bool linux_async_io_submit(Os_Async_Io *io, File f, void *buffer, u64 size, u64 offset, bool write) {
+	io->file = f;
+	io->buffer = buffer;
+	io->size = size;
+	io->offset = offset;
+	io->write = write;
+	io->bytes_transferred = 0;
+	
+	if (f == OS_INVALID_FILE || (!buffer && size > 0)) {
+		io->status = OS_ASYNC_IO_FAILED;
+		return false;
+	}
+	
+	io->status = OS_ASYNC_IO_PENDING;
+	
+	if (size == 0) {
+		io->status = OS_ASYNC_IO_DONE;
+		return true;
+	}
+	
+	if (!linux_io_uring_submit(io)) linux_async_io_pool_submit(io);
+	return true;
+}
+
+bool os_file_read_async(Os_Async_Io *io, File f, void *buffer, u64 size, u64 offset) {
+	return linux_async_io_submit(io, f, buffer, size, offset, false);
+}
+bool os_file_write_async(Os_Async_Io *io, File f, void *buffer, u64 size, u64 offset) {
+	return linux_async_io_submit(io, f, buffer, size, offset, true);
+}
+
+bool os_async_io_poll(Os_Async_Io *io) {
+	if (io->status != OS_ASYNC_IO_PENDING) return true;
+	
+	// Nobody else is reaping the ring, so poll does it. Never block though.
+	if (io->_native && pthread_mutex_trylock(&linux_io_uring.lock) == 0) {
+		linux_io_uring_reap(&linux_io_uring);
+		pthread_mutex_unlock(&linux_io_uring.lock);
+	}
+	
+	return io->status != OS_ASYNC_IO_PENDING;
+}
+
+bool os_async_io_wait(Os_Async_Io *io) {
+	while (io->status == OS_ASYNC_IO_PENDING) {
+		if (io->_native) {
+			Linux_Io_Uring *ring = &linux_io_uring;
+			pthread_mutex_lock(&ring->lock);
+			linux_io_uring_reap(ring);
+			// The completion may have been reaped by someone else (or moved to the pool), so
+			// only block in the kernel while this request is still on the ring.
+			if (io->status == OS_ASYNC_IO_PENDING && io->_native && ring->in_flight > 0) {
+				linux_io_uring_wait_for_completions(ring);
+			}
+			pthread_mutex_unlock(&ring->lock);
+		} else {
+			Linux_Async_Io_Pool *pool = &linux_async_io_pool;
+			pthread_mutex_lock(&pool->lock);
+			while (io->status == OS_ASYNC_IO_PENDING) pthread_cond_wait(&pool->has_completed, &pool->lock);
+			pthread_mutex_unlock(&pool->lock);
+		}
+	}
+	return io->status == OS_ASYNC_IO_DONE;
+}
+
+bool os_is_file_s(string path) {
+	struct stat s;
+	if (stat(temp_convert_to_null_terminated_string(path), &s) != 0) return false;
+	return !S_ISDIR(s.st_mode);
+}
+
+bool os_is_directory_s(string path) {
+	struct stat s;
+	if (stat(temp_convert_to_null_terminated_string(path), &s) != 0) return false;
+	return S_ISDIR(s.st_mode);
+}
+
+bool os_is_path_absolute(string path) {
+	return path.count > 0 && path.data[0] == '/';
+}
+
+// Makes path absolute (relative to cwd) and resolves ".", ".." and repeated slashes.
+// This does not touch the file system (other than getcwd) so path does not need to exist.
+string linux_get_normalized_absolute_path(string path, Allocator allocator) {
+	string joined = path;
+	if (!os_is_path_absolute(path)) {
+		char cwd[PATH_MAX];
+		if (!getcwd(cwd, sizeof(cwd))) return null_string;
+		joined = tprint("%cs/%s", cwd, path);
+	}
+
+	u8 *result = (u8*)alloc(allocator, joined.count+1);
+	u64 count = 0;
+
+	u64 i = 0;
+	while (i < joined.count) {
+		while (i < joined.count && joined.data[i] == '/') i += 1;
+
+		u64 start = i;
+		while (i < joined.count && joined.data[i] != '/') i += 1;
+
+		string part = (string){ i-start, joined.data+start };
+
+		if (part.count == 0 || strings_match(part, STR("."))) continue;
+
+		if (strings_match(part, STR(".."))) {
+			while (count > 0 && result[count-1] != '/') count -= 1;
+			if (count > 0) count -= 1;
+			continue;
+		}
+
+		result[count] = '/';
+		count += 1;
+		memcpy(result+count, part.data, part.count);
+		count += part.count;
+	}
+
+	if (count == 0) {
+		result[0] = '/';
+		count = 1;
+	}
+
+	return (string){count, result};
+}
+
+bool os_get_absolute_path(string path, string *result, Allocator allocator) {
+	string abs = linux_get_normalized_absolute_path(path, allocator);
+	if (!abs.data) return false;
+	*result = abs;
+	return true;
+}
+
+bool os_get_relative_path(string from, string to, string *result, Allocator allocator) {
+
+	from = linux_get_normalized_absolute_path(from, get_temporary_allocator());
+	to   = linux_get_normalized_absolute_path(to,   get_temporary_allocator());
+	if (!from.data || !to.data) return false;
+
+	// Relative to a file means relative to the directory it is in
+	// #Speed is_file potentially slow
+	if (os_is_file(from)) {
+		while (from.count > 1 && from.data[from.count-1] != '/') from.count -= 1;
+		if (from.count > 1) from.count -= 1;
+	}
+
+	// Find last separator of the shared prefix
+	u64 common = 0;
+	u64 i = 0;
+	while (i < from.count && i < to.count && from.data[i] == to.data[i]) {
+		i += 1;
+		if (from.data[i-1] == '/') common = i;
+	}
+	if ((i == from.count || from.data[i] == '/') && (i == to.count || to.data[i] == '/')) {
+		common = i;
+	}
+
+	String_Builder builder;
+	string_builder_init(&builder, allocator);
+
+	u64 ups = 0;
+	for (u64 j = common; j < from.count; j++) {
+		if (j == common && from.data[j] != '/') ups += 1;
+		else if (from.data[j] == '/' && j+1 < from.count) ups += 1;
+	}
+
+	if (ups == 0) string_builder_append(&builder, STR("."));
+	for (u64 j = 0; j < ups; j++) {
+		if (j != 0) string_builder_append(&builder, STR("/"));
+		string_builder_append(&builder, STR(".."));
+	}
+
+	string rest = string_view(to, common, to.count-common);
+	if (rest.count > 0 && rest.data[0] == '/') rest = string_view(rest, 1, rest.count-1);
+	if (rest.count > 0) {
+		string_builder_append(&builder, STR("/"));
+		string_builder_append(&builder, rest);
+	}
+
+	*result = string_builder_get_string(builder);
+
+	return true;
+}
+
+bool os_do_paths_match(string a, string b) {
+	string full_a = linux_get_normalized_absolute_path(a, get_temporary_allocator());
+	string full_b = linux_get_normalized_absolute_path(b, get_temporary_allocator());
+
+	if (!full_a.data || !full_b.data) return false;
+
+	return strings_match(full_a, full_b);
+}
+
+// #Cleanup
+// These are not os-specific, why are they here?
+void fprints(File f, string fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	fprint_va_list_buffered(f, fmt, args);
+	va_end(args);
+}
+void fprintf(File f, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	string s;
+	s.data = cast(u8*)fmt;
+	s.count = strlen(fmt);
+	fprint_va_list_buffered(f, s, args);
+	va_end(args);
+}
+
+void os_wait_and_read_stdin(string *result, u64 max_count, Allocator allocator) {
+	char *buffer = talloc(max_count);
+
+	ssize_t n;
+	do { n = read(STDIN_FILENO, buffer, max_count); } while (n < 0 && errno == EINTR);
+
+	if (n < 0) {
+		*result = string_copy(STR("STDIN is not available"), allocator);
+	} else {
+		*result = alloc_string(allocator, (u64)n);
+		memcpy(result->data, buffer, (u64)n);
+	}
+}
+
+
+
+///
+///
+// Queries
+///
+
+void linux_query_stack_bounds() {
+	pthread_attr_t attr;
+	void *addr = 0;
+	size_t size = 0;
+
+	// This is slow for the main thread (it parses /proc/self/maps), so we cache it per thread.
+	if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+		pthread_attr_getstack(&attr, &addr, &size);
+		pthread_attr_destroy(&attr);
+	}
+
+	linux_stack_limit = addr;
+	linux_stack_base  = (u8*)addr + size;
+}
+
+void*
+os_get_stack_base() {
+	if (!linux_stack_base) linux_query_stack_bounds();
+	return linux_stack_base;
+}
+void*
+os_get_stack_limit() {
+	if (!linux_stack_limit) linux_query_stack_bounds();
+	return linux_stack_limit;
+}
+
+u64
+os_get_number_of_logical_processors() {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (u64)n : 1;
+}
+
+///
+///
+// Debug
+///
+#define LINUX_MAX_STACK_FRAMES 64
+string *
+os_get_stack_trace(u64 *trace_count, Allocator allocator) {
+#if CONFIGURATION == DEBUG
+	void *frames[LINUX_MAX_STACK_FRAMES];
+	int frame_count = backtrace(frames, LINUX_MAX_STACK_FRAMES);
+
+	// Symbols are only resolved for exported functions unless you link with -rdynamic
+	char **symbols = backtrace_symbols(frames, frame_count);
+
+	string *stack_strings = (string *)alloc(allocator, LINUX_MAX_STACK_FRAMES * sizeof(string));
+	*trace_count = 0;
+
+	for (int i = 0; i < frame_count; i++) {
+		if (symbols) {
+			stack_strings[*trace_count] = string_copy(STR(symbols[i]), allocator);
+		} else {
+			stack_strings[*trace_count].data = (u8 *)alloc(allocator, 32);
+			stack_strings[*trace_count].count = format_string_to_buffer_va((char *)stack_strings[*trace_count].data, 32, "0x%llx", (u64)frames[i]);
+		}
+		(*trace_count)++;
+	}
+
+	// backtrace_symbols allocates with the crt, which is the only thing we ever use it for
+	if (symbols) free(symbols);
+
+	return stack_strings;
+#else // DEBUG
+
+	*trace_count = 1;
+	string *result = alloc(allocator, 3+sizeof(string));
+	result->count = 3;
+	result->data = (u8*)result+sizeof(string);
+	string s = STR("<0>");
+	memcpy(result->data, s.data, 3);
+	return result;
+
+#endif // NOT DEBUG
+}
+
+bool os_grow_program_memory(u64 new_size) {
+	os_lock_mutex(program_memory_mutex); // #Sync
+	if (program_memory_capacity >= new_size) {
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		return true;
+	}
+
+	bool is_first_time = program_memory == 0;
+
+	if (is_first_time) {
+		// Reserve the whole range up front. PROT_NONE + MAP_NORESERVE doesn't count towards
+		// overcommit, so this is just address space.
+		// If we can't get the full range (ulimit -v, 32-bit), settle for less.
+		u64 reserve_size = align_next(max(PROGRAM_MEMORY_RESERVE_SIZE, new_size), os.granularity);
+		void *aligned_base = (void*)align_next(VIRTUAL_MEMORY_BASE, os.granularity);
+		void *result = MAP_FAILED;
+		while (result == MAP_FAILED && reserve_size >= new_size) {
+			// Kernels older than 4.17 don't know MAP_FIXED_NOREPLACE and treat the base as a hint,
+			// which is fine for us.
+			result = mmap(aligned_base, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+			if (result == MAP_FAILED) {
+				result = mmap(0, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			}
+			if (result == MAP_FAILED) reserve_size = align_next(reserve_size/2, os.granularity);
+		}
+		if (result == MAP_FAILED) {
+			os_unlock_mutex(program_memory_mutex); // #Sync
+			return false;
+		}
+		program_memory = result;
+		program_memory_next = program_memory;
+		program_memory_capacity = 0;
+		program_memory_reserved = reserve_size;
+		
+		if (os.large_page_size) {
+			// Huge pages only back ranges that are aligned to the huge page size
+			u8 *aligned = (u8*)align_next((u64)program_memory, os.large_page_size);
+			program_memory_reserved -= (u64)(aligned - (u8*)program_memory);
+			program_memory_reserved = align_previous(program_memory_reserved, os.large_page_size);
+			program_memory = aligned;
+			program_memory_next = program_memory;
+			
+			if (madvise(program_memory, program_memory_reserved, MADV_HUGEPAGE) != 0) {
+				os_write_string_to_stdout(STR("ENABLE_LARGE_PAGES: madvise(MADV_HUGEPAGE) failed, using normal pages.\n"));
+				os.large_page_size = 0;
+			}
+		}
+	}
+	
+	if (new_size > program_memory_reserved) {
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		return false;
+	}
+
+	void* tail = (u8*)program_memory + program_memory_capacity;
+	assert((u64)tail % os.granularity == 0, "Tail is not aligned to granularity!");
+	
+	u64 amount_to_commit = align_next(new_size-program_memory_capacity, os.large_page_size ? os.large_page_size : os.granularity);
+	amount_to_commit = min(amount_to_commit, program_memory_reserved-program_memory_capacity);
+	
+	// Linux commits lazily on first touch anyway, so this just makes the pages accessible
+	if (mprotect(tail, amount_to_commit, PROT_READ | PROT_WRITE) != 0) {
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		return false;
+	}
+#if CONFIGURATION == DEBUG
+	memset(tail, 0xBA, amount_to_commit);
+	mprotect(tail, amount_to_commit, PROT_NONE);
+#endif
+
+	program_memory_capacity += amount_to_commit;
+
+	char size_str[32];
+	s64_to_null_terminated_string(program_memory_capacity/1024, size_str, 10);
+
+	os_write_string_to_stdout(STR("Program memory grew to "));
+	os_write_string_to_stdout(STR(size_str));
+	os_write_string_to_stdout(STR(" kb\n"));
+	os_unlock_mutex(program_memory_mutex); // #Sync
+	return true;
+}
+
+void*
+os_reserve_next_memory_pages(u64 size) {
+	assert(size % os.page_size == 0, "size was not aligned to page size in os_reserve_next_memory_pages");
+
+	os_lock_mutex(program_memory_mutex); // #Sync
+	void *p = program_memory_next;
+	program_memory_next = (u8*)program_memory_next + size;
+	u64 minimum_size = (u64)program_memory_next - (u64)program_memory;
+	os_unlock_mutex(program_memory_mutex); // #Sync
+
+	// Commit what's needed, nothing more. Growth can only fail if we run past the reserved range.
+	bool ok = os_grow_program_memory(minimum_size);
+	assert(ok, "Could not commit program memory up to %d bytes (%d reserved). Either we're out of memory or PROGRAM_MEMORY_RESERVE_SIZE is too small.", minimum_size, program_memory_reserved);
+
+	return p;
+}
+
+void*
+os_reserve_next_memory_pages_decommitted(u64 size) {
+	assert(size % os.page_size == 0, "size was not aligned to page size in os_reserve_next_memory_pages_decommitted");
+
+	os_lock_mutex(program_memory_mutex); // #Sync
+	u8 *p = (u8*)program_memory_next;
+	u8 *end = p + size;
+	u8 *committed_end = (u8*)program_memory + program_memory_capacity;
+	if (end > committed_end) {
+		// Skip ahead to the next granularity boundary so everything below the committed tail
+		// stays either committed or handed out.
+		u8 *aligned_end = (u8*)align_next((u64)end, os.large_page_size ? os.large_page_size : os.granularity);
+		u64 new_capacity = (u64)(aligned_end - (u8*)program_memory);
+		bool ok = new_capacity <= program_memory_reserved;
+		assert(ok, "Could not reserve program memory up to %d bytes (%d reserved). PROGRAM_MEMORY_RESERVE_SIZE is too small.", new_capacity, program_memory_reserved);
+		program_memory_capacity = new_capacity;
+		program_memory_next = aligned_end;
+	} else {
+		program_memory_next = end;
+	}
+	os_unlock_mutex(program_memory_mutex); // #Sync
+	
+	// Part of the range may already have been committed with the tail
+	if (committed_end > p) os_decommit_program_memory_pages(p, (u64)(min(end, committed_end) - p));
+
+	return p;
+}
+
+void
+os_decommit_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	assert(is_pointer_in_program_memory(start) && is_pointer_in_program_memory((u8*)start+size-1), "Tried to decommit memory outside of program memory");
+	
+	int err = madvise(start, size, MADV_DONTNEED);
+	assert(err == 0, "madvise failed with error %d", errno);
+	err = mprotect(start, size, PROT_NONE);
+	assert(err == 0, "mprotect failed with error %d", errno);
+}
+
+bool
+os_recommit_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When recommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When recommitting memory pages, the size must be aligned to page_size");
+	assert(is_pointer_in_program_memory(start) && is_pointer_in_program_memory((u8*)start+size-1), "Tried to recommit memory outside of program memory");
+	
+	// MADV_DONTNEED already dropped the pages, they come back zeroed when touched
+	return mprotect(start, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void
+os_unlock_program_memory_pages(void *start, u64 size) {
+#if CONFIGURATION == DEBUG
+	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
+	// Unlike VirtualProtect, mprotect is fine with ranges spanning multiple mappings
+	int err = mprotect(start, size, PROT_READ | PROT_WRITE);
+	assert(err == 0, "mprotect failed with error %d", errno);
+#endif
+}
+
+void
+os_lock_program_memory_pages(void *start, u64 size) {
+#if CONFIGURATION == DEBUG
+	assert((u64)start % os.page_size == 0, "When locking memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When locking memory pages, the size must be aligned to page_size");
+	int err = mprotect(start, size, PROT_NONE);
+	assert(err == 0, "mprotect failed with error %d", errno);
+#endif
+}
+
+///
+///
+// Mouse pointer
+// (No mouse in headless)
+
+void ogb_instance
+os_set_mouse_pointer_standard(Mouse_Pointer_Kind kind) {
+}
+void ogb_instance
+os_set_mouse_pointer_custom(Custom_Mouse_Pointer p) {
+}
+
+Custom_Mouse_Pointer ogb_instance
+os_make_custom_mouse_pointer(void *image, int width, int height, int hotspot_x, int hotspot_y) {
+	return 0;
+}
+
+Custom_Mouse_Pointer ogb_instance
+os_make_custom_mouse_pointer_from_file(string path, int hotspot_x, int hotspot_y, Allocator allocator) {
+	return 0;
+}
+
+void set_gamepad_vibration(float32 left, float32 right) {
+}
+void set_specific_gamepad_vibration(u64 gamepad_index, float32 left, float32 right) {
+}
+
+void os_update() {
+	has_os_update_been_called_at_all = true;
+	
+	heap_trim_if_needed();
+	
+#if ENABLE_PROFILING
+	heap_report_stats_to_profiler();
+	spinlock_report_stats_to_profiler(&_profiler_lock, STR("profiler lock"));
+#endif
+}
@@ -359,9 +359,48 @@ win32_audio_thread(Thread *t);
 void 
 win32_audio_poll_default_device_thread(Thread *t);
 
-volatile bool win32_has_audio_thread_started = false;
+Event win32_audio_thread_started;
 #endif /* OOGABOOGA_HEADLESS */
 
+#if ENABLE_LARGE_PAGES
+typedef BOOL (WINAPI *Win32_Open_Process_Token_Proc)(HANDLE, DWORD, PHANDLE);
+typedef BOOL (WINAPI *Win32_Lookup_Privilege_Value_Proc)(LPCWSTR, LPCWSTR, PLUID);
+typedef BOOL (WINAPI *Win32_Adjust_Token_Privileges_Proc)(HANDLE, BOOL, PTOKEN_PRIVILEGES, DWORD, PTOKEN_PRIVILEGES, PDWORD);
+
+// Large pages need SeLockMemoryPrivilege ("Lock pages in memory" in the local security policy).
+// Returns the large page size, or 0 if we can't use them.
+u64 win32_try_enable_large_pages() {
+	u64 large_page_size = (u64)GetLargePageMinimum();
+	if (large_page_size == 0) return 0;
+	
+	// We don't link with advapi32
+	HMODULE advapi = LoadLibraryW(L"advapi32.dll");
+	if (!advapi) return 0;
+	Win32_Open_Process_Token_Proc open_process_token = (Win32_Open_Process_Token_Proc)GetProcAddress(advapi, "OpenProcessToken");
+	Win32_Lookup_Privilege_Value_Proc lookup_privilege_value = (Win32_Lookup_Privilege_Value_Proc)GetProcAddress(advapi, "LookupPrivilegeValueW");
+	Win32_Adjust_Token_Privileges_Proc adjust_token_privileges = (Win32_Adjust_Token_Privileges_Proc)GetProcAddress(advapi, "AdjustTokenPrivileges");
+	if (!open_process_token || !lookup_privilege_value || !adjust_token_privileges) return 0;
+	
+	HANDLE token;
+	if (!open_process_token(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return 0;
+	
+	TOKEN_PRIVILEGES privileges = ZERO(TOKEN_PRIVILEGES);
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool ok = lookup_privilege_value(0, L"SeLockMemoryPrivilege", &privileges.Privileges[0].Luid);
+	
+	// AdjustTokenPrivileges succeeds even when the privilege isn't held, so check last error
+	if (ok) ok = adjust_token_privileges(token, FALSE, &privileges, 0, 0, 0) && GetLastError() == ERROR_SUCCESS;
+	CloseHandle(token);
+	
+	if (!ok) {
+		os_write_string_to_stdout(STR("ENABLE_LARGE_PAGES: Missing SeLockMemoryPrivilege, using normal pages.\n"));
+		return 0;
+	}
+	return large_page_size;
+}
+#endif // ENABLE_LARGE_PAGES
+
 void os_init(u64 program_memory_capacity) {
 	
     // #Volatile
@@ -416,12 +455,18 @@ void os_init(u64 program_memory_capacity) {
     }
 
 
+	os.large_page_size = 0;
+#if ENABLE_LARGE_PAGES
+	os.large_page_size = win32_try_enable_large_pages();
+#endif
+
 	program_memory_mutex = os_make_mutex();
 	os_grow_program_memory(program_memory_capacity);
 	
 	heap_init();
 	
 	QueryPerformanceCounter(&win32_counter_at_start);
+	os.cycles_per_second = os_measure_cycles_per_second();
 	
 	
 #ifndef OOGABOOGA_HEADLESS
@@ -450,7 +495,7 @@ void os_init(u64 program_memory_capacity) {
     os_thread_start(&audio_thread);
     os_thread_start(&audio_poll_default_device_thread);
     
-    while (!win32_has_audio_thread_started) { os_yield_thread(); }
+    event_wait(&win32_audio_thread_started);
 #endif /* NOT OOGABOOGA_HEADLESS */
 
 
@@ -519,47 +564,6 @@ void win32_query_monitors() {
 	}
 }
 
-void s64_to_null_terminated_string_reverse(char str[], int length)
-{
-    int start = 0;
-    int end = length - 1;
-    while (start < end) {
-        char temp = str[start];
-        str[start] = str[end];
-        str[end] = temp;
-        end--;
-        start++;
-    }
-}
-
-void s64_to_null_terminated_string(s64 num, char* str, int base)
-{
-    int i = 0;
-    bool neg = false;
- 
-    if (num == 0) {
-        str[i++] = '0';
-        str[i] = '\0';
-        return;
-    }
- 
-    if (num < 0 && base == 10) {
-        neg = true;
-        num = -num;
-    }
- 
-    while (num != 0) {
-        int rem = num % base;
-        str[i++] = (rem > 9) ? (rem - 10) + 'a' : rem + '0';
-        num = num / base;
-    }
- 
-    if (neg)
-        str[i++] = '-';
- 
-    str[i] = '\0';
-    s64_to_null_terminated_string_reverse(str, i);
-}
 
 
 
@@ -592,7 +596,8 @@ DWORD WINAPI win32_thread_invoker(LPVOID param) {
 	
 	t->proc(t);
 	
-	heap_dealloc(temporary_storage);
+	temporary_storage_release();
+	heap_thread_cache_release();
 	
 	return 0;
 }
@@ -697,6 +702,19 @@ void os_unlock_mutex(Mutex_Handle m) {
 	assert(result, "Unlock mutex 0x%x failed with error %d", m, GetLastError());
 }
 
+///
+// Wait on address
+
+void os_wait_on_address(volatile u32 *address, u32 expected) {
+	WaitOnAddress(address, &expected, sizeof(u32), INFINITE);
+}
+void os_wake_one_on_address(volatile u32 *address) {
+	WakeByAddressSingle((PVOID)address);
+}
+void os_wake_all_on_address(volatile u32 *address) {
+	WakeByAddressAll((PVOID)address);
+}
+
 
 void os_sleep(u32 ms) {
     Sleep(ms);
@@ -1007,6 +1025,172 @@ bool os_read_entire_file_s(string path, string *result, Allocator allocator) {
     return res;
 }
 
+bool os_file_map_s(string path, string *result) {
+	u16 *path_wide = temp_win32_fixed_utf8_to_null_terminated_wide(path);
+	HANDLE file = CreateFileW(path_wide, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	
+	// The view keeps both the mapping object and the file alive, so we can close the handles right away
+	HANDLE mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+	CloseHandle(file);
+	if (!mapping) return false;
+	
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!view) return false;
+	
+	result->data = (u8*)view;
+	result->count = (u64)file_size.QuadPart;
+	return true;
+}
+
+void os_file_unmap(string mapped) {
+	if (!mapped.data) return;
+	UnmapViewOfFile(mapped.data);
+}
+
+///
+// Async file IO
+// Our file handles aren't opened with FILE_FLAG_OVERLAPPED, so instead of IOCP we hand requests
+// to a few threads that do a blocking ReadFile/WriteFile at the requested offset.
+
+typedef struct Win32_Async_Io_Pool {
+	bool started;
+	Os_Async_Io *first;
+	Os_Async_Io *last;
+	Thread threads[OS_ASYNC_IO_THREAD_COUNT];
+	SRWLOCK lock;
+	CONDITION_VARIABLE has_work;
+	CONDITION_VARIABLE has_completed;
+} Win32_Async_Io_Pool;
+
+// #Global
+Win32_Async_Io_Pool win32_async_io_pool = {
+	.lock = SRWLOCK_INIT,
+	.has_work = CONDITION_VARIABLE_INIT,
+	.has_completed = CONDITION_VARIABLE_INIT
+};
+
+void win32_async_io_execute_blocking(Os_Async_Io *io) {
+	u64 done = 0;
+	bool ok = true;
+	while (done < io->size) {
+		u64 offset = io->offset + done;
+		OVERLAPPED overlapped = ZERO(OVERLAPPED);
+		overlapped.Offset     = (DWORD)(offset & 0xFFFFFFFF);
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		
+		DWORD to_transfer = (DWORD)min(io->size - done, (u64)0xFFFFFFFF);
+		DWORD transferred = 0;
+		BOOL result;
+		if (io->write) result = WriteFile(io->file, (u8*)io->buffer + done, to_transfer, &transferred, &overlapped);
+		else           result = ReadFile (io->file, (u8*)io->buffer + done, to_transfer, &transferred, &overlapped);
+		
+		if (!result) {
+			// Reading past the end of the file is not an error, we just stop there
+			if (!io->write && GetLastError() == ERROR_HANDLE_EOF) break;
+			ok = false;
+			break;
+		}
+		if (transferred == 0) {
+			if (io->write) ok = false;
+			break;
+		}
+		done += transferred;
+	}
+	io->bytes_transferred = done;
+	io->status = ok ? OS_ASYNC_IO_DONE : OS_ASYNC_IO_FAILED;
+}
+
+void win32_async_io_worker(Thread *t) {
+	Win32_Async_Io_Pool *pool = &win32_async_io_pool;
+	while (true) {
+		AcquireSRWLockExclusive(&pool->lock);
+		while (!pool->first) SleepConditionVariableSRW(&pool->has_work, &pool->lock, INFINITE, 0);
+		Os_Async_Io *io = pool->first;
+		pool->first = io->_next;
+		if (!pool->first) pool->last = 0;
+		ReleaseSRWLockExclusive(&pool->lock);
+		
+		// Status is set under the lock so waiters can't miss the wake
+		Os_Async_Io result = *io;
+		win32_async_io_execute_blocking(&result);
+		
+		AcquireSRWLockExclusive(&pool->lock);
+		io->bytes_transferred = result.bytes_transferred;
+		io->status = result.status;
+		WakeAllConditionVariable(&pool->has_completed);
+		ReleaseSRWLockExclusive(&pool->lock);
+	}
+}
+
+bool win32_async_io_submit(Os_Async_Io *io, File f, void *buffer, u64 size, u64 offset, bool write) {
+	io->file = f;
+	io->buffer = buffer;
+	io->size = size;
+	io->offset = offset;
+	io->write = write;
+	io->bytes_transferred = 0;
+	io->_native = false;
+	io->_next = 0;
+	
+	if (f == OS_INVALID_FILE || (!buffer && size > 0)) {
+		io->status = OS_ASYNC_IO_FAILED;
+		return false;
+	}
+	
+	if (size == 0) {
+		io->status = OS_ASYNC_IO_DONE;
+		return true;
+	}
+	
+	io->status = OS_ASYNC_IO_PENDING;
+	
+	Win32_Async_Io_Pool *pool = &win32_async_io_pool;
+	AcquireSRWLockExclusive(&pool->lock);
+	if (!pool->started) {
+		for (u64 i = 0; i < OS_ASYNC_IO_THREAD_COUNT; i++) {
+			os_thread_init(&pool->threads[i], win32_async_io_worker);
+			os_thread_start(&pool->threads[i]);
+		}
+		pool->started = true;
+	}
+	if (pool->last) pool->last->_next = io;
+	else            pool->first = io;
+	pool->last = io;
+	WakeConditionVariable(&pool->has_work);
+	ReleaseSRWLockExclusive(&pool->lock);
+	
+	return true;
+}
+
+bool os_file_read_async(Os_Async_Io *io, File f, void *buffer, u64 size, u64 offset) {
+	return win32_async_io_submit(io, f, buffer, size, offset, false);
+}
+bool os_file_write_async(Os_Async_Io *io, File f, void *buffer, u64 size, u64 offset) {
+	return win32_async_io_submit(io, f, buffer, size, offset, true);
+}
+
+bool os_async_io_poll(Os_Async_Io *io) {
+	return io->status != OS_ASYNC_IO_PENDING;
+}
+
+bool os_async_io_wait(Os_Async_Io *io) {
+	if (io->status == OS_ASYNC_IO_PENDING) {
+		Win32_Async_Io_Pool *pool = &win32_async_io_pool;
+		AcquireSRWLockExclusive(&pool->lock);
+		while (io->status == OS_ASYNC_IO_PENDING) SleepConditionVariableSRW(&pool->has_completed, &pool->lock, INFINITE, 0);
+		ReleaseSRWLockExclusive(&pool->lock);
+	}
+	return io->status == OS_ASYNC_IO_DONE;
+}
+
 bool os_is_file_s(string path) {
 	u16 *path_wide = temp_win32_fixed_utf8_to_null_terminated_wide(path);
 	assert(path_wide, "Invalid path string");
@@ -1284,6 +1468,10 @@ os_get_stack_trace(u64 *trace_count, Allocator allocator) {
 #endif // NOT DEBUG
 }
 
+// Program memory below this is MEM_LARGE_PAGES (the initial program memory with ENABLE_LARGE_PAGES).
+// Those pages can't be decommitted or have their protection changed.
+u8 *win32_large_page_memory_end = 0;
+
 bool os_grow_program_memory(u64 new_size) {
 	os_lock_mutex(program_memory_mutex); // #Sync
 	if (program_memory_capacity >= new_size) {
@@ -1291,54 +1479,93 @@ bool os_grow_program_memory(u64 new_size) {
 		return true;
 	}
 
-	
-	
 	bool is_first_time = program_memory == 0;
 	
-	if (is_first_time) {
-		// It's fine to allocate a region with size only aligned to page size, BUT,
-		// since we allocate each region with the base address at the tail of the
-		// previous region, then that tail needs to be aligned to granularity, which
-		// will be true if the size is also always aligned to granularity.
-		u64 aligned_size = align_next(new_size, os.granularity);
-		void *aligned_base = (void*)align_next(VIRTUAL_MEMORY_BASE, os.granularity);
-
-		program_memory = VirtualAlloc(aligned_base, aligned_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-		if (program_memory == 0) { 
-			os_unlock_mutex(program_memory_mutex); // #Sync
-			return false;
-		}
-		program_memory_next = program_memory;
-		program_memory_capacity = aligned_size;
-#if CONFIGURATION == DEBUG
-		memset(program_memory, 0xBA, program_memory_capacity);
-        DWORD _ = PAGE_READWRITE;
-		VirtualProtect(aligned_base, aligned_size, PAGE_NOACCESS, &_);
-#endif
-	} else {
-		void* tail = (u8*)program_memory + program_memory_capacity;
+#if ENABLE_LARGE_PAGES
+	if (is_first_time && os.large_page_size) {
+		// Large pages can't be committed into an existing reservation, they have to be reserved
+		// and committed in one go. So the initial program memory is one large page region, and
+		// the rest of the range is reserved right after it like usual. Growth commits normal
+		// pages inside that reservation, so nothing else can ever end up in our range.
+		u64 large_size = align_next(new_size, os.large_page_size);
+		void *aligned_base = (void*)align_next(VIRTUAL_MEMORY_BASE, os.large_page_size);
+		void *large = VirtualAlloc(aligned_base, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (large == 0) large = VirtualAlloc(0, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
 		
-		assert((u64)program_memory_capacity % os.granularity == 0, "program_memory_capacity is not aligned to granularity!");
-		assert((u64)tail % os.granularity == 0, "Tail is not aligned to granularity!");
+		u64 rest_size = 0;
+		if (large) {
+			rest_size = align_next(max(PROGRAM_MEMORY_RESERVE_SIZE, large_size)-large_size, os.granularity);
+			void *rest = 0;
+			while (rest == 0 && rest_size > 0) {
+				rest = VirtualAlloc((u8*)large+large_size, rest_size, MEM_RESERVE, PAGE_NOACCESS);
+				if (rest == 0) rest_size = rest_size/2 >= os.granularity ? align_next(rest_size/2, os.granularity) : 0;
+			}
+		}
 		
-		u64 amount_to_allocate = align_next(new_size-program_memory_capacity, os.granularity);
+		if (large) {
+			program_memory = large;
+			program_memory_next = program_memory;
+			program_memory_capacity = large_size;
+			program_memory_reserved = large_size + rest_size;
+			win32_large_page_memory_end = (u8*)large + large_size;
+			// No page locking in debug here, large pages can't change protection.
+			
+			os_unlock_mutex(program_memory_mutex); // #Sync
+			return true;
+		}
 		
-		// Just keep allocating at the tail of the current chunk
-		void* result = VirtualAlloc(tail, amount_to_allocate, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-#if CONFIGURATION == DEBUG
-		memset(result, 0xBA, amount_to_allocate);
-		DWORD _ = PAGE_READWRITE;
-		VirtualProtect(tail, amount_to_allocate, PAGE_NOACCESS, &_);
-#endif
+		// Physical memory too fragmented for that many large pages
+		os_write_string_to_stdout(STR("ENABLE_LARGE_PAGES: Could not allocate large pages, using normal pages.\n"));
+		os.large_page_size = 0;
+	}
+#endif // ENABLE_LARGE_PAGES
+	
+	if (is_first_time) {
+		// Reserve the whole range up front, this is only address space and costs nothing.
+		// If we can't get the full range, settle for less.
+		u64 reserve_size = align_next(max(PROGRAM_MEMORY_RESERVE_SIZE, new_size), os.granularity);
+		void *aligned_base = (void*)align_next(VIRTUAL_MEMORY_BASE, os.granularity);
+		void *result = 0;
+		while (result == 0 && reserve_size >= new_size) {
+			result = VirtualAlloc(aligned_base, reserve_size, MEM_RESERVE, PAGE_NOACCESS);
+			if (result == 0) result = VirtualAlloc(0, reserve_size, MEM_RESERVE, PAGE_NOACCESS);
+			if (result == 0) reserve_size = align_next(reserve_size/2, os.granularity);
+		}
 		if (result == 0) { 
 			os_unlock_mutex(program_memory_mutex); // #Sync
 			return false;
 		}
-		assert(tail == result, "It seems tail is not aligned properly. o nein");
-		assert((u64)program_memory_capacity % os.granularity == 0, "program_memory_capacity is not aligned to granularity!");
-		
-		program_memory_capacity += amount_to_allocate;
+		program_memory = result;
+		program_memory_next = program_memory;
+		program_memory_capacity = 0;
+		program_memory_reserved = reserve_size;
+	}
+	
+	if (new_size > program_memory_reserved) {
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		return false;
+	}
+	
+	void* tail = (u8*)program_memory + program_memory_capacity;
+	assert((u64)tail % os.granularity == 0, "Tail is not aligned to granularity!");
+	
+	u64 amount_to_commit = align_next(new_size-program_memory_capacity, os.granularity);
+	amount_to_commit = min(amount_to_commit, program_memory_reserved-program_memory_capacity);
+	
+	// Committing inside our own reservation can't collide with anything else
+	void* result = VirtualAlloc(tail, amount_to_commit, MEM_COMMIT, PAGE_READWRITE);
+	if (result == 0) { 
+		os_unlock_mutex(program_memory_mutex); // #Sync
+		return false;
 	}
+	assert(tail == result, "VirtualAlloc committed at the wrong address. o nein");
+#if CONFIGURATION == DEBUG
+	memset(result, 0xBA, amount_to_commit);
+	DWORD _ = PAGE_READWRITE;
+	VirtualProtect(tail, amount_to_commit, PAGE_NOACCESS, &_);
+#endif
+	
+	program_memory_capacity += amount_to_commit;
 
 	
 	char size_str[32];
@@ -1355,41 +1582,117 @@ void*
 os_reserve_next_memory_pages(u64 size) {
 	assert(size % os.page_size == 0, "size was not aligned to page size in os_reserve_next_memory_pages");
 
+	os_lock_mutex(program_memory_mutex); // #Sync
 	void *p = program_memory_next;
-	
 	program_memory_next = (u8*)program_memory_next + size;
+	u64 minimum_size = (u64)program_memory_next - (u64)program_memory;
+	os_unlock_mutex(program_memory_mutex); // #Sync
 	
-	void *program_tail = (u8*)program_memory + program_memory_capacity;
+	// Commit what's needed, nothing more. Growth can only fail if we run past the reserved range.
+	bool ok = os_grow_program_memory(minimum_size);
+	assert(ok, "Could not commit program memory up to %d bytes (%d reserved). Either we're out of memory or PROGRAM_MEMORY_RESERVE_SIZE is too small.", minimum_size, program_memory_reserved);
 	
-	if ((u64)program_memory_next > (u64)program_tail) {
-		u64 minimum_size = ((u64)program_memory_next) - (u64)program_memory + 1;
-		u64 new_program_size = get_next_power_of_two(minimum_size);
-		
-		const u64 ATTEMPTS = 1000;
-		for (u64 i = 0; i <= ATTEMPTS; i++) {
-			if (program_memory_capacity >= new_program_size) break; // Another thread might have resized already, causing it to fail here.
-			assert(i < ATTEMPTS, "OS is not letting us allocate more memory. Maybe we are out of memory? You sure must be using a lot of memory then.");
-			if (os_grow_program_memory(new_program_size))
-				break;
-		}
+	return p;
+}
+
+void*
+os_reserve_next_memory_pages_decommitted(u64 size) {
+	assert(size % os.page_size == 0, "size was not aligned to page size in os_reserve_next_memory_pages_decommitted");
+
+	os_lock_mutex(program_memory_mutex); // #Sync
+	u8 *p = (u8*)program_memory_next;
+	u8 *end = p + size;
+	u8 *committed_end = (u8*)program_memory + program_memory_capacity;
+	if (end > committed_end) {
+		// Skip ahead to the next granularity boundary so everything below the committed tail
+		// stays either committed or handed out.
+		u8 *aligned_end = (u8*)align_next((u64)end, os.granularity);
+		u64 new_capacity = (u64)(aligned_end - (u8*)program_memory);
+		bool ok = new_capacity <= program_memory_reserved;
+		assert(ok, "Could not reserve program memory up to %d bytes (%d reserved). PROGRAM_MEMORY_RESERVE_SIZE is too small.", new_capacity, program_memory_reserved);
+		program_memory_capacity = new_capacity;
+		program_memory_next = aligned_end;
+	} else {
+		program_memory_next = end;
 	}
+	os_unlock_mutex(program_memory_mutex); // #Sync
 	
+	// Part of the range may already have been committed with the tail
+	if (committed_end > p) os_decommit_program_memory_pages(p, (u64)(min(end, committed_end) - p));
+
 	return p;
 }
 
+void
+os_decommit_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	assert(is_pointer_in_program_memory(start) && is_pointer_in_program_memory((u8*)start+size-1), "Tried to decommit memory outside of program memory");
+	
+	// Large pages are locked in physical memory and can't be decommitted.
+	// The memory stays readable & writable, so recommit just has to zero it.
+	u8 *end = (u8*)start+size;
+	if (end <= win32_large_page_memory_end) return;
+	if ((u8*)start < win32_large_page_memory_end) {
+		size = (u64)(end-win32_large_page_memory_end);
+		start = win32_large_page_memory_end;
+	}
+	
+	BOOL ok = VirtualFree(start, size, MEM_DECOMMIT);
+	assert(ok, "VirtualFree Failed with error %d", GetLastError());
+}
+
+bool
+os_recommit_program_memory_pages(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When recommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When recommitting memory pages, the size must be aligned to page_size");
+	assert(is_pointer_in_program_memory(start) && is_pointer_in_program_memory((u8*)start+size-1), "Tried to recommit memory outside of program memory");
+	
+	u8 *end = (u8*)start+size;
+	if ((u8*)start < win32_large_page_memory_end) {
+		u8 *large_end = min(end, win32_large_page_memory_end);
+		memset(start, 0, (u64)(large_end-(u8*)start));
+		if (large_end == end) return true;
+		size = (u64)(end-large_end);
+		start = large_end;
+	}
+	
+	// Freshly committed pages are zeroed by the OS
+	return VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE) == start;
+}
+
+// The range may span multiple VirtualAlloc regions, and VirtualProtect can't cross those.
+// So we protect one run of pages with the same allocation and protection at a time, which
+// is usually the whole range in one call. Decommitted pages (heap_trim) are skipped, they're
+// inaccessible anyways and get their protection when they're recommitted. So are large pages,
+// which can't change protection.
+void
+win32_protect_program_memory_pages(void *start, u64 size, DWORD protect) {
+	u8 *p = max((u8*)start, win32_large_page_memory_end);
+	u8 *end = (u8*)start+size;
+	while (p < end) {
+		MEMORY_BASIC_INFORMATION info;
+		SIZE_T info_size = VirtualQuery(p, &info, sizeof(info));
+		assert(info_size == sizeof(info), "VirtualQuery Failed with error %d", GetLastError());
+		
+		u8 *run_end = (u8*)info.BaseAddress + info.RegionSize;
+		if (run_end > end) run_end = end;
+		
+		if (info.State == MEM_COMMIT && info.Protect != protect) {
+			DWORD old_protect = 0;
+			BOOL ok = VirtualProtect(p, (SIZE_T)(run_end-p), protect, &old_protect);
+			assert(ok, "VirtualProtect Failed with error %d", GetLastError());
+		}
+		p = run_end;
+	}
+}
+
 void
 os_unlock_program_memory_pages(void *start, u64 size) {
 #if CONFIGURATION == DEBUG
 	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
 	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
-	// This memory may be across multiple allocated regions so we need to do this one page at a time.
-	// Probably super slow but this shouldn't happen often at all + it's only in debug.
-	// - Charlie M 28th July 2024
-	for (u8 *p = (u8*)start; p < (u8*)start+size; p += os.page_size) {
-		DWORD old_protect = PAGE_NOACCESS;
-		BOOL ok = VirtualProtect(p, os.page_size, PAGE_READWRITE, &old_protect);
-		assert(ok, "VirtualProtect Failed with error %d", GetLastError());
-	}
+	win32_protect_program_memory_pages(start, size, PAGE_READWRITE);
 #endif
 }
 
@@ -1398,14 +1701,7 @@ os_lock_program_memory_pages(void *start, u64 size) {
 #if CONFIGURATION == DEBUG
 	assert((u64)start % os.page_size == 0, "When unlocking memory pages, the start address must be the start of a page");
 	assert(size       % os.page_size == 0, "When unlocking memory pages, the size must be aligned to page_size");
-	// This memory may be across multiple allocated regions so we need to do this one page at a time.
-	// Probably super slow but this shouldn't happen often at all + it's only in debug.
-	// - Charlie M 28th July 2024
-	for (u8 *p = (u8*)start; p < (u8*)start+size; p += os.page_size) {
-		DWORD old_protect = PAGE_READWRITE;
-		BOOL ok = VirtualProtect(p, os.page_size, PAGE_NOACCESS, &old_protect);
-		assert(ok, "VirtualProtect Failed with error %d", GetLastError());
-	}
+	win32_protect_program_memory_pages(start, size, PAGE_NOACCESS);
 #endif
 }
 
@@ -1510,7 +1806,7 @@ os_make_custom_mouse_pointer_from_file(string path, int hotspot_x, int hotspot_y
     third_party_allocator = allocator;
     
     string png;
-    bool ok = os_read_entire_file(path, &png, allocator);
+    bool ok = os_file_map(path, &png);
     
     if (!ok) return 0;
     
@@ -1524,13 +1820,13 @@ os_make_custom_mouse_pointer_from_file(string path, int hotspot_x, int hotspot_y
     );
     
     if (!stb_data) {
-        dealloc_string(allocator, png);
+        os_file_unmap(png);
         return 0;
     }
     
     Custom_Mouse_Pointer p = os_make_custom_mouse_pointer(stb_data, width, height, hotspot_x, hotspot_y);
     
-    dealloc_string(allocator, png);
+    os_file_unmap(png);
     stbi_image_free(stb_data);
     third_party_allocator = ZERO(Allocator);
     
@@ -1557,6 +1853,7 @@ Audio_Format audio_output_format; // For use when loading audio sources
 IMMDevice* win32_audio_device = 0;
 IMMDeviceEnumerator* win32_device_enumerator = 0;
 Mutex audio_init_mutex;
+HANDLE win32_audio_buffer_event = 0; // Signaled by the device every time it wants more frames
 
 void
 win32_audio_init() {
@@ -1647,7 +1944,7 @@ win32_audio_init() {
 	hr = IAudioClient_Initialize(
     	win32_audio_client, 
     	AUDCLNT_SHAREMODE_SHARED, 
-    	0, 
+    	AUDCLNT_STREAMFLAGS_EVENTCALLBACK, 
     	BUFFER_DURATION_MS*10000ll, 0, 
     	output_format, 0
 	);
@@ -1659,6 +1956,10 @@ win32_audio_init() {
 	}
     win32_check_hr(hr);
 	
+    if (!win32_audio_buffer_event) win32_audio_buffer_event = CreateEventW(0, FALSE, FALSE, 0);
+    hr = IAudioClient_SetEventHandle(win32_audio_client, win32_audio_buffer_event);
+    win32_check_hr(hr);
+	
     hr = IAudioClient_GetService(win32_audio_client, &IID_IAudioRenderClient, (void**)&win32_render_client);
     win32_check_hr(hr);
     
@@ -1682,9 +1983,7 @@ win32_audio_init() {
 
 void
 win32_audio_poll_default_device_thread(Thread *t) {
-	while (!win32_has_audio_thread_started) {
-		os_yield_thread();
-	}
+	event_wait(&win32_audio_thread_started);
 
 	while (!window.should_close) {
 		while (win32_audio_deactivated) {
@@ -1727,7 +2026,7 @@ win32_audio_thread(Thread *t) {
 	mutex_init(&audio_init_mutex);
 	
     mutex_acquire_or_wait(&audio_init_mutex);
-    win32_has_audio_thread_started = true;
+    event_set(&win32_audio_thread_started);
 	win32_audio_init();
     mutex_release(&audio_init_mutex);
 	
@@ -1739,6 +2038,8 @@ win32_audio_thread(Thread *t) {
     
 	while (!window.should_close) tm_scope("Audio update") {
 		if (win32_audio_deactivated) tm_scope("Retry audio device") {
+			// Keep up with player changes and source destroys even without a device
+			audio_player_apply_commands();
 			os_sleep(100);
 			mutex_acquire_or_wait(&audio_init_mutex);
 			win32_audio_init();
@@ -1770,9 +2071,9 @@ win32_audio_thread(Thread *t) {
     	}
     	
     	while (num_frames_to_write == 0) tm_scope("Chill") {
-    		// We yield & sleep until we have any work to do
-    		os_yield_thread();
-    		os_sleep(1);
+    		// Sleep until the device wants more frames. Time out now and then in case the
+    		// device went away and won't signal anymore.
+    		WaitForSingleObject(win32_audio_buffer_event, 100);
 			
 	    	hr = IAudioClient_GetCurrentPadding(win32_audio_client, &num_frames_available);
 			if (FAILED(hr)) {
@@ -1884,6 +2185,13 @@ void os_update() {
 	}
 
 	has_os_update_been_called_at_all = true;
+	
+	heap_trim_if_needed();
+	
+#if ENABLE_PROFILING
+	heap_report_stats_to_profiler();
+	spinlock_report_stats_to_profiler(&_profiler_lock, STR("profiler lock"));
+#endif
 
 	win32_do_handle_raw_input = true;
 #ifndef OOGABOOGA_HEADLESS
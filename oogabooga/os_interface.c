@@ -9,14 +9,13 @@
 	
 #elif defined(__linux__)
     #ifndef OOGABOOGA_HEADLESS
-    #define "Linux is only supported for headless builds"
+    #error "Linux is only supported for headless builds"
     #endif
-	typedef SOMETHING Mutex_Handle;
-	typedef SOMETHING Thread_Handle;
-	typedef SOMETHING Dynamic_Library_Handle;
-	typedef SOMETHING Window_Handle;
-	typedef SOMETHING File;
-	#error "Linux is not supported yet";
+	typedef pthread_mutex_t* Mutex_Handle;
+	typedef pthread_t Thread_Handle;
+	typedef void* Dynamic_Library_Handle;
+	typedef void* Window_Handle;
+	typedef int File;
 #elif defined(__APPLE__) && defined(__MACH__)
 	typedef SOMETHING Mutex_Handle;
 	typedef SOMETHING Thread_Handle;
@@ -28,11 +27,6 @@
 	#error "Current OS not supported!";
 #endif
 
-#ifndef max
-	#define max(a, b) ((a) > (b) ? (a) : (b))
-	#define min(a, b) ((a) < (b) ? (a) : (b))
-#endif
-
 #define _INTSIZEOF(n)         ((sizeof(n) + sizeof(int) - 1) & ~(sizeof(int) - 1))
 
 typedef int   (__cdecl *Crt_Vsnprintf_Proc) (char*, size_t, const char*, va_list);
@@ -49,6 +43,8 @@ typedef struct Os_Monitor {
 typedef struct Os_Context {
 	u64 page_size;
 	u64 granularity;
+	u64 large_page_size; // 0 unless ENABLE_LARGE_PAGES and the OS lets us use them
+	u64 cycles_per_second; // How fast rdtsc() ticks, measured in os_init. 0 if we couldn't tell.
 	
 	Dynamic_Library_Handle crt;
 	
@@ -163,6 +159,22 @@ os_lock_mutex(Mutex_Handle m);
 void ogb_instance
 os_unlock_mutex(Mutex_Handle m);
 
+///
+// Wait on address (WaitOnAddress on windows, futex on linux)
+// Sleep until another thread changes a value, without any OS object to create or destroy.
+// Mutex in concurrency.c parks on this.
+
+// Sleeps if *address is still expected, returns right away if it isn't.
+// Can return without being woken, so always check the value again.
+void ogb_instance
+os_wait_on_address(volatile u32 *address, u32 expected);
+
+void ogb_instance
+os_wake_one_on_address(volatile u32 *address);
+
+void ogb_instance
+os_wake_all_on_address(volatile u32 *address);
+
 ///
 // Threading utilities
 
@@ -187,6 +199,25 @@ DEPRECATED(os_get_current_time_in_seconds(), "Use os_get_elapsed_seconds() inste
 float64 ogb_instance
 os_get_elapsed_seconds();
 
+// Spins for about a millisecond, so only os_init calls this. Result is in os.cycles_per_second.
+// Assumes an invariant tsc, which is every x86 cpu from the last 15 years or so.
+u64 ogb_instance
+os_measure_cycles_per_second();
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+u64
+os_measure_cycles_per_second() {
+	f64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	f64 elapsed = 0;
+	while (elapsed < 0.001) {
+		elapsed = os_get_elapsed_seconds()-start_seconds;
+	}
+	u64 cycles = rdtsc()-start_cycles;
+	return (u64)((f64)cycles/elapsed);
+}
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
 
 ///
 ///
@@ -280,6 +311,70 @@ os_read_entire_file_handle(File f, string *result, Allocator allocator);
 bool ogb_instance
 os_read_entire_file_s(string path, string *result, Allocator allocator);
 
+// Maps the entire file read-only into memory instead of copying it into an allocation.
+// Pages are shared with the OS file cache (and other processes mapping the same file) and
+// are only read from disk when touched.
+// - Do NOT write to the result
+// - Release with os_file_unmap(), not dealloc
+// - Fails on empty files
+bool ogb_instance
+os_file_map_s(string path, string *result);
+
+void ogb_instance
+os_file_unmap(string mapped);
+
+///
+// Async file IO
+// Reads/writes at an explicit offset that run in the background. Submit, keep doing other
+// things (frame, mixing, ...) and poll or wait for the result later.
+// - The Os_Async_Io, the file and the buffer must stay alive until the request is no longer pending
+// - Requests may complete in any order
+// - Don't mix with os_file_read/os_file_write/os_file_set_pos on the same file while requests are in flight
+// - A read that hits the end of the file completes with fewer bytes_transferred than requested
+// Linux: io_uring if the kernel allows it, otherwise a thread pool doing pread/pwrite.
+// Windows: a thread pool doing ReadFile/WriteFile at the offset.
+#ifndef OS_ASYNC_IO_THREAD_COUNT
+	#define OS_ASYNC_IO_THREAD_COUNT 2
+#endif
+
+typedef enum Os_Async_Io_Status {
+	OS_ASYNC_IO_IDLE = 0,
+	OS_ASYNC_IO_PENDING,
+	OS_ASYNC_IO_DONE,
+	OS_ASYNC_IO_FAILED,
+} Os_Async_Io_Status;
+
+typedef struct Os_Async_Io Os_Async_Io;
+typedef struct Os_Async_Io {
+	File file;
+	void *buffer;
+	u64 size;
+	u64 offset;
+	bool write;
+	
+	// readonly
+	volatile Os_Async_Io_Status status;
+	u64 bytes_transferred;
+	
+	bool _native;
+	Os_Async_Io *_next;
+} Os_Async_Io;
+
+// Returns false if the request could not be submitted (io->status is then OS_ASYNC_IO_FAILED)
+bool ogb_instance
+os_file_read_async(Os_Async_Io *io, File f, void *buffer, u64 size, u64 offset);
+
+bool ogb_instance
+os_file_write_async(Os_Async_Io *io, File f, void *buffer, u64 size, u64 offset);
+
+// Never blocks. Returns true when the request is no longer pending, check io->status for the result.
+bool ogb_instance
+os_async_io_poll(Os_Async_Io *io);
+
+// Blocks until the request is no longer pending. Returns true if it succeeded.
+bool ogb_instance
+os_async_io_wait(Os_Async_Io *io);
+
 
 bool ogb_instance
 os_is_file_s(string path);
@@ -346,6 +441,12 @@ inline bool os_read_entire_file_f(const char *path, string *result, Allocator al
                            default: os_read_entire_file_f \
                           )(__VA_ARGS__)
                           
+inline bool os_file_map_f(const char *path, string *result) {return os_file_map_s(STR(path), result);}
+#define os_file_map(...) _Generic((FIRST_ARG(__VA_ARGS__)), \
+                           string:  os_file_map_s, \
+                           default: os_file_map_f \
+                          )(__VA_ARGS__)
+                          
 inline bool os_is_file_f(const char *path) {return os_is_file_s(STR(path));}
 #define os_is_file(...) _Generic((FIRST_ARG(__VA_ARGS__)), \
                            string:  os_is_file_s, \
@@ -435,29 +536,51 @@ dump_stack_trace() {
 // Memory
 ///
 
+// Program memory is one virtual address range of PROGRAM_MEMORY_RESERVE_SIZE reserved in os_init.
+// program_memory_capacity is how much of it is committed, and only grows by what is actually used.
+
 // #Global
 ogb_instance void *program_memory;
 ogb_instance void *program_memory_next;
 ogb_instance u64 program_memory_capacity;
+ogb_instance u64 program_memory_reserved;
 ogb_instance Mutex_Handle program_memory_mutex;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 void *program_memory = 0;
 void *program_memory_next = 0;
 u64 program_memory_capacity = 0;
+u64 program_memory_reserved = 0;
 Mutex_Handle program_memory_mutex = 0;
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+// Commits program memory up to new_size. Fails if new_size is past program_memory_reserved
+// or if the OS is out of memory.
 bool ogb_instance
 os_grow_program_memory(size_t new_size);
 
 // BEWARE:
 // - size must be aligned to os.page_size
-// - Pages will not always belong to the same region (although they will be contigious in virtual adress space)
 // - Pages will be locked (Win32 PAGE_NOACCESS) so you need to unlock with os_unlock_program_memory_pages() before use.
 ogb_instance void*
 os_reserve_next_memory_pages(u64 size);
 
+// Same as os_reserve_next_memory_pages() but only takes the address range, nothing is committed
+// or touched. Pages come back decommitted, recommit what you use with os_recommit_program_memory_pages().
+// May skip up to os.granularity of address space after the range to keep the committed tail aligned.
+ogb_instance void*
+os_reserve_next_memory_pages_decommitted(u64 size);
+
+// Gives the physical memory behind already used program memory pages back to the OS, while keeping
+// the address range. Contents are lost and the pages can't be touched until recommitted.
+// start & size must be aligned to os.page_size
+void ogb_instance
+os_decommit_program_memory_pages(void *start, u64 size);
+
+// Makes decommitted pages usable again. They come back zeroed and unlocked.
+bool ogb_instance
+os_recommit_program_memory_pages(void *start, u64 size);
+
 void ogb_instance
 os_unlock_program_memory_pages(void *start, u64 size);
 void ogb_instance
@@ -22,7 +22,7 @@ void dump_profile_result() {
 	
 	log_verbose("Wrote profiling result to google_trace.json");
 }
-void _profiler_report_time_cycles(string name, u64 count, u64 start) {
+void _profiler_init_if_needed() {
 	if (!profiler_initted) {
 		spinlock_init(&_profiler_lock);
 		profiler_initted = true;
@@ -30,6 +30,9 @@ void _profiler_report_time_cycles(string name, u64 count, u64 start) {
 		string_builder_init_reserve(&_profile_output, 1024*1000, get_heap_allocator());	
 		
 	}
+}
+void _profiler_report_time_cycles(string name, u64 count, u64 start) {
+	_profiler_init_if_needed();
 	
 	spinlock_acquire_or_wait(&_profiler_lock);
 	
@@ -38,6 +41,31 @@ void _profiler_report_time_cycles(string name, u64 count, u64 start) {
 	
 	spinlock_release(&_profiler_lock);
 }
+void _profiler_report_counter(string name, u64 value) {
+	_profiler_init_if_needed();
+	
+	spinlock_acquire_or_wait(&_profiler_lock);
+	
+	string fmt = STR("{\"cat\":\"counter\",\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"ts\":%lld,\"args\":{\"value\":%llu}},");
+	string_builder_print(&_profile_output, fmt, name, rdtsc()*1000, value);
+	
+	spinlock_release(&_profiler_lock);
+}
+// Shows how contended a lock was since the last report as counters in the trace, then resets
+// its stats. Does nothing unless ENABLE_PROFILING and ENABLE_SPINLOCK_STATS.
+void spinlock_report_stats_to_profiler(Spinlock *l, string name) {
+#if ENABLE_PROFILING && ENABLE_SPINLOCK_STATS
+	spinlock_acquire_or_wait(l);
+	Spinlock_Stats stats = spinlock_get_stats(l);
+	spinlock_reset_stats(l);
+	spinlock_release(l);
+	
+	_profiler_report_counter(tprint("%s acquires", name), stats.acquire_count);
+	_profiler_report_counter(tprint("%s contended acquires", name), stats.contended_count);
+	_profiler_report_counter(tprint("%s spins", name), stats.spin_count);
+	_profiler_report_counter(tprint("%s max wait cycles", name), stats.max_wait_cycles);
+#endif
+}
 #if ENABLE_PROFILING
 #define tm_scope(name) \
     for (u64 start_time = rdtsc(), end_time = start_time, elapsed_time = 0; \
@@ -51,8 +79,11 @@ void _profiler_report_time_cycles(string name, u64 count, u64 start) {
     for (u64 start_time = rdtsc(), end_time = start_time, elapsed_time = 0; \
          elapsed_time == 0; \
          elapsed_time = (end_time = rdtsc()) - start_time, var+=elapsed_time)
+// Shows up as a graph in the trace
+#define tm_counter(name, value) _profiler_report_counter(STR(name), (value))
 #else
 	#define tm_scope(...)
 	#define tm_scope_var(...)
 	#define tm_scope_accum(...)
+	#define tm_counter(...)
 #endif
\ No newline at end of file
@@ -151,12 +151,7 @@ string_builder_reserve(String_Builder *b, u64 required_capacity) {
 	if (b->buffer_capacity >= required_capacity) return;
 	
 	u64 new_capacity = max(b->buffer_capacity*2, (u64)(required_capacity*1.5));
-	u8 *new_buffer = alloc(b->allocator, new_capacity);
-	if (b->buffer) {
-		memcpy(new_buffer, b->buffer, b->count);
-		dealloc(b->allocator, b->buffer);
-	}
-	b->buffer = new_buffer;
+	b->buffer = reallocate(b->allocator, b->buffer, b->buffer_capacity, new_capacity);
 	b->buffer_capacity = new_capacity;
 }
 void 
@@ -233,4 +228,47 @@ string
 string_trim(string s) {
 	s = string_trim_left(s);
 	return string_trim_right(s);
-}
\ No newline at end of file
+}
+
+// Used by the os layers where we can't allocate or format yet
+void s64_to_null_terminated_string_reverse(char str[], int length)
+{
+    int start = 0;
+    int end = length - 1;
+    while (start < end) {
+        char temp = str[start];
+        str[start] = str[end];
+        str[end] = temp;
+        end--;
+        start++;
+    }
+}
+
+void s64_to_null_terminated_string(s64 num, char* str, int base)
+{
+    int i = 0;
+    bool neg = false;
+ 
+    if (num == 0) {
+        str[i++] = '0';
+        str[i] = '\0';
+        return;
+    }
+ 
+    if (num < 0 && base == 10) {
+        neg = true;
+        num = -num;
+    }
+ 
+    while (num != 0) {
+        int rem = num % base;
+        str[i++] = (rem > 9) ? (rem - 10) + 'a' : rem + '0';
+        num = num / base;
+    }
+ 
+    if (neg)
+        str[i++] = '-';
+ 
+    str[i] = '\0';
+    s64_to_null_terminated_string_reverse(str, i);
+}
@@ -41,9 +41,11 @@ u64 format_string_to_buffer_vararg(char* buffer, u64 count, const char* fmt, ...
 	va_end(args);
 	return n;
 }
-typedef struct _8_Bytes {u8 _[8];} _8_Bytes;
-typedef struct _12_Bytes {u8 _[12];} _12_Bytes;
-typedef struct _16_Bytes {u8 _[16];} _16_Bytes;
+// These need to be float members so they are classified the same way as the Vector types
+// when passed through varargs (System V passes float structs in SSE registers).
+typedef struct _8_Bytes {f32 _[2];} _8_Bytes;
+typedef struct _12_Bytes {f32 _[3];} _12_Bytes;
+typedef struct _16_Bytes {f32 _[4];} _16_Bytes;
 u64 format_string_to_buffer(char* buffer, u64 count, const char* fmt, va_list args) {
 	if (!buffer) count = UINT64_MAX;
     const char* p = fmt;
@@ -161,7 +163,12 @@ u64 format_string_to_buffer(char* buffer, u64 count, const char* fmt, va_list ar
                 }
                 format_specifier[specifier_len] = '\0';
 
-                int temp_len = vsnprintf(temp_buffer, sizeof(temp_buffer), format_specifier, args);
+                // vsnprintf may consume from args on some ABIs, so give it a copy and skip the
+                // argument ourselves below.
+                va_list args_for_crt;
+                va_copy(args_for_crt, args);
+                int temp_len = vsnprintf(temp_buffer, sizeof(temp_buffer), format_specifier, args_for_crt);
+                va_end(args_for_crt);
                 switch (format_specifier[specifier_len - 1]) {
                     case 'd': case 'i': va_arg(args, int); break;
                     case 'u': case 'x': case 'X': case 'o': va_arg(args, unsigned int); break;
@@ -224,7 +231,12 @@ string sprint_va_list_to_buffer(const string fmt, va_list args, void* buffer, u6
 string sprint_va_list(Allocator allocator, const string fmt, va_list args) {
 
     char* fmt_cstring = temp_convert_to_null_terminated_string(fmt);
-    u64 count = format_string_to_buffer(NULL, 0, fmt_cstring, args) + 1; 
+    
+    // Counting consumes the args on some ABIs so count with a copy
+    va_list args_for_count;
+    va_copy(args_for_count, args);
+    u64 count = format_string_to_buffer(NULL, 0, fmt_cstring, args_for_count) + 1; 
+    va_end(args_for_count);
 
     char* buffer = NULL;
 
@@ -235,7 +247,7 @@ string sprint_va_list(Allocator allocator, const string fmt, va_list args) {
 
 
 string sprints(Allocator allocator, const string fmt, ...) {
-	va_list args = 0;
+	va_list args;
 	va_start(args, fmt);
 	string s = sprint_va_list(allocator, fmt, args);
 	va_end(args);
@@ -244,7 +256,7 @@ string sprints(Allocator allocator, const string fmt, ...) {
 
 // temp allocator
 string tprints(const string fmt, ...) {
-	va_list args = 0;
+	va_list args;
 	va_start(args, fmt);
 	string s = sprint_va_list(get_temporary_allocator(), fmt, args);
 	va_end(args);
@@ -347,9 +359,9 @@ typedef void(*Logger_Proc)(Log_Level level, string s);
 void string_builder_prints(String_Builder *b, string fmt, ...) {
 	assert(b->allocator.proc, "String_Builder is missing allocator");
 	
-	va_list args1 = 0;
+	va_list args1;
 	va_start(args1, fmt);
-	va_list args2 = 0;
+	va_list args2;
 	va_copy(args2, args1);
 	
 	u64 formatted_count = format_string_to_buffer(0, 0, temp_convert_to_null_terminated_string(fmt), args1);
@@ -366,9 +378,9 @@ void string_builder_prints(String_Builder *b, string fmt, ...) {
 void string_builder_printf(String_Builder *b, const char *fmt, ...) {
 	assert(b->allocator.proc, "String_Builder is missing allocator");
 	
-	va_list args1 = 0;
+	va_list args1;
 	va_start(args1, fmt);
-	va_list args2 = 0;
+	va_list args2;
 	va_copy(args2, args1);
 	
 	u64 formatted_count = format_string_to_buffer(0, 0, fmt, args1);
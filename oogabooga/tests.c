@@ -20,7 +20,7 @@ void log_heap() {
 		
 		while (node != 0) {
 		
-			print("\t\tFREE NODE @ 0x%I64x, %llu bytes\n", (u64)node, node->size);
+			print("\t\tFREE NODE @ 0x%I64x, %llu bytes\n", (u64)node, (u64)node->size);
 			
 			total_free += node->size;
 		
@@ -68,9 +68,37 @@ void test_allocator(bool do_log_heap) {
     memcpy(check_bytes_copy, check_bytes, 1024);
     
     
-    // Allocate and free large block
-    //void* large_block = alloc(heap, 1024 * 1024 * 100);
-    //dealloc(heap, large_block);
+    // Allocate and free large blocks. These get their own pages.
+    u64 large_block_size = HEAP_LARGE_ALLOCATION_THRESHOLD*4;
+    u8* large_block = (u8*)alloc(heap, large_block_size);
+    assert(large_block != NULL, "Failed to allocate large block");
+    large_block[0] = 69;
+    large_block[large_block_size-1] = 69;
+    dealloc(heap, large_block);
+    u8* large_block_again = (u8*)alloc(heap, HEAP_LARGE_ALLOCATION_THRESHOLD*2);
+    assert(large_block_again == large_block, "Large allocation address range was not reused");
+    assert(large_block_again[0] == 0, "Reused large allocation should come back zeroed");
+    dealloc(heap, large_block_again);
+
+    // Bigger than any address range the heap could reuse, so this gets fresh program memory
+    // (which debug builds fill with 0xBA)
+    u64 fresh_size = HEAP_LARGE_ALLOCATION_THRESHOLD;
+    for (u64 i = 0; i < heap_free_large_region_count; i++) {
+    	fresh_size = max(fresh_size, heap_free_large_regions[i].size + os.page_size);
+    }
+    u8 *fresh_zeroed = (u8*)alloc_zeroed(heap, fresh_size);
+    for (u64 i = 0; i < fresh_size; i += 1024) assert(fresh_zeroed[i] == 0, "alloc_zeroed returned dirty memory for a fresh large allocation");
+    assert(fresh_zeroed[fresh_size-1] == 0, "alloc_zeroed returned dirty memory for a fresh large allocation");
+    dealloc(heap, fresh_zeroed);
+    
+    // Regions bigger than a heap block are fine too. Only reserved, so this doesn't cost memory.
+    u64 huge_size = align_next(MAX_HEAP_BLOCK_SIZE + MB(100), os.page_size);
+    u8 *huge_region = heap_large_reserve_region(huge_size);
+    assert(is_pointer_in_program_memory(huge_region+huge_size-1), "Failed to reserve a region bigger than a heap block");
+    bool huge_ok = os_recommit_program_memory_pages(huge_region+huge_size-os.page_size, os.page_size);
+    assert(huge_ok, "Failed recommitting the end of a huge region");
+    huge_region[huge_size-1] = 69;
+    heap_large_release_region(huge_region, huge_size);
 
     // Allocate multiple small blocks
     void* blocks[100];
@@ -138,6 +166,25 @@ void test_allocator(bool do_log_heap) {
     foo = (int*)alloc(get_temporary_allocator(), 72);
     
     assert(old_foo == foo, "Temp allocator goof");
+
+    // Temp scopes only free their own allocations
+    *foo = 1337;
+    Temp_Scope outer_scope = temp_scope_begin();
+    int *in_outer = (int*)talloc(sizeof(int));
+    *in_outer = 69;
+    Temp_Scope inner_scope = temp_scope_begin();
+    int *in_inner = (int*)talloc(sizeof(int));
+    temp_scope_end(inner_scope);
+    assert(talloc(sizeof(int)) == in_inner, "Temp scope did not free its allocations");
+    // Way more than is reserved, so it has to chain on more memory instead of wrapping around
+    u8 *huge_temp = (u8*)talloc(TEMPORARY_STORAGE_SIZE*3);
+    huge_temp[TEMPORARY_STORAGE_SIZE*3-1] = 1;
+    assert(*foo == 1337 && *in_outer == 69, "Temp memory was overwritten when growing");
+    assert(get_temporary_storage_high_water_mark() >= TEMPORARY_STORAGE_SIZE*3, "Temp high water mark is wrong");
+    temp_scope_end(outer_scope);
+    assert(talloc(sizeof(int)) == in_outer, "Temp scope did not free its allocations");
+    assert(*foo == 1337, "Temp scope freed memory from outside of it");
+    reset_temporary_storage();
     
     // Repeated Allocation and Free
     for (int i = 0; i < 10000; ++i) {
@@ -191,9 +238,262 @@ void test_allocator(bool do_log_heap) {
     for (int i = 1; i < 50; i += 2) {
         dealloc(heap, blocks[i]);
     }
-    
+
+    // Reallocate. The heap should grow in place when there's free memory right after.
+    u8 *grower = (u8*)alloc(heap, 8000);
+    u8 *blocker = (u8*)alloc(heap, 8000);
+    for (u64 i = 0; i < 8000; i++) grower[i] = (u8)i;
+    dealloc(heap, blocker);
+    u8 *grown = (u8*)reallocate(heap, grower, 8000, 12000);
+    assert(grown == grower, "Reallocate did not grow in place even though the next node was free");
+    for (u64 i = 0; i < 8000; i++) assert(grown[i] == (u8)i, "Reallocate lost the contents");
+#if DO_ZERO_INITIALIZATION
+    for (u64 i = 8000; i < 12000; i++) assert(grown[i] == 0, "Reallocate did not zero the new memory");
+#endif
+    u8 *shrunk = (u8*)reallocate(heap, grown, 12000, 6000);
+    assert(shrunk == grown, "Reallocate did not shrink in place");
+    for (u64 i = 0; i < 6000; i++) assert(shrunk[i] == (u8)i, "Reallocate lost the contents");
+    u8 *moved = (u8*)reallocate(heap, shrunk, 6000, 100);
+    for (u64 i = 0; i < 100; i++) assert(moved[i] == (u8)i, "Reallocate lost the contents");
+    moved = (u8*)reallocate(heap, moved, 100, KB(100));
+    for (u64 i = 0; i < 100; i++) assert(moved[i] == (u8)i, "Reallocate lost the contents");
+    dealloc(heap, moved);
+
+    u8 *large_grower = (u8*)alloc(heap, MB(2));
+    large_grower[MB(2)-1] = 69;
+    u8 *large_grown = (u8*)reallocate(heap, large_grower, MB(2), MB(8));
+    assert(large_grown[MB(2)-1] == 69, "Reallocate lost the contents");
+    large_grown[MB(8)-1] = 69;
+    large_grown = (u8*)reallocate(heap, large_grown, MB(8), MB(3));
+    assert(large_grown[MB(2)-1] == 69, "Reallocate lost the contents");
+    dealloc(heap, large_grown);
+
+    // Allocators that can't reallocate get alloc + copy
+    Allocator temp = get_temporary_allocator();
+    u8 *temp_grower = (u8*)alloc(temp, 64);
+    temp_grower[63] = 69;
+    u8 *temp_grown = (u8*)reallocate(temp, temp_grower, 64, 128);
+    assert(temp_grown[63] == 69, "Reallocate lost the contents");
+
+    // Heap stats
+    Heap_Stats stats_before = heap_get_stats();
+    void *stats_small = alloc(heap, 100);
+    void *stats_block = alloc(heap, 20000);
+    void *stats_large = alloc(heap, MB(3));
+    Heap_Stats stats = heap_get_stats();
+    assert(stats.allocation_count == stats_before.allocation_count+3, "Heap stats allocation count is wrong");
+    assert(stats.allocated_bytes >= stats_before.allocated_bytes+100+20000+MB(3), "Heap stats allocated bytes is wrong");
+    assert(stats.committed_bytes == stats.allocated_bytes+stats.free_bytes, "Heap stats don't add up");
+    assert(stats.live_allocations_by_size[3] == stats_before.live_allocations_by_size[3]+1, "Heap stats histogram is wrong"); // 100 -> 128
+    assert(stats.live_allocations_by_size[11] == stats_before.live_allocations_by_size[11]+1, "Heap stats histogram is wrong"); // 20000 -> 32k
+    assert(stats.largest_free_block > 0 && stats.free_node_count > 0, "Heap stats free list is wrong");
+    stats_block = reallocate(heap, stats_block, 20000, 40000);
+    stats = heap_get_stats();
+    assert(stats.live_allocations_by_size[11] == stats_before.live_allocations_by_size[11], "Heap stats histogram is wrong after reallocate");
+    dealloc(heap, stats_small);
+    dealloc(heap, stats_block);
+    dealloc(heap, stats_large);
+    stats = heap_get_stats();
+    assert(stats.allocation_count == stats_before.allocation_count, "Heap stats allocation count is wrong");
+    assert(stats.allocated_bytes == stats_before.allocated_bytes, "Heap stats allocated bytes is wrong");
+#if CONFIGURATION == DEBUG
+    u64 debug_total_allocated = 0;
+    for (Heap_Block *block = heap_head; block; block = block->next) debug_total_allocated += block->total_allocated;
+    assert(debug_total_allocated == heap_block_allocated, "Heap stats disagree with the debug allocation tracking");
+#endif
+
+#if ENABLE_ALLOCATION_TRACKING
+    // Allocation tracking
+    Allocation_Snapshot tracking_before = allocation_tracking_snapshot(heap);
+    const char *test_tag = "allocation tracking test";
+    push_allocation_tag(test_tag);
+    void *tracked[3];
+    tracked[0] = alloc(heap, 100);
+    tracked[1] = alloc(heap, 20000);
+    tracked[2] = alloc(heap, MB(2));
+    tracked[0] = reallocate(heap, tracked[0], 100, 10000);
+    pop_allocation_tag();
+    Allocation_Snapshot tracking_after = allocation_tracking_snapshot(heap);
+    bool found_test_tag = false;
+    for (u64 i = 0; i < tracking_after.tag_count; i++) {
+    	if (tracking_after.tags[i].tag != test_tag) continue;
+    	assert(tracking_after.tags[i].count == 3, "Allocation tracking count is wrong");
+    	assert(tracking_after.tags[i].bytes == 10000+20000+MB(2), "Allocation tracking bytes are wrong");
+    	found_test_tag = true;
+    }
+    assert(found_test_tag, "Allocation tracking lost the tag");
+    allocation_tracking_log_diff(tracking_before, tracking_after);
+    for (u64 i = 0; i < 3; i++) dealloc(heap, tracked[i]);
+    allocation_tracking_free_snapshot(tracking_before);
+    allocation_tracking_free_snapshot(tracking_after);
+#endif
+
+    // Heap trimming
+    void *trimmed[16];
+    for (u64 i = 0; i < 16; i++) trimmed[i] = alloc(heap, KB(200));
+    for (u64 i = 0; i < 16; i++) dealloc(heap, trimmed[i]);
+    Heap_Stats stats_before_trim = heap_get_stats();
+    heap_trim();
+    Heap_Stats stats_after_trim = heap_get_stats();
+    if (TARGET_OS != WINDOWS || !os.large_page_size) {
+    	assert(stats_after_trim.committed_bytes + KB(200)*15 <= stats_before_trim.committed_bytes, "heap_trim did not give back the free pages");
+    }
+    assert(stats_after_trim.allocated_bytes == stats_before_trim.allocated_bytes, "heap_trim changed allocated bytes");
+    if (TARGET_OS != WINDOWS || !os.large_page_size) {
+    	// Free nodes remember that they're decommitted, so trimming again doesn't touch them
+    	spinlock_acquire_or_wait(&heap_lock);
+    	for (Heap_Block *block = heap_head; block; block = block->next) {
+    		for (Heap_Free_Node *node = block->free_head; node; node = node->next) {
+    			u8 *first_page = (u8*)align_next((u8*)node + sizeof(Heap_Free_Node), os.page_size);
+    			u8 *last_page_end = (u8*)align_previous((u8*)node + node->size, os.page_size);
+    			if (last_page_end > first_page) assert(node->pages == HEAP_FREE_PAGES_DECOMMITTED, "heap_trim did not mark a free node decommitted");
+    		}
+    	}
+    	spinlock_release(&heap_lock);
+    	heap_trim();
+    	assert(heap_get_stats().committed_bytes == stats_after_trim.committed_bytes, "Trimming twice changed committed bytes");
+    }
+    for (u64 i = 0; i < 16; i++) {
+    	u8 *p = (u8*)alloc(heap, KB(200)); // Lands in trimmed pages
+    	memset(p, 0x42, KB(200));
+    	trimmed[i] = p;
+    }
+    for (u64 i = 0; i < 16; i++) {
+    	assert(((u8*)trimmed[i])[KB(100)] == 0x42, "Heap memory is wrong after trimming");
+    	dealloc(heap, trimmed[i]);
+    }
+
+    // Arenas
+    Arena *arena = make_arena(MB(64));
+    u8 *arena_first = (u8*)arena_alloc(arena, 3);
+    u8 *arena_second = (u8*)arena_alloc(arena, 100);
+    assert((u64)arena_second % ARENA_ALIGNMENT == 0, "Arena allocation is not aligned");
+    assert(arena_second > arena_first, "Arena is not bumping");
+    u8 *arena_aligned = (u8*)arena_alloc_aligned(arena, 16, 4096);
+    assert((u64)arena_aligned % 4096 == 0, "Arena allocation is not aligned");
+    Arena_Checkpoint arena_start = arena_checkpoint(arena);
+    u64 used_before = arena_get_used_size(arena);
+    u8 *arena_big = (u8*)arena_alloc(arena, MB(20)); // Way past the first commit
+    arena_big[0] = 69;
+    arena_big[MB(20)-1] = 69;
+    arena_rewind(arena_start);
+    assert(arena_get_used_size(arena) == used_before, "Arena rewind did not rewind");
+    assert(arena_alloc(arena, 16) == arena_big, "Arena did not reuse memory after rewind");
+    arena_rewind(arena_start);
+    u8 *arena_zeroed = (u8*)arena_alloc_zeroed(arena, MB(20)); // First bytes are dirty, the rest was never touched
+    assert(arena_zeroed == arena_big, "Arena did not reuse memory after rewind");
+    assert(arena_zeroed[0] == 0 && arena_zeroed[MB(20)-1] == 0, "arena_alloc_zeroed returned dirty memory");
+
+    u8 *heap_dirty = (u8*)alloc_uninitialized(heap, 128);
+    memset(heap_dirty, 0x69, 128);
+    dealloc(heap, heap_dirty);
+    u8 *heap_zeroed = (u8*)alloc_zeroed(heap, 128);
+    for (u64 i = 0; i < 128; i++) assert(heap_zeroed[i] == 0, "alloc_zeroed returned dirty memory");
+    dealloc(heap, heap_zeroed);
+    u8 *large_zeroed = (u8*)alloc_zeroed(heap, HEAP_LARGE_ALLOCATION_THRESHOLD);
+    assert(large_zeroed[0] == 0 && large_zeroed[HEAP_LARGE_ALLOCATION_THRESHOLD-1] == 0, "alloc_zeroed returned dirty memory");
+    dealloc(heap, large_zeroed);
+
+    Allocator arena_allocator = get_arena_allocator(arena);
+    u8 *arena_grower = (u8*)alloc(arena_allocator, 64);
+    arena_grower[63] = 69;
+    u8 *arena_grown = (u8*)reallocate(arena_allocator, arena_grower, 64, KB(256));
+    assert(arena_grown == arena_grower, "Arena did not grow the last allocation in place");
+    assert(arena_grown[63] == 69, "Reallocate lost the contents");
+    alloc(arena_allocator, 16);
+    arena_grown = (u8*)reallocate(arena_allocator, arena_grown, KB(256), KB(512));
+    assert(arena_grown != arena_grower && arena_grown[63] == 69, "Arena reallocate should have copied");
+    arena_reset(arena);
+    assert(arena_get_used_size(arena) == 0, "Arena reset did not reset");
+    arena_release(arena);
+
+    // Aligned allocations
+    u64 aligned_sizes[] = {24, 1000, KB(20), HEAP_LARGE_ALLOCATION_THRESHOLD+100};
+    u64 alignments[] = {32, 64, 128, 4096};
+    void *aligned_allocs[4*4];
+    for (u64 i = 0; i < 4; i++) {
+    	for (u64 j = 0; j < 4; j++) {
+    		u8 *p = (u8*)alloc_aligned(heap, aligned_sizes[i], alignments[j]);
+    		assert((u64)p % alignments[j] == 0, "alloc_aligned(%llu, %llu) is not aligned", aligned_sizes[i], alignments[j]);
+    		assert(heap_get_allocation_size(p) >= aligned_sizes[i], "alloc_aligned gave too little memory");
+    		memset(p, 0x42, aligned_sizes[i]);
+    		aligned_allocs[i*4+j] = p;
+    	}
+    }
+    for (u64 i = 0; i < 4*4; i++) {
+    	assert(((u8*)aligned_allocs[i])[0] == 0x42, "Aligned allocations overlap");
+    	dealloc(heap, aligned_allocs[i]);
+    }
+    u8 *aligned_large = (u8*)alloc_aligned(heap, HEAP_LARGE_ALLOCATION_THRESHOLD, 256);
+    aligned_large[0] = 69;
+    u8 *aligned_large_grown = (u8*)reallocate(heap, aligned_large, HEAP_LARGE_ALLOCATION_THRESHOLD, HEAP_LARGE_ALLOCATION_THRESHOLD*2);
+    assert(aligned_large_grown[0] == 69, "Reallocate lost the contents");
+    dealloc(heap, aligned_large_grown);
+    
+    Allocator aligned_arena = make_arena_allocator(MB(1));
+    alloc(aligned_arena, 3);
+    assert((u64)alloc_aligned(aligned_arena, 100, 256) % 256 == 0, "Arena alloc_aligned is not aligned");
+    arena_release((Arena*)aligned_arena.data);
+    alloc(temp, 3);
+    assert((u64)alloc_aligned(temp, 100, 128) % 128 == 0, "Temp alloc_aligned is not aligned");
+
+    u8 arena_memory[1024];
+    Allocator stack_arena = make_arena_allocator_with_memory(sizeof(arena_memory), arena_memory);
+    u8 *in_stack = (u8*)alloc(stack_arena, 128);
+    assert(in_stack > arena_memory && in_stack+128 <= arena_memory+sizeof(arena_memory), "Arena with memory allocated outside of its memory");
+
     assert(bytes_match(check_bytes, check_bytes_copy, 1024), "Memory corrupt");
     
+    // Small allocation throughput. Not a test, but it's nice to see the numbers.
+    const u64 small_alloc_count = 20000;
+    void **small_allocs = (void**)alloc(heap, small_alloc_count*sizeof(void*));
+    u64 small_alloc_start = rdtsc();
+    for (u64 i = 0; i < small_alloc_count; i++) {
+    	small_allocs[i] = alloc(heap, 16 + (i*16) % 1024);
+    }
+    for (u64 i = 0; i < small_alloc_count; i++) {
+    	dealloc(heap, small_allocs[(i*7919) % small_alloc_count]); // Scattered order
+    }
+    u64 small_alloc_cycles = rdtsc() - small_alloc_start;
+    print("\n\t%llu small allocs + deallocs: %.1f cycles per pair\n", small_alloc_count, (f64)small_alloc_cycles/(f64)small_alloc_count);
+    dealloc(heap, small_allocs);
+
+#if CONFIGURATION == DEBUG
+    spinlock_acquire_or_wait(&heap_lock);
+    for (Heap_Block *block = heap_head; block != 0; block = block->next) {
+    	sanity_check_block(block);
+    }
+    spinlock_release(&heap_lock);
+#endif
+    
+    // Program memory is reserved up front and only committed as it's used
+    assert(program_memory_reserved >= program_memory_capacity, "Program memory committed past what's reserved");
+    u64 page_test_size = os.page_size*4;
+    u8 *pages = (u8*)os_reserve_next_memory_pages(page_test_size);
+    assert(pages+page_test_size <= (u8*)program_memory+program_memory_capacity, "os_reserve_next_memory_pages did not commit the pages");
+    os_unlock_program_memory_pages(pages, page_test_size);
+    memset(pages, 0x69, page_test_size);
+    os_decommit_program_memory_pages(pages, page_test_size);
+    bool recommit_ok = os_recommit_program_memory_pages(pages, page_test_size);
+    assert(recommit_ok, "Failed: os_recommit_program_memory_pages");
+    for (u64 i = 0; i < page_test_size; i++) {
+    	assert(pages[i] == 0, "Recommitted pages should be zeroed");
+    }
+    
+    // Reserving decommitted pages doesn't touch them (debug would have filled them with 0xBA)
+    u64 reserve_test_size = os.granularity*4;
+    u8 *reserved_pages = (u8*)os_reserve_next_memory_pages_decommitted(reserve_test_size);
+    assert(is_pointer_in_program_memory(reserved_pages+reserve_test_size-1), "os_reserve_next_memory_pages_decommitted did not reserve the pages");
+    recommit_ok = os_recommit_program_memory_pages(reserved_pages, reserve_test_size);
+    assert(recommit_ok, "Failed: os_recommit_program_memory_pages on reserved pages");
+    for (u64 i = 0; i < reserve_test_size; i += 512) {
+    	assert(reserved_pages[i] == 0, "Reserved pages should come back zeroed");
+    }
+    u8 *after_reserved = (u8*)os_reserve_next_memory_pages(os.page_size);
+    assert(after_reserved >= reserved_pages+reserve_test_size, "Reserved range was handed out again");
+    os_unlock_program_memory_pages(after_reserved, os.page_size);
+    memset(after_reserved, 0x69, os.page_size);
+    
     if (do_log_heap) log_heap();
 }
 
@@ -234,6 +534,17 @@ void test_allocator_threaded(Thread *t) {
         assert(temp != NULL && "Repeated allocation failed");
         dealloc(heap, temp);
     }
+    
+    void* small_blocks[256];
+    for (int n = 0; n < 100; ++n) {
+	    for (int i = 0; i < 256; ++i) {
+	        small_blocks[i] = alloc(heap, 16 + (i*48) % 2048);
+	        assert(small_blocks[i] != NULL && "Small allocation failed");
+	    }
+	    for (int i = 255; i >= 0; --i) {
+	        dealloc(heap, small_blocks[i]);
+	    }
+    }
 
     void* mixed_blocks[40];
     for (int i = 0; i < 40; ++i) {
@@ -258,6 +569,64 @@ void test_allocator_threaded(Thread *t) {
     }
 }
 
+typedef struct Remote_Free_Test_Data {
+	void **pointers;
+	u64 count;
+} Remote_Free_Test_Data;
+void test_allocator_remote_free_proc(Thread *t) {
+	Remote_Free_Test_Data *data = (Remote_Free_Test_Data*)t->data;
+	for (u64 i = 0; i < data->count; i++) {
+		dealloc(get_heap_allocator(), data->pointers[i]);
+	}
+}
+void test_allocator_threads() {
+	Allocator heap = get_heap_allocator();
+	
+	// Free from another thread than the one that allocated
+	const u64 remote_count = 1000;
+	void **remote_pointers = (void**)alloc(heap, remote_count*sizeof(void*));
+	for (u64 i = 0; i < remote_count; i++) {
+		remote_pointers[i] = alloc(heap, 64);
+		*(u64*)remote_pointers[i] = i;
+	}
+	Remote_Free_Test_Data remote_data = {remote_pointers, remote_count};
+	Thread remote_thread;
+	os_thread_init(&remote_thread, test_allocator_remote_free_proc);
+	remote_thread.data = &remote_data;
+	os_thread_start(&remote_thread);
+	os_thread_join(&remote_thread);
+	// Remote frees get picked up here, and the slots should be handed out again
+	bool any_reused = false;
+	for (u64 i = 0; i < remote_count; i++) {
+		void *p = alloc(heap, 64);
+		for (u64 j = 0; j < remote_count && !any_reused; j++) {
+			if (p == remote_pointers[j]) any_reused = true;
+		}
+		remote_pointers[i] = p;
+	}
+	assert(any_reused, "Failed: slots freed by another thread were never reused");
+	for (u64 i = 0; i < remote_count; i++) dealloc(heap, remote_pointers[i]);
+	dealloc(heap, remote_pointers);
+	
+	// Same amount of work per thread, so the time should stay flat if we scale
+	u64 max_threads = min(os_get_number_of_logical_processors(), 8);
+	Thread *threads = (Thread*)alloc(heap, sizeof(Thread)*max_threads);
+	print("\n");
+	for (u64 thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+		f64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < thread_count; i++) {
+			os_thread_init(&threads[i], test_allocator_threaded);
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < thread_count; i++) {
+			os_thread_join(&threads[i]);
+		}
+		f64 elapsed = os_get_elapsed_seconds() - start;
+		print("\t%llu threads: %.2fms\n", thread_count, elapsed*1000.0);
+	}
+	dealloc(heap, threads);
+}
+
 void test_strings() {
 	Allocator heap = get_heap_allocator();
 	{
@@ -450,6 +819,13 @@ void test_strings() {
     assert(strings_match(hello_balls, STR("Greetings, Balls!")), "Failed: string_replace");
 }
 
+#if TARGET_OS == LINUX
+Os_Async_Io async_pipe_read;
+void async_test_wait_on_pipe(Thread *t) {
+	os_async_io_wait(&async_pipe_read);
+}
+#endif
+
 void test_file_io() {
 
 #if TARGET_OS == WINDOWS && !OOGABOOGA_LINK_EXTERNAL_INSTANCE
@@ -487,7 +863,7 @@ void test_file_io() {
     assert(file != OS_INVALID_FILE, "Failed: os_file_open (read)");
     string hello_world_read = talloc_string(hello_world_write.count);
     bool read_result = os_file_read(file, hello_world_read.data, hello_world_read.count, &hello_world_read.count);
-    assert(read_result, "Failed: os_file_read %d", GetLastError());
+    assert(read_result, "Failed: os_file_read");
     assert(strings_match(hello_world_read, hello_world_write), "Failed: os_file_read write/read mismatch");
     os_file_close(file);
 
@@ -539,6 +915,93 @@ void test_file_io() {
     u64 *new_integers = (u64*)integers_data.data;
     assert(integers_read.count == integers_data.count, "Failed: big file read/write mismatch. Read was %d and written was %d", integers_read.count, integers_data.count);
     assert(strings_match(integers_data, integers_read), "Failed: big file read/write mismatch");
+    
+    string integers_mapped;
+    ok = os_file_map("integers", &integers_mapped);
+    assert(ok, "Failed: os_file_map");
+    assert(integers_mapped.count == integers_data.count, "Failed: os_file_map size mismatch. Mapped %d, written %d", integers_mapped.count, integers_data.count);
+    assert(memcmp(integers_mapped.data, integers_data.data, integers_data.count) == 0, "Failed: os_file_map content mismatch");
+    os_file_unmap(integers_mapped);
+    
+    string nothing_mapped;
+    assert(!os_file_map("this_file_does_not_exist", &nothing_mapped), "Failed: os_file_map should fail on missing file");
+    
+    // Async IO, chunks submitted out of order
+    File async_file = os_file_open("async_integers", O_WRITE | O_CREATE);
+    assert(async_file != OS_INVALID_FILE, "Failed: os_file_open (async_integers)");
+    Os_Async_Io async_writes[4];
+    u64 async_chunk_size = integers_data.count/4;
+    for (s64 i = 3; i >= 0; i--) {
+    	ok = os_file_write_async(&async_writes[i], async_file, integers_data.data+i*async_chunk_size, async_chunk_size, i*async_chunk_size);
+    	assert(ok, "Failed: os_file_write_async");
+    }
+    for (u64 i = 0; i < 4; i++) {
+    	ok = os_async_io_wait(&async_writes[i]);
+    	assert(ok, "Failed: os_async_io_wait (write %d)", i);
+    	assert(async_writes[i].bytes_transferred == async_chunk_size, "Failed: async write wrote %d, expected %d", async_writes[i].bytes_transferred, async_chunk_size);
+    }
+    os_file_close(async_file);
+    
+    async_file = os_file_open("async_integers", O_READ);
+    assert(async_file != OS_INVALID_FILE, "Failed: os_file_open (async_integers)");
+    u8 *async_read_buffer = alloc(heap, integers_data.count);
+    Os_Async_Io async_reads[4];
+    for (u64 i = 0; i < 4; i++) {
+    	ok = os_file_read_async(&async_reads[i], async_file, async_read_buffer+i*async_chunk_size, async_chunk_size, i*async_chunk_size);
+    	assert(ok, "Failed: os_file_read_async");
+    }
+    u64 async_done_count = 0;
+    while (async_done_count < 4) {
+    	async_done_count = 0;
+    	for (u64 i = 0; i < 4; i++) async_done_count += os_async_io_poll(&async_reads[i]) ? 1 : 0;
+    	if (async_done_count < 4) os_yield_thread();
+    }
+    for (u64 i = 0; i < 4; i++) {
+    	assert(async_reads[i].status == OS_ASYNC_IO_DONE, "Failed: async read %d failed", i);
+    }
+    assert(memcmp(async_read_buffer, integers_data.data, integers_data.count) == 0, "Failed: async read/write mismatch");
+    
+    Os_Async_Io async_eof;
+    ok = os_file_read_async(&async_eof, async_file, async_read_buffer, 128, integers_data.count-64);
+    assert(ok, "Failed: os_file_read_async past end of file");
+    ok = os_async_io_wait(&async_eof);
+    assert(ok && async_eof.bytes_transferred == 64, "Failed: async read past end of file should give what's left. Got %d", async_eof.bytes_transferred);
+    os_file_close(async_file);
+    
+#if TARGET_OS == LINUX
+    // A thread blocked waiting on a pipe read must not hold up submitting and waiting on other IO
+    int pipe_fds[2];
+    assert(pipe(pipe_fds) == 0, "Failed: pipe");
+    u8 pipe_buffer[16];
+    ok = os_file_read_async(&async_pipe_read, pipe_fds[0], pipe_buffer, sizeof(pipe_buffer), 0);
+    assert(ok, "Failed: os_file_read_async on a pipe");
+    Thread pipe_waiter;
+    os_thread_init(&pipe_waiter, async_test_wait_on_pipe);
+    os_thread_start(&pipe_waiter);
+    os_sleep(10);
+    
+    async_file = os_file_open("async_integers", O_READ);
+    assert(async_file != OS_INVALID_FILE, "Failed: os_file_open (async_integers)");
+    Os_Async_Io async_while_blocked;
+    ok = os_file_read_async(&async_while_blocked, async_file, async_read_buffer, async_chunk_size, 0);
+    assert(ok, "Failed: os_file_read_async while another thread waits");
+    ok = os_async_io_wait(&async_while_blocked);
+    assert(ok && async_while_blocked.bytes_transferred == async_chunk_size, "Failed: async read while another thread waits");
+    os_file_close(async_file);
+    
+    assert(write(pipe_fds[1], "hello", 5) == 5, "Failed: write to pipe");
+    os_thread_join(&pipe_waiter);
+    assert(async_pipe_read.status == OS_ASYNC_IO_DONE && async_pipe_read.bytes_transferred == 5, "Failed: async pipe read");
+    assert(memcmp(pipe_buffer, "hello", 5) == 0, "Failed: async pipe read content");
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+#endif
+    
+    dealloc(heap, async_read_buffer);
+    
+    Os_Async_Io async_invalid;
+    assert(!os_file_read_async(&async_invalid, OS_INVALID_FILE, async_read_buffer, 128, 0), "Failed: os_file_read_async should fail on invalid file");
+    assert(async_invalid.status == OS_ASYNC_IO_FAILED, "Failed: os_file_read_async invalid file status");
 
 	assert(os_is_file("test.txt"), "Failed: test.txt not recognized as file");
 	assert(os_is_file("test_bytes.txt"), "Failed: test_bytes.txt not recognized as file");
@@ -582,7 +1045,9 @@ void test_file_io() {
     delete_ok = os_file_delete("balls.txt");
     assert(delete_ok, "Failed: could not delete balls.txt");
     delete_ok = os_file_delete("integers");
-    assert(delete_ok, "Failed: could not delete integers"); 
+    assert(delete_ok, "Failed: could not delete integers");
+    delete_ok = os_file_delete("async_integers");
+    assert(delete_ok, "Failed: could not delete async_integers"); 
     delete_ok = os_delete_directory("test_dir", false);
     assert(delete_ok, "Failed: could not delete test_dir"); 
     delete_ok = os_delete_directory("test_dir1", true);
@@ -1143,6 +1608,60 @@ void test_hash_table() {
 #define NUM_BINS 100
 #define NUM_SAMPLES 100000000
 
+typedef struct Pool_Test_Thing {
+	u64 id;
+	Vector4 color;
+} Pool_Test_Thing;
+void test_pool() {
+	Pool *things = make_pool(Pool_Test_Thing, 100000);
+	
+	Pool_Handle first = pool_add(things);
+	assert(first != 0, "0 should never be a valid pool handle");
+	Pool_Test_Thing *first_thing = (Pool_Test_Thing*)pool_get(things, first);
+	assert(first_thing && first_thing->id == 0, "Pool object was not zeroed");
+	assert((u64)first_thing % 16 == 0, "Pool object is not aligned");
+	first_thing->id = 1;
+	assert(pool_get_handle(things, first_thing) == first, "Pool handle from pointer is wrong");
+	
+	pool_remove(things, first);
+	assert(!pool_is_valid(things, first) && pool_get(things, first) == 0, "Stale pool handle was accepted");
+	
+	Pool_Handle reused = pool_add(things);
+	assert(reused != first, "Reused pool slot got the same handle");
+	assert(pool_get(things, reused) == first_thing, "Pool did not reuse the removed slot");
+	assert(pool_get(things, first) == 0, "Stale pool handle was accepted after the slot was reused");
+	pool_remove(things, reused);
+	
+	// Enough to commit more pages
+	const u32 count = 50000;
+	Pool_Handle *handles = (Pool_Handle*)alloc(get_heap_allocator(), count*sizeof(Pool_Handle));
+	for (u32 i = 0; i < count; i++) {
+		handles[i] = pool_add(things);
+		((Pool_Test_Thing*)pool_get(things, handles[i]))->id = i;
+	}
+	for (u32 i = 0; i < count; i += 2) {
+		pool_remove(things, handles[i]);
+	}
+	assert(things->count == count/2, "Pool count is wrong");
+	
+	u64 visited = 0;
+	for (Pool_Test_Thing *thing = pool_first(things); thing; thing = pool_next(things, thing)) {
+		assert(thing->id % 2 == 1, "Pool iterated a removed object");
+		visited += 1;
+	}
+	assert(visited == count/2, "Pool iteration missed objects");
+	
+	dealloc(get_heap_allocator(), handles);
+	pool_release(things);
+	
+	Pool *aligned_things = make_pool_aligned(Pool_Test_Thing, 100, 64);
+	for (u32 i = 0; i < 10; i++) {
+		Pool_Test_Thing *thing = (Pool_Test_Thing*)pool_get(aligned_things, pool_add(aligned_things));
+		assert((u64)thing % 64 == 0, "Aligned pool object is not aligned");
+	}
+	pool_release(aligned_things);
+}
+
 void test_random_distribution() {
     int bins[NUM_BINS] = {0};
     seed_for_random = rdtsc();
@@ -1181,20 +1700,111 @@ void mutex_test_increment_counter(Thread* t) {
         mutex_release(&data->mutex);
     }
 }
+#define ATOMIC_TEST_THREADS 8
+#define ATOMIC_TEST_ADDS 100000
+void atomic_test_add(Thread *t) {
+	volatile u64 *counter = (volatile u64*)t->data;
+	for (u64 i = 0; i < ATOMIC_TEST_ADDS; i++) atomic_fetch_add_64(counter, 1);
+}
+void test_atomics() {
+	volatile u32 a32 = 0;
+	volatile u64 a64 = 0;
+	
+	atomic_store_32(&a32, 5, MEMORY_ORDER_RELAXED);
+	assert(atomic_load_32(&a32, MEMORY_ORDER_ACQUIRE) == 5, "Failed: atomic_store_32/atomic_load_32");
+	atomic_store_64(&a64, 0xFFFFFFFFFULL, MEMORY_ORDER_SEQ_CST);
+	assert(atomic_load_64(&a64, MEMORY_ORDER_RELAXED) == 0xFFFFFFFFFULL, "Failed: atomic_store_64/atomic_load_64");
+	
+	assert(atomic_fetch_add_32(&a32, 3) == 5 && a32 == 8, "Failed: atomic_fetch_add_32");
+	assert(atomic_fetch_add_32(&a32, (u32)-8) == 8 && a32 == 0, "Failed: atomic_fetch_add_32 with a negative value");
+	assert(atomic_fetch_add_64(&a64, 1) == 0xFFFFFFFFFULL && a64 == 0x1000000000ULL, "Failed: atomic_fetch_add_64");
+	
+	assert(atomic_fetch_or_32(&a32, 0x5) == 0 && a32 == 0x5, "Failed: atomic_fetch_or_32");
+	assert(atomic_fetch_or_32(&a32, 0x3) == 0x5 && a32 == 0x7, "Failed: atomic_fetch_or_32");
+	assert(atomic_fetch_or_64(&a64, 1) == 0x1000000000ULL && a64 == 0x1000000001ULL, "Failed: atomic_fetch_or_64");
+	
+	assert(atomic_exchange_32(&a32, 42) == 0x7 && a32 == 42, "Failed: atomic_exchange_32");
+	assert(atomic_exchange_64(&a64, 0) == 0x1000000001ULL && a64 == 0, "Failed: atomic_exchange_64");
+	
+	Thread threads[ATOMIC_TEST_THREADS];
+	for (u64 i = 0; i < ATOMIC_TEST_THREADS; i++) {
+		os_thread_init(&threads[i], atomic_test_add);
+		threads[i].data = (void*)&a64;
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < ATOMIC_TEST_THREADS; i++) os_thread_destroy(&threads[i]);
+	assert(a64 == ATOMIC_TEST_THREADS*ATOMIC_TEST_ADDS, "Failed: Lost atomic_fetch_add_64's across threads, got %llu", a64);
+}
+
+#define SPINLOCK_TEST_THREADS 8
+#define SPINLOCK_TEST_TASK_COUNT 20000
+typedef struct Spinlock_Test_Shared_Data {
+	Spinlock lock;
+	u64 counter;
+	bool any_active_thread;
+} Spinlock_Test_Shared_Data;
+void spinlock_test_increment_counter(Thread *t) {
+	Spinlock_Test_Shared_Data *data = (Spinlock_Test_Shared_Data*)t->data;
+	for (u64 i = 0; i < SPINLOCK_TEST_TASK_COUNT; i++) {
+		spinlock_acquire_or_wait(&data->lock);
+		assert(!data->any_active_thread, "Failed: More than one thread is in critical section!");
+		data->any_active_thread = true;
+		data->counter++;
+		data->any_active_thread = false;
+		spinlock_release(&data->lock);
+	}
+}
+void test_spinlock() {
+	Spinlock l;
+	spinlock_init(&l);
+	
+	spinlock_acquire_or_wait(&l);
+	assert(!spinlock_acquire_or_wait_timeout(&l, 0.001), "Failed: Acquired a held spinlock");
+	spinlock_release(&l);
+	assert(spinlock_acquire_or_wait_timeout(&l, 0.001), "Failed: Timed out on a free spinlock");
+	spinlock_release(&l);
+	
+	Spinlock_Test_Shared_Data data = {0};
+	spinlock_init(&data.lock);
+	
+	Thread threads[SPINLOCK_TEST_THREADS];
+	u64 start = rdtsc();
+	for (u64 i = 0; i < SPINLOCK_TEST_THREADS; i++) {
+		os_thread_init(&threads[i], spinlock_test_increment_counter);
+		threads[i].data = &data;
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < SPINLOCK_TEST_THREADS; i++) {
+		os_thread_destroy(&threads[i]);
+	}
+	u64 cycles = rdtsc()-start;
+	
+	assert(data.counter == SPINLOCK_TEST_THREADS*SPINLOCK_TEST_TASK_COUNT, "Failed: Counter does not match expected value after threading tasks");
+	
+#if ENABLE_SPINLOCK_STATS
+	Spinlock_Stats stats = spinlock_get_stats(&data.lock);
+	assert(stats.acquire_count == SPINLOCK_TEST_THREADS*SPINLOCK_TEST_TASK_COUNT, "Failed: Spinlock stats missed acquires");
+	assert(stats.contended_count <= stats.acquire_count, "Failed: Spinlock stats don't add up");
+	print("\n\t%llu of %llu acquires contended, %llu spins, max wait %llu cycles\n", stats.contended_count, stats.acquire_count, stats.spin_count, stats.max_wait_cycles);
+#endif
+	
+	// Not a test, but it's nice to see the numbers.
+	print("\n\t%d threads: %.1f cycles per acquire + release\n", SPINLOCK_TEST_THREADS, (f64)cycles/(f64)(SPINLOCK_TEST_THREADS*SPINLOCK_TEST_TASK_COUNT));
+}
 void test_mutex() {
     Mutex m;
     
     // Test initialization
     mutex_init(&m);
     assert(m.spin_time_microseconds == MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS, "Failed: Default spin time incorrect");
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after initialization");
+    assert(m.state == 0, "Failed: Mutex should not be acquired after initialization");
 
     // Test acquire and release without contention
     mutex_acquire_or_wait(&m);
-    assert(m.spinlock_acquired, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
+    assert(m.state == 1, "Failed: Mutex should be acquired after mutex_acquire_or_wait");
     
     mutex_release(&m);
-    assert(!m.spinlock_acquired, "Failed: Spinlock should not be acquired after mutex_release");
+    assert(m.state == 0, "Failed: Mutex should not be acquired after mutex_release");
 
     // Clean up
     mutex_destroy(&m);
@@ -1223,6 +1833,378 @@ void test_mutex() {
     assert(data.counter == num_threads * MUTEX_TEST_TASK_COUNT, "Failed: Counter does not match expected value after threading tasks");
 
     mutex_destroy(&data.mutex);
+    
+    // Not a test, but it's nice to see the numbers.
+    // Uncontended Mutex should be way cheaper than going through the OS.
+    const u64 bench_count = 100000;
+    mutex_init(&m);
+    u64 start = rdtsc();
+    for (u64 i = 0; i < bench_count; i++) {
+    	mutex_acquire_or_wait(&m);
+    	mutex_release(&m);
+    }
+    u64 mutex_cycles = rdtsc()-start;
+    mutex_destroy(&m);
+    
+    Mutex_Handle os_mutex = os_make_mutex();
+    start = rdtsc();
+    for (u64 i = 0; i < bench_count; i++) {
+    	os_lock_mutex(os_mutex);
+    	os_unlock_mutex(os_mutex);
+    }
+    u64 os_mutex_cycles = rdtsc()-start;
+    os_destroy_mutex(os_mutex);
+    
+    print("\n\tUncontended: Mutex %.1f cycles per acquire + release, OS mutex %.1f cycles\n", (f64)mutex_cycles/(f64)bench_count, (f64)os_mutex_cycles/(f64)bench_count);
+}
+
+#define SYNC_TEST_THREADS 4
+#define SYNC_TEST_ITEMS 10000
+#define SYNC_TEST_PING_PONGS 1000
+typedef struct Sync_Test_Shared_Data {
+	Semaphore sem;
+	Mutex mutex;
+	Condition_Variable not_empty;
+	u64 queue[SYNC_TEST_ITEMS];
+	u64 queue_count;
+	u64 consumed_sum;
+	bool done;
+	Event go;
+	volatile u32 through_event_count;
+	Binary_Semaphore ping, pong;
+} Sync_Test_Shared_Data;
+void sync_test_semaphore_consumer(Thread *t) {
+	Sync_Test_Shared_Data *data = (Sync_Test_Shared_Data*)t->data;
+	for (u64 i = 0; i < SYNC_TEST_ITEMS/SYNC_TEST_THREADS; i++) semaphore_wait(&data->sem);
+}
+void sync_test_condition_consumer(Thread *t) {
+	Sync_Test_Shared_Data *data = (Sync_Test_Shared_Data*)t->data;
+	mutex_acquire_or_wait(&data->mutex);
+	while (true) {
+		while (data->queue_count == 0 && !data->done) condition_variable_wait(&data->not_empty, &data->mutex);
+		if (data->queue_count == 0) break;
+		data->queue_count -= 1;
+		data->consumed_sum += data->queue[data->queue_count];
+	}
+	mutex_release(&data->mutex);
+}
+void sync_test_event_waiter(Thread *t) {
+	Sync_Test_Shared_Data *data = (Sync_Test_Shared_Data*)t->data;
+	event_wait(&data->go);
+	assert(event_is_set(&data->go), "Failed: Went through an event that is not set");
+	atomic_fetch_add_32(&data->through_event_count, 1);
+}
+void sync_test_pong(Thread *t) {
+	Sync_Test_Shared_Data *data = (Sync_Test_Shared_Data*)t->data;
+	for (u64 i = 0; i < SYNC_TEST_PING_PONGS; i++) {
+		binary_semaphore_wait(&data->ping);
+		binary_semaphore_signal(&data->pong);
+	}
+}
+void test_sync_primitives() {
+	Sync_Test_Shared_Data *data = alloc(get_heap_allocator(), sizeof(Sync_Test_Shared_Data));
+	memset(data, 0, sizeof(*data));
+	Thread threads[SYNC_TEST_THREADS];
+	
+	// Semaphore
+	semaphore_init(&data->sem, 2);
+	assert(semaphore_try_wait(&data->sem), "Failed: Semaphore with a count of 2 didn't let us through");
+	assert(semaphore_try_wait(&data->sem), "Failed: Semaphore with a count of 1 didn't let us through");
+	assert(!semaphore_try_wait(&data->sem), "Failed: Semaphore with a count of 0 let us through");
+	for (u64 i = 0; i < SYNC_TEST_THREADS; i++) {
+		os_thread_init(&threads[i], sync_test_semaphore_consumer);
+		threads[i].data = data;
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < SYNC_TEST_ITEMS; i += 100) semaphore_signal(&data->sem, i % 200 == 0 ? 1 : 199);
+	for (u64 i = 0; i < SYNC_TEST_THREADS; i++) os_thread_destroy(&threads[i]);
+	assert(data->sem.count == 0, "Failed: Semaphore count is %u after every signal was waited for", data->sem.count);
+	semaphore_destroy(&data->sem);
+	
+	// Condition variable
+	mutex_init(&data->mutex);
+	condition_variable_init(&data->not_empty);
+	for (u64 i = 0; i < SYNC_TEST_THREADS; i++) {
+		os_thread_init(&threads[i], sync_test_condition_consumer);
+		threads[i].data = data;
+		os_thread_start(&threads[i]);
+	}
+	u64 expected_sum = 0;
+	for (u64 i = 1; i <= SYNC_TEST_ITEMS; i++) {
+		mutex_acquire_or_wait(&data->mutex);
+		data->queue[data->queue_count] = i;
+		data->queue_count += 1;
+		mutex_release(&data->mutex);
+		condition_variable_signal(&data->not_empty);
+		expected_sum += i;
+	}
+	mutex_acquire_or_wait(&data->mutex);
+	data->done = true;
+	mutex_release(&data->mutex);
+	condition_variable_broadcast(&data->not_empty);
+	for (u64 i = 0; i < SYNC_TEST_THREADS; i++) os_thread_destroy(&threads[i]);
+	assert(data->consumed_sum == expected_sum, "Failed: Condition variable consumers got %llu, expected %llu", data->consumed_sum, expected_sum);
+	condition_variable_destroy(&data->not_empty);
+	mutex_destroy(&data->mutex);
+	
+	// Event
+	event_init(&data->go, false);
+	for (u64 i = 0; i < SYNC_TEST_THREADS; i++) {
+		os_thread_init(&threads[i], sync_test_event_waiter);
+		threads[i].data = data;
+		os_thread_start(&threads[i]);
+	}
+	os_sleep(5);
+	assert(data->through_event_count == 0, "Failed: Threads went through an event that was never set");
+	event_set(&data->go);
+	for (u64 i = 0; i < SYNC_TEST_THREADS; i++) os_thread_destroy(&threads[i]);
+	assert(data->through_event_count == SYNC_TEST_THREADS, "Failed: Not every thread woke up from the event");
+	event_reset(&data->go);
+	assert(!event_is_set(&data->go), "Failed: Event still set after reset");
+	event_destroy(&data->go);
+	
+	// Binary semaphore ping pong
+	binary_semaphore_init(&data->ping, false);
+	binary_semaphore_init(&data->pong, false);
+	binary_semaphore_signal(&data->ping);
+	binary_semaphore_signal(&data->ping);
+	binary_semaphore_wait(&data->ping);
+	assert(data->ping.sem.count == 0, "Failed: Binary semaphore counted past 1");
+	os_thread_init(&threads[0], sync_test_pong);
+	threads[0].data = data;
+	os_thread_start(&threads[0]);
+	f64 start = os_get_elapsed_seconds();
+	for (u64 i = 0; i < SYNC_TEST_PING_PONGS; i++) {
+		binary_semaphore_signal(&data->ping);
+		binary_semaphore_wait(&data->pong);
+	}
+	f64 elapsed = os_get_elapsed_seconds()-start;
+	os_thread_destroy(&threads[0]);
+	binary_semaphore_destroy(&data->ping);
+	binary_semaphore_destroy(&data->pong);
+	
+	// Not a test, but it's nice to see the numbers.
+	print("\n\tBinary semaphore round trip between two threads: %.2f microseconds\n", elapsed*1000000.0/(f64)SYNC_TEST_PING_PONGS);
+	
+	dealloc(get_heap_allocator(), data);
+}
+
+#define QUEUE_TEST_THREADS 4 // Producers, and as many consumers
+#define QUEUE_TEST_ITEMS_PER_PRODUCER 100000
+typedef struct Queue_Test_Shared_Data {
+	Mpmc_Queue queue;
+	u64 *array; // Growing array for the mutex version
+	Mutex mutex;
+	bool use_mutex;
+	volatile u64 consumed_count;
+	volatile u64 consumed_sum;
+} Queue_Test_Shared_Data;
+void queue_test_producer(Thread *t) {
+	Queue_Test_Shared_Data *data = (Queue_Test_Shared_Data*)t->data;
+	for (u64 i = 1; i <= QUEUE_TEST_ITEMS_PER_PRODUCER; i++) {
+		if (data->use_mutex) {
+			mutex_acquire_or_wait(&data->mutex);
+			growing_array_add((void**)&data->array, &i);
+			mutex_release(&data->mutex);
+		} else {
+			while (!mpmc_queue_push(&data->queue, i)) os_yield_thread();
+		}
+	}
+}
+void queue_test_consumer(Thread *t) {
+	Queue_Test_Shared_Data *data = (Queue_Test_Shared_Data*)t->data;
+	const u64 total = QUEUE_TEST_THREADS*QUEUE_TEST_ITEMS_PER_PRODUCER;
+	u64 sum = 0;
+	u64 count = 0;
+	while (data->consumed_count < total) {
+		u64 item = 0;
+		bool got_item = false;
+		if (data->use_mutex) {
+			mutex_acquire_or_wait(&data->mutex);
+			u64 valid_count = growing_array_get_valid_count(data->array);
+			if (valid_count > 0) {
+				item = data->array[valid_count-1];
+				growing_array_pop((void**)&data->array);
+				got_item = true;
+			}
+			mutex_release(&data->mutex);
+		} else {
+			got_item = mpmc_queue_pop(&data->queue, &item);
+		}
+		
+		if (got_item) {
+			sum += item;
+			count += 1;
+			atomic_fetch_add_64(&data->consumed_count, 1);
+		} else {
+			os_yield_thread();
+		}
+	}
+	atomic_fetch_add_64(&data->consumed_sum, sum);
+}
+// Returns cycles
+u64 queue_test_run(Queue_Test_Shared_Data *data) {
+	data->consumed_count = 0;
+	data->consumed_sum = 0;
+	Thread threads[QUEUE_TEST_THREADS*2];
+	u64 start = rdtsc();
+	for (u64 i = 0; i < QUEUE_TEST_THREADS*2; i++) {
+		os_thread_init(&threads[i], i < QUEUE_TEST_THREADS ? queue_test_producer : queue_test_consumer);
+		threads[i].data = data;
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < QUEUE_TEST_THREADS*2; i++) {
+		os_thread_destroy(&threads[i]);
+	}
+	u64 cycles = rdtsc()-start;
+	
+	const u64 n = QUEUE_TEST_ITEMS_PER_PRODUCER;
+	assert(data->consumed_count == QUEUE_TEST_THREADS*n, "Queue lost or duplicated items");
+	assert(data->consumed_sum == QUEUE_TEST_THREADS*(n*(n+1)/2), "Queue items got corrupted");
+	return cycles;
+}
+void test_mpmc_queue() {
+	Mpmc_Queue q;
+	mpmc_queue_init(&q, u64, 5, get_heap_allocator());
+	assert(q.mask+1 == 8, "Queue capacity was not rounded up to a power of two");
+	
+	for (u64 i = 0; i < 8; i++) assert(mpmc_queue_push(&q, i), "Queue push failed before full");
+	u64 extra = 69;
+	assert(!mpmc_queue_push(&q, extra), "Queue push should fail when full");
+	assert(mpmc_queue_get_count(&q) == 8, "Queue count is wrong");
+	for (u64 i = 0; i < 8; i++) {
+		u64 item;
+		assert(mpmc_queue_pop(&q, &item) && item == i, "Queue is not FIFO");
+	}
+	u64 item;
+	assert(!mpmc_queue_pop(&q, &item), "Queue pop should fail when empty");
+	// Wrap around a few laps
+	for (u64 i = 0; i < 100; i++) {
+		assert(mpmc_queue_push(&q, i) && mpmc_queue_pop(&q, &item) && item == i, "Queue broke after wrapping");
+	}
+	mpmc_queue_destroy(&q);
+	
+	Queue_Test_Shared_Data *data = (Queue_Test_Shared_Data*)alloc(get_heap_allocator(), sizeof(Queue_Test_Shared_Data));
+	memset(data, 0, sizeof(*data));
+	mpmc_queue_init(&data->queue, u64, 1024, get_heap_allocator());
+	mutex_init(&data->mutex);
+	growing_array_init((void**)&data->array, sizeof(u64), get_heap_allocator());
+	
+	data->use_mutex = false;
+	u64 queue_cycles = queue_test_run(data);
+	data->use_mutex = true;
+	u64 mutex_cycles = queue_test_run(data);
+	
+	// Not a test, but it's nice to see the numbers.
+	const u64 total = QUEUE_TEST_THREADS*QUEUE_TEST_ITEMS_PER_PRODUCER;
+	print("\n\t%d producers, %d consumers: Mpmc_Queue %.1f cycles per item, Mutex + growing array %.1f cycles per item\n", QUEUE_TEST_THREADS, QUEUE_TEST_THREADS, (f64)queue_cycles/(f64)total, (f64)mutex_cycles/(f64)total);
+	
+	growing_array_deinit((void**)&data->array);
+	mutex_destroy(&data->mutex);
+	mpmc_queue_destroy(&data->queue);
+	dealloc(get_heap_allocator(), data);
+}
+
+#define RING_TEST_ITEMS 200000
+void ring_test_producer(Thread *t) {
+	Spsc_Ring *ring = (Spsc_Ring*)t->data;
+	for (u64 i = 1; i <= RING_TEST_ITEMS; i++) {
+		while (!spsc_ring_push(ring, i)) os_yield_thread();
+	}
+}
+void test_spsc_ring() {
+	Spsc_Ring ring;
+	spsc_ring_init(&ring, u64, 5, get_heap_allocator());
+	assert(ring.mask+1 == 8, "Ring capacity was not rounded up to a power of two");
+	
+	for (u64 i = 0; i < 8; i++) assert(spsc_ring_push(&ring, i), "Ring push failed before full");
+	u64 extra = 69;
+	assert(!spsc_ring_push(&ring, extra), "Ring push should fail when full");
+	assert(spsc_ring_get_count(&ring) == 8, "Ring count is wrong");
+	u64 item;
+	for (u64 i = 0; i < 8; i++) {
+		assert(spsc_ring_pop(&ring, &item) && item == i, "Ring is not FIFO");
+	}
+	assert(!spsc_ring_pop(&ring, &item), "Ring pop should fail when empty");
+	for (u64 i = 0; i < 100; i++) {
+		assert(spsc_ring_push(&ring, i) && spsc_ring_pop(&ring, &item) && item == i, "Ring broke after wrapping");
+	}
+	spsc_ring_destroy(&ring);
+	
+	// One producer thread, this thread consumes. Items need to come out in order.
+	spsc_ring_init(&ring, u64, 64, get_heap_allocator());
+	Thread producer;
+	os_thread_init(&producer, ring_test_producer);
+	producer.data = &ring;
+	os_thread_start(&producer);
+	u64 expected = 1;
+	while (expected <= RING_TEST_ITEMS) {
+		if (spsc_ring_pop(&ring, &item)) {
+			assert(item == expected, "Ring item out of order, expected %llu got %llu", expected, item);
+			expected += 1;
+		} else {
+			os_yield_thread();
+		}
+	}
+	os_thread_destroy(&producer);
+	assert(spsc_ring_get_count(&ring) == 0, "Ring should be empty");
+	spsc_ring_destroy(&ring);
+}
+
+#define JOB_TEST_COUNT 10000
+void job_test_square(void *data, u64 index) {
+	u64 *results = (u64*)data;
+	u8 *scratch = (u8*)talloc(256); // Workers have their own temporary storage
+	memset(scratch, 0xEE, 256);
+	results[index] = index*index;
+}
+void job_test_spawn(void *data, u64 index) {
+	// Jobs starting jobs and waiting on them
+	u64 *results = (u64*)data + index*100;
+	u8 *scratch = (u8*)talloc(1024);
+	memset(scratch, (int)index, 1024);
+	Job_Counter inner = ZERO(Job_Counter);
+	job_run_many(job_test_square, results, 100, &inner);
+	job_wait(&inner);
+	for (u64 i = 0; i < 100; i++) assert(results[i] == i*i, "Nested job did not finish before job_wait returned");
+	// The jobs we ran while waiting must not have freed our temporary storage
+	for (u64 i = 0; i < 1024; i++) assert(scratch[i] == (u8)index, "Temporary storage was overwritten while waiting on nested jobs");
+}
+void test_jobs() {
+	// Runs inline before the job system is up
+	u64 inline_result = 0;
+	job_run(job_test_square, &inline_result, 0);
+	
+	job_system_init(4);
+	assert(job_system_get_worker_count() == 4, "Wrong worker count");
+	
+	u64 *results = (u64*)alloc(get_heap_allocator(), JOB_TEST_COUNT*sizeof(u64));
+	Job_Counter counter = ZERO(Job_Counter);
+	job_run_many(job_test_square, results, JOB_TEST_COUNT, &counter);
+	job_wait(&counter);
+	assert(counter.count == 0, "Job counter is not 0 after job_wait");
+	for (u64 i = 0; i < JOB_TEST_COUNT; i++) {
+		assert(results[i] == i*i, "Job %llu did not run", i);
+	}
+	
+	memset(results, 0, JOB_TEST_COUNT*sizeof(u64));
+	job_run_many(job_test_spawn, results, JOB_TEST_COUNT/100, &counter);
+	job_wait(&counter);
+	for (u64 i = 0; i < JOB_TEST_COUNT; i++) {
+		assert(results[i] == (i%100)*(i%100), "Nested job %llu did not run", i);
+	}
+	
+	// Give the workers time to go to sleep, starting jobs has to wake them
+	os_sleep(10);
+	memset(results, 0, JOB_TEST_COUNT*sizeof(u64));
+	job_run_many(job_test_square, results, JOB_TEST_COUNT, &counter);
+	job_wait(&counter);
+	for (u64 i = 0; i < JOB_TEST_COUNT; i++) {
+		assert(results[i] == i*i, "Job %llu did not run after the workers went to sleep", i);
+	}
+	
+	job_system_shutdown();
+	dealloc(get_heap_allocator(), results);
 }
 
 #ifndef OOGABOOGA_HEADLESS
@@ -1363,6 +2345,69 @@ void test_growing_array() {
     assert(growing_array_get_valid_count(things) == 99, "Failed: growing_array_get_valid_count");
 }
 
+// Not really a test, more of a benchmark. Compare the numbers from a build with and without
+// ENABLE_LARGE_PAGES to see the TLB difference.
+typedef struct Large_Page_Test_Quad {
+	// Same layout as Draw_Quad, which doesn't exist in headless builds
+	Vector2 bottom_left, top_left, top_right, bottom_right;
+	Vector4 color;
+	void *image;
+	s32 filters[2];
+	s32 z;
+	u8 type;
+	bool has_scissor;
+	Vector4 uv;
+	Vector4 scissor;
+	Vector4 userdata[4];
+} Large_Page_Test_Quad;
+void test_large_pages() {
+	Allocator heap = get_heap_allocator();
+	
+	print("(os.large_page_size = %llu)\n", os.large_page_size);
+	
+	// Heap walk: touch one 4kb page at a time in a scattered order, so with normal pages
+	// pretty much every access is a TLB miss.
+	const u64 walk_size = MB(64);
+	const u64 walk_page_count = walk_size / KB(4);
+	const u64 walk_access_count = walk_page_count * 64;
+	u8 *walk = (u8*)alloc(heap, walk_size);
+	memset(walk, 1, walk_size); // Fault everything in before measuring
+	
+	volatile u8 *walk_reader = walk; // Don't let the compiler figure out the sum
+	u64 sum = 0;
+	u64 start = rdtsc();
+	for (u64 i = 0; i < walk_access_count; i++) {
+		u64 page = (i * 7919) % walk_page_count; // Prime stride
+		sum += walk_reader[page*KB(4) + (i & 63)];
+	}
+	u64 walk_cycles = rdtsc() - start;
+	assert(sum == walk_access_count, "Heap walk read garbage");
+	print("\tScattered heap walk (%llu mb): %.2f cycles per access\n", walk_size/MB(1), (f64)walk_cycles/(f64)walk_access_count);
+	dealloc(heap, walk);
+	
+	// Quad buffer: fill it up like a frame of drawing would, then read it back like the renderer
+	const u64 quad_count = 256*1024;
+	Large_Page_Test_Quad *quads = (Large_Page_Test_Quad*)alloc(heap, quad_count*sizeof(Large_Page_Test_Quad));
+	memset(quads, 0, quad_count*sizeof(Large_Page_Test_Quad));
+	
+	start = rdtsc();
+	for (u64 i = 0; i < quad_count; i++) {
+		Large_Page_Test_Quad *q = &quads[i];
+		q->bottom_left  = v2((f32)i, 0);
+		q->top_right    = v2((f32)i+1, 1);
+		q->color        = v4(1, 1, 1, 1);
+		q->z            = (s32)i;
+	}
+	s64 z_sum = 0;
+	for (u64 i = 0; i < quad_count; i++) {
+		z_sum += quads[i].z;
+	}
+	u64 quad_cycles = rdtsc() - start;
+	assert(z_sum == (s64)(quad_count*(quad_count-1)/2), "Quad buffer read garbage");
+	print("\tQuad buffer (%llu quads, %llu mb): %.2f cycles per quad\n", quad_count, (quad_count*sizeof(Large_Page_Test_Quad))/MB(1), (f64)quad_cycles/(f64)quad_count);
+	dealloc(heap, quads);
+}
+
 void oogabooga_run_tests() {
 	
 	print("Testing growing array... ");
@@ -1377,6 +2422,10 @@ void oogabooga_run_tests() {
 	test_threads();
 	print("OK!\n");
 	
+	print("Testing threaded allocator... ");
+	test_allocator_threads();
+	print("OK!\n");
+	
 	print("Testing strings... ");
 	test_strings();
 	print("OK!\n");
@@ -1401,13 +2450,45 @@ void oogabooga_run_tests() {
 	test_hash_table();
 	print("OK!\n");
 	
+	print("Testing pool... ");
+	test_pool();
+	print("OK!\n");
+	
 	print("Testing random distribution... ");
 	test_random_distribution();
 	print("OK!\n");
 	
+	print("Testing atomics... ");
+	test_atomics();
+	print("OK!\n");
+	
+	print("Testing spinlock... ");
+	test_spinlock();
+	print("OK!\n");
+	
 	print("Testing mutex... ");
 	test_mutex();
 	print("OK!\n");
+	
+	print("Testing semaphores, condition variables and events... ");
+	test_sync_primitives();
+	print("OK!\n");
+	
+	print("Testing mpmc queue... ");
+	test_mpmc_queue();
+	print("OK!\n");
+	
+	print("Testing spsc ring... ");
+	test_spsc_ring();
+	print("OK!\n");
+	
+	print("Testing jobs... ");
+	test_jobs();
+	print("OK!\n");
+	
+	print("Benchmarking large pages... ");
+	test_large_pages();
+	print("OK!\n");
 
 #ifndef OOGABOOGA_HEADLESS
 	print("Testing radix sort... ");